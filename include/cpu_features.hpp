@@ -0,0 +1,37 @@
+#pragma once
+
+// Runtime CPU feature detection for the vectorized kernels.
+// --------------------------------
+// The kernels for each instruction set live in the same translation unit as
+// the scalar code and are compiled with per-function target attributes, so the
+// project needs no special /arch or -m flags. MSVC accepts the intrinsics
+// without them.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TSSSS_X86 1
+#else
+#define TSSSS_X86 0
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TSSSS_TARGET_AVX2
+#define TSSSS_TARGET_AVX512
+#else
+#define TSSSS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TSSSS_TARGET_AVX512 __attribute__((target("avx512f,avx512dq")))
+#endif
+
+enum class SimdLevel
+{
+	SCALAR,
+	AVX2,
+	AVX512,
+};
+
+// Best instruction set supported by both the CPU and the OS, capped by
+// simd_set_level().
+SimdLevel simd_level();
+// Cap the instruction set used by the vectorized kernels, e.g. to compare
+// kernels in a benchmark. Levels the machine does not support are ignored.
+void simd_set_level(SimdLevel level);
+const char *simd_level_name(SimdLevel level);
@@ -1,7 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+using namespace std;
+
+enum class HaarMode
+{
+	STANDARD,
+	NONSTANDARD,
+};
+
+enum class Wavelet
+{
+	HAAR,
+	CDF53,
+	CDF97,
+};
+
+// Difference between an image and a reference, as measured by image_error().
+struct ImageError
+{
+	double fro;
+	double psnr;
+	double max_abs;
+	double rel_l2;
+};
+
 void haar_1d(int n, double x[]);
 void haar_1d_inverse(int n, double x[]);
 void haar_2d(int m, int n, double u[]);
 void haar_2d_inverse(int m, int n, double u[]);
+int haar_1d_work_size(int n);
+int haar_2d_work_size(int m, int n);
+template <typename T> void haar_1d(int n, T x[], T w[]);
+template <typename T> void haar_1d_inverse(int n, T x[], T w[]);
+template <typename T> void haar_2d(int m, int n, T u[], T w[]);
+template <typename T> void haar_2d_inverse(int m, int n, T u[], T w[]);
+template <typename T> void haar_2d_rows(int m, int n, T u[], int ldu, T w[]);
+template <typename T> void haar_2d_rows_inverse(int m, int n, T u[], int ldu, T w[]);
+int haar_2d_panel_rows(int m, int n, int elem_size);
+int haar_2d_blocked_work_size(int m, int n, int panel);
+template <typename T> void haar_2d_blocked(int m, int n, T u[], T w[], int panel);
+template <typename T> void haar_2d_inverse_blocked(int m, int n, T u[], T w[], int panel);
+int haar_2d_interleaved_work_size(int m, int n, int c);
+template <typename T> void haar_2d_interleaved(int m, int n, int c, T u[], T w[]);
+template <typename T> void haar_2d_inverse_interleaved(int m, int n, int c, T u[], T w[]);
+int haar_2d_lowpass_work_size(int m, int n, int cm, int cn);
+template <typename T> void haar_2d_nonstandard(int m, int n, T u[], T w[]);
+template <typename T> void haar_2d_nonstandard_inverse(int m, int n, T u[], T w[]);
+template <typename T> void haar_2d(int m, int n, T u[], T w[], HaarMode mode);
+template <typename T> void haar_2d_inverse(int m, int n, T u[], T w[], HaarMode mode);
+template <typename T>
+void haar_2d_lowpass(int m, int n, const T u[], int cm, int cn, T c[], T w[], HaarMode mode = HaarMode::STANDARD);
+template <typename T> int haar_select_largest(int n, const T c[], int k, int index[], T value[], int w[]);
+int wavelet_2d_work_size(int m, int n);
+template <typename T> void wavelet_2d(int m, int n, T u[], T w[], Wavelet wavelet, HaarMode mode);
+template <typename T> void wavelet_2d_dual(int m, int n, T u[], T w[], Wavelet wavelet, HaarMode mode);
+template <typename T> void wavelet_2d_inverse(int m, int n, T u[], T w[], Wavelet wavelet, HaarMode mode);
+template <typename T>
+void haar_2d_update(int m, int n, T u[], T c[], const T v[], int count, const int rects[],
+	HaarMode mode = HaarMode::STANDARD);
+template <typename T> void haar_2d_simd(int m, int n, T u[], T w[]);
+template <typename T> void haar_2d_inverse_simd(int m, int n, T u[], T w[]);
+void haar_2d_integer(int m, int n, int u[], int w[]);
+void haar_2d_inverse_integer(int m, int n, int u[], int w[]);
+class ThreadPool;
+template <typename T> void haar_2d_parallel(int m, int n, T u[], ThreadPool &pool);
+template <typename T> void haar_2d_inverse_parallel(int m, int n, T u[], ThreadPool &pool);
+template <typename T> void haar_2d_parallel(int m, int n, T u[], int num_threads);
+template <typename T> void haar_2d_inverse_parallel(int m, int n, T u[], int num_threads);
+template <typename T> int haar_2d_lowpass_batch_lanes();
+template <typename T> int haar_2d_lowpass_batch_work_size(int m, int n, int cm, int cn);
+template <typename T>
+void haar_2d_lowpass_batch(int count, int m, int n, const T *const u[], int cm, int cn, T c[], T w[],
+	HaarMode mode = HaarMode::STANDARD);
+template <typename T>
+void haar_2d_lowpass_batch(int count, int m, int n, const T *const u[], int cm, int cn, T c[], ThreadPool &pool,
+	HaarMode mode = HaarMode::STANDARD);
+struct SstxCoef;
+void haar_convolve(int texels, int coefs, const float kernel[], const float radiance[], float color[],
+	ThreadPool &pool);
+void haar_convolve_sparse(int texels, int k, const SstxCoef kernel[], const float radiance[], float color[],
+	ThreadPool &pool);
+double haar_codebook(int n, int k, const SstxCoef x[], int dim, int entries, int iterations, uint64_t seed,
+	ThreadPool &pool, float codebook[], int assignment[]);
+int haar_lowrank(int n, int k, const SstxCoef x[], int dim, double error, int max_rank, int power_iterations,
+	uint64_t seed, ThreadPool &pool, float basis[], float weights[], double *rank_error);
+template <typename T>
+ImageError image_error(int m, int n, int channels, const T a[], const T b[], double peak, ThreadPool &pool,
+	ImageError channel_error[] = nullptr);
+class MappedFile;
+template <typename T> bool haar_2d_file(MappedFile &file, uint64_t offset, int m, int n, size_t budget);
+template <typename T> bool haar_2d_inverse_file(MappedFile &file, uint64_t offset, int m, int n, size_t budget);
 int i4_max(int i1, int i2);
 int i4_min(int i1, int i2);
 double *r8mat_copy_new(int m, int n, double a1[]);
@@ -15,4 +105,7 @@ double *r8vec_linspace_new(int n, double a_lo, double a_hi);
 double *r8vec_ones_new(int n);
 void r8vec_transpose_print(int n, double a[], string title);
 double *r8vec_uniform_01_new(int n, int &seed);
+double r8_uniform_01_counter(uint64_t seed, uint64_t index);
+double *r8mat_uniform_01_counter_new(int m, int n, uint64_t seed, ThreadPool &pool);
+double *r8vec_uniform_01_counter_new(int n, uint64_t seed, ThreadPool &pool);
 void timestamp();
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A file mapped into memory one view at a time.
+// --------------------------------
+// Only the current view is mapped, so the pages of the file a process can
+// have resident are bounded by the view size however large the file is.
+// map() takes any offset; the view is widened internally to the mapping
+// granularity of the system. Writes through a view of a writable file go
+// to the file.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	// Opens an existing file. Fails if it does not exist or is empty.
+	bool open(const char *path, bool writable);
+	void close();
+	bool isOpen() const;
+	uint64_t size() const
+	{
+		return file_size;
+	}
+	// Maps [offset, offset + length) of the file, replacing the current
+	// view, and returns its address or nullptr on failure.
+	void *map(uint64_t offset, size_t length);
+	void unmap();
+	// Size of the pages views are mapped in.
+	static size_t pageSize();
+
+private:
+	uint64_t file_size = 0;
+	bool writable = false;
+	void *view = nullptr;
+	size_t view_length = 0;
+#ifdef _WIN32
+	void *file = nullptr;
+	void *mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A ring of persistently mapped buffers that shader results are read back
+// through, written to a stream by a thread of its own.
+// --------------------------------
+// acquire() binds the next slot as an SSBO range for the dispatches that
+// fill it, and submit() fences them. The GPU can be up to one slot per ring
+// entry ahead: the GL thread only blocks when it comes back to a slot whose
+// fence has not signaled yet or whose data is still being written. Fences
+// signal in order, and the writer thread writes the slots as they are handed
+// over, so the stream gets them in submission order. The ring must be used
+// from the thread the GL context is current on. If the buffer cannot be
+// mapped, each slot is copied out with glGetBufferSubData once its fence
+// signals instead, on the GL thread.
+class ReadbackRing
+{
+public:
+	// slots buffers of slot_size bytes each, written to out.
+	ReadbackRing(int slots, size_t slot_size, std::ostream &out) : out(out), fences(slots), state(slots, State::FREE)
+	{
+		GLint align = 1;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align);
+		this->slot_size = slot_size;
+		stride = (slot_size + align - 1) / align * align;
+		GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferStorage(GL_SHADER_STORAGE_BUFFER, stride * slots, nullptr, flags);
+		mapped = (const char *)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, stride * slots, flags);
+		if (mapped == nullptr)
+			copies.resize(stride * slots);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		writer = std::thread([this]() { writerLoop(); });
+	}
+	~ReadbackRing()
+	{
+		finish();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		writer.join();
+		if (mapped != nullptr)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+			glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &buffer);
+	}
+	ReadbackRing(const ReadbackRing &) = delete;
+	ReadbackRing &operator=(const ReadbackRing &) = delete;
+
+	// Whether the buffer is mapped, rather than copied out slot by slot.
+	bool persistent() const
+	{
+		return mapped != nullptr;
+	}
+
+	// Waits until the next slot is free and binds it to the SSBO binding.
+	void acquire(GLuint binding)
+	{
+		int slot = next % (int)state.size();
+		while (slotState(slot) == State::PENDING)
+			retireOldest(true);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			freed.wait(lock, [&]() { return state[slot] == State::FREE; });
+		}
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer, (GLintptr)(stride * slot), slot_size);
+	}
+	// Fences the commands issued since acquire(); the first bytes of the slot
+	// are written once they complete.
+	void submit(size_t bytes)
+	{
+		int slot = next % (int)state.size();
+		glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			state[slot] = State::PENDING;
+		}
+		pending.push_back({slot, bytes});
+		next++;
+		// Hand over whatever has completed meanwhile, without waiting.
+		while (!pending.empty() && retireOldest(false))
+			;
+	}
+	// Waits until every submitted slot is written; false if a write failed.
+	bool finish()
+	{
+		while (!pending.empty())
+			retireOldest(true);
+		std::unique_lock<std::mutex> lock(mutex);
+		freed.wait(lock, [&]() { return writes.empty() && writing < 0; });
+		return !failed;
+	}
+
+private:
+	enum class State
+	{
+		FREE,
+		PENDING,
+		WRITING,
+	};
+
+	State slotState(int slot)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return state[slot];
+	}
+	// Passes the oldest fenced slot to the writer once its fence signals.
+	// Returns false if it has not and wait is false.
+	bool retireOldest(bool wait)
+	{
+		int slot = pending.front().first;
+		GLenum status = glClientWaitSync(fences[slot], wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+			return false;
+		glDeleteSync(fences[slot]);
+		if (mapped == nullptr)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)(stride * slot), pending.front().second,
+				copies.data() + stride * slot);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			state[slot] = State::WRITING;
+			writes.push_back(pending.front());
+		}
+		pending.pop_front();
+		wake.notify_one();
+		return true;
+	}
+	void writerLoop()
+	{
+		for (;;)
+		{
+			std::pair<int, size_t> write;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stopping || !writes.empty(); });
+				if (writes.empty())
+					return;
+				write = writes.front();
+				writes.pop_front();
+				writing = write.first;
+			}
+			out.write((mapped != nullptr ? mapped : copies.data()) + stride * write.first, write.second);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				failed = failed || !out.good();
+				state[write.first] = State::FREE;
+				writing = -1;
+			}
+			freed.notify_all();
+		}
+	}
+
+	std::ostream &out;
+	GLuint buffer = 0;
+	const char *mapped = nullptr;
+	// The slots, copied out, if the buffer could not be mapped.
+	std::vector<char> copies;
+	size_t slot_size = 0;
+	size_t stride = 0;
+	int next = 0;
+	// Touched by the GL thread only.
+	std::vector<GLsync> fences;
+	std::deque<std::pair<int, size_t>> pending;
+	// Shared with the writer thread, under mutex.
+	std::vector<State> state;
+	std::deque<std::pair<int, size_t>> writes;
+	int writing = -1;
+	bool failed = false;
+	bool stopping = false;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable freed;
+};
@@ -162,6 +162,10 @@ public:
     { 
         glUniform2iv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
     }
+    void setVec4iArray(const std::string &name, int count, const glm::ivec4 *value) const
+    { 
+        glUniform4iv(glGetUniformLocation(ID, name.c_str()), count, &value[0][0]); 
+    }
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
         glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+// One kept coefficient, laid out as SparseCoef in the shaders' std430
+// KernelCoef buffer.
+struct SstxCoef
+{
+	int32_t index;
+	float value;
+};
+
+static_assert(sizeof(SstxCoef) == 8, "SstxCoef is written to disk and to SSBOs as is");
+
+// Entry of the chunk index of a .sstx file.
+// --------------------------------
+struct SstxChunk
+{
+	// Offset of the kernels of the chunk in the file.
+	uint64_t offset;
+	uint32_t first_row;
+	uint32_t rows;
+	// FNV-1a hash of the kernels of the chunk.
+	uint64_t checksum;
+};
+
+static_assert(sizeof(SstxChunk) == 24, "SstxChunk is written to disk as is");
+
+// Header of a baked .sstx kernel coefficient file.
+// --------------------------------
+// The file is laid out to be used in place through a memory mapping (see
+// SstxFile): the header, then the chunk index, chunk_count SstxChunk
+// entries, then from dataOffset(), a multiple of 4096, the tex_w * tex_h
+// kernels, one per kernel center in the order the HAAR mode bakes them, in
+// chunks of chunk_rows rows of centers. The chunks follow each other in
+// order, so the kernels are also one array. Each kernel is coef_k SstxCoef
+// entries: the coefficients of largest magnitude in the coef_w x coef_h
+// block, with coefficient (row, col) of the block at index row * coef_w +
+// col.
+//
+// Files that carry the header of a bake, shards, codebooks and low-rank
+// files, leave chunk_count and checksum 0 or as in the .sstx file.
+struct SstxHeader
+{
+	static const uint32_t VERSION = 5;
+	// Alignment of the kernels in the file.
+	static const uint32_t DATA_ALIGNMENT = 4096;
+
+	char magic[4] = {'S', 'S', 'T', 'X'};
+	uint32_t version = VERSION;
+	uint32_t tex_w = 0;
+	uint32_t tex_h = 0;
+	uint32_t coef_w = 0;
+	uint32_t coef_h = 0;
+	// Decomposition the coefficients were computed in, as HaarMode:
+	// 0 standard, 1 nonstandard.
+	uint32_t haar_mode = 0;
+	// Coefficients kept per kernel.
+	uint32_t coef_k = 0;
+	// Basis the coefficients are in, as Wavelet: 0 Haar, 1 CDF 5/3, 2 CDF 9/7.
+	uint32_t wavelet = 0;
+	// Distance from the kernel center beyond which the profile was taken as
+	// 0, infinite if it never was.
+	float cutoff_radius = INFINITY;
+	// Color channels a kernel holds weights for; 1 when one profile serves
+	// all of them.
+	uint32_t channels = 1;
+	// Type of the kernel entries: 0 for SstxCoef, an int32 index and a
+	// float32 value.
+	uint32_t data_type = 0;
+	// A and s of the diffuse profile, as tssss::fDiffuseProfile.
+	float profile_a = 0;
+	float profile_s = 0;
+	// Rows of kernel centers per chunk, the last chunk taking what is left,
+	// and the number of chunks, chunkCount() in a .sstx file.
+	uint32_t chunk_rows = 16;
+	uint32_t chunk_count = 0;
+	// FNV-1a hash of the header, with this field 0, and the chunk index.
+	uint64_t checksum = 0;
+
+	uint32_t chunkCount() const
+	{
+		return (tex_h + chunk_rows - 1) / chunk_rows;
+	}
+	uint64_t kernelBytes() const
+	{
+		return (uint64_t)coef_k * sizeof(SstxCoef);
+	}
+	uint64_t dataOffset() const
+	{
+		uint64_t end = sizeof(SstxHeader) + (uint64_t)chunkCount() * sizeof(SstxChunk);
+		return (end + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+	}
+
+	bool write(std::ostream &out) const
+	{
+		out.write((const char *)this, sizeof(SstxHeader));
+		return out.good();
+	}
+	// Fails on a short read, a missing magic, a version this code does not
+	// know or no chunks.
+	bool read(std::istream &in)
+	{
+		SstxHeader header;
+		in.read((char *)&header, sizeof(SstxHeader));
+		if (!in.good() || memcmp(header.magic, "SSTX", 4) != 0 || header.version != VERSION ||
+			header.chunk_rows == 0)
+			return false;
+		*this = header;
+		return true;
+	}
+};
+
+static_assert(sizeof(SstxHeader) == 72, "SstxHeader is written to disk as is");
+
+// FNV-1a hash of SIZE bytes at DATA, continuing from HASH.
+inline uint64_t sstxChecksum(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Header of a shard of a bake, the kernels of a range of kernel center rows.
+// --------------------------------
+// The header is followed by the SstxHeader of the whole bake, then by the
+// kernels of rows first_row to first_row + rows_done - 1, tex_w per row in
+// the order of a .sstx file. rows_done is the checkpoint: it is rewritten
+// after the rows it counts are in the file, so a bake that stops resumes at
+// rows_done, and the shard is complete once it reaches rows.
+struct SstxShardHeader
+{
+	static const uint32_t VERSION = 1;
+
+	char magic[4] = {'S', 'S', 'T', 'S'};
+	uint32_t version = VERSION;
+	uint32_t first_row = 0;
+	uint32_t rows = 0;
+	uint32_t rows_done = 0;
+
+	bool write(std::ostream &out) const
+	{
+		out.write((const char *)this, sizeof(SstxShardHeader));
+		return out.good();
+	}
+	// Fails on a short read, a missing magic, a version this code does not
+	// know or a checkpoint past the end of the shard.
+	bool read(std::istream &in)
+	{
+		SstxShardHeader header;
+		in.read((char *)&header, sizeof(SstxShardHeader));
+		if (!in.good() || memcmp(header.magic, "SSTS", 4) != 0 || header.version != VERSION ||
+			header.rows_done > header.rows)
+			return false;
+		*this = header;
+		return true;
+	}
+};
+
+static_assert(sizeof(SstxShardHeader) == 20, "SstxShardHeader is written to disk as is");
+
+// Header of a kernel codebook file, made from a .sstx file by tssss-bake
+// -codebook.
+// --------------------------------
+// The header is followed by the SstxHeader of the .sstx file, whose checksum
+// tells whether a .sstx file is the one the codebook was made from, then by
+// entries codebook entries of coef_k SstxCoef each, laid out as the kernels of
+// a .sstx file, then by tex_w * tex_h uint32_t entry numbers below entries,
+// one for each kernel of the .sstx file in its order.
+struct SstxCodebookHeader
+{
+	static const uint32_t VERSION = 1;
+
+	char magic[4] = {'S', 'S', 'T', 'C'};
+	uint32_t version = VERSION;
+	uint32_t entries = 0;
+	// Squared error of the kernels as the codebook gives them, over their
+	// squared norm.
+	float error = 0;
+
+	bool write(std::ostream &out) const
+	{
+		out.write((const char *)this, sizeof(SstxCodebookHeader));
+		return out.good();
+	}
+	// Fails on a short read, a missing magic or a version this code does not
+	// know.
+	bool read(std::istream &in)
+	{
+		SstxCodebookHeader header;
+		in.read((char *)&header, sizeof(SstxCodebookHeader));
+		if (!in.good() || memcmp(header.magic, "SSTC", 4) != 0 || header.version != VERSION)
+			return false;
+		*this = header;
+		return true;
+	}
+};
+
+static_assert(sizeof(SstxCodebookHeader) == 16, "SstxCodebookHeader is written to disk as is");
+
+// Header of a low-rank kernel file, made from a .sstx file by tssss-bake
+// -lowrank.
+// --------------------------------
+// The header is followed by the SstxHeader of the .sstx file, then by rank
+// orthonormal basis vectors of coef_w * coef_h floats, coefficient (row, col)
+// of the block at index row * coef_w + col, then by rank float weights for
+// each kernel of the .sstx file in its order. A kernel is the sum of the
+// basis vectors times its weights.
+struct SstxLowRankHeader
+{
+	static const uint32_t VERSION = 1;
+
+	char magic[4] = {'S', 'S', 'T', 'L'};
+	uint32_t version = VERSION;
+	uint32_t rank = 0;
+	// Squared error of the kernels as the basis and weights give them, over
+	// their squared norm.
+	float error = 0;
+
+	bool write(std::ostream &out) const
+	{
+		out.write((const char *)this, sizeof(SstxLowRankHeader));
+		return out.good();
+	}
+	// Fails on a short read, a missing magic or a version this code does not
+	// know.
+	bool read(std::istream &in)
+	{
+		SstxLowRankHeader header;
+		in.read((char *)&header, sizeof(SstxLowRankHeader));
+		if (!in.good() || memcmp(header.magic, "SSTL", 4) != 0 || header.version != VERSION)
+			return false;
+		*this = header;
+		return true;
+	}
+};
+
+static_assert(sizeof(SstxLowRankHeader) == 16, "SstxLowRankHeader is written to disk as is");
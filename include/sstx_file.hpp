@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+#include "mapped_file.hpp"
+#include "sstx.hpp"
+
+// A .sstx file mapped into memory.
+// --------------------------------
+// The header, the chunk index and the kernels are used where they lie in
+// the mapping, so opening a file costs the checks of its header and index,
+// and the kernels are paged in as they are read. Writers put the header
+// and room for the index with begin(), then the kernels, and seal() the
+// file once it is closed.
+class SstxFile
+{
+public:
+	// Maps the .sstx file at PATH. Fails if it is not one, if its index or
+	// chunks do not fit it or, with VERIFY, if a chunk does not match its
+	// checksum. The header and index are always checked against theirs.
+	bool open(const char *path, bool verify);
+	void close();
+	const SstxHeader &header() const
+	{
+		return *(const SstxHeader *)base;
+	}
+	const SstxChunk *chunks() const
+	{
+		return (const SstxChunk *)(base + sizeof(SstxHeader));
+	}
+	// The kernels of the whole map, coef_k each, in order.
+	const SstxCoef *kernels() const
+	{
+		return (const SstxCoef *)(base + header().dataOffset());
+	}
+
+	// Writes HEADER and zeroes up to its dataOffset(), where the kernels go.
+	static bool begin(std::ostream &out, const SstxHeader &header);
+	// Fills in the chunk index and the checksums of the .sstx file at PATH,
+	// whose kernels are all written.
+	static bool seal(const char *path);
+
+private:
+	MappedFile file;
+	const char *base = nullptr;
+};
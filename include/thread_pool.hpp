@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed-size pool of worker threads for data-parallel loops.
+// --------------------------------
+// parallelFor() splits [0, count) into one contiguous chunk per thread, so
+// a given pool size always hands the same indices to the same thread index.
+// Work that depends only on its indices therefore gives the same result for
+// every pool size. The calling thread runs chunk 0 itself.
+class ThreadPool
+{
+public:
+	// num_threads <= 0 uses one thread per hardware thread.
+	explicit ThreadPool(int num_threads = 0)
+	{
+		if (num_threads <= 0)
+			num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+		for (int t = 1; t < num_threads; t++)
+			workers.emplace_back([this, t]() { workerLoop(t); });
+	}
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread &worker : workers)
+			worker.join();
+	}
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	int size() const
+	{
+		return (int)workers.size() + 1;
+	}
+	// Call fn(begin, end, thread) once per thread with the chunk [begin, end)
+	// of [0, count) assigned to it; returns when all chunks are done.
+	void parallelFor(int count, const std::function<void(int, int, int)> &fn)
+	{
+		if (count <= 0)
+			return;
+		if (workers.empty() || count == 1)
+		{
+			fn(0, count, 0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &fn;
+			job_count = count;
+			pending = (int)workers.size();
+			generation++;
+		}
+		wake.notify_all();
+		runChunk(0);
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return pending == 0; });
+		job = nullptr;
+	}
+
+private:
+	void runChunk(int t)
+	{
+		int n = size();
+		int begin = (int)((long long)job_count * t / n);
+		int end = (int)((long long)job_count * (t + 1) / n);
+		if (begin < end)
+			(*job)(begin, end, t);
+	}
+	void workerLoop(int t)
+	{
+		unsigned long long seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+			}
+			runChunk(t);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				pending--;
+			}
+			done.notify_one();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(int, int, int)> *job = nullptr;
+	int job_count = 0;
+	int pending = 0;
+	unsigned long long generation = 0;
+	bool stopping = false;
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Settings shared by the renderer and the kernel baker.
+// --------------------------------
+namespace tssss
+{
+	const unsigned int tex_w = 512;
+	const unsigned int tex_h = 512;
+	// Candidate block of the transform the kernels choose from, and the
+	// number of coefficients each kernel keeps.
+	const unsigned int coef_w = 32;
+	const unsigned int coef_h = 32;
+	const unsigned int coef_k = 64;
+	// Kernels HaarBake bakes per dispatch. With a CDF wavelet each needs a
+	// tex_w x tex_h slice of scratch, 1 MB at 512 x 512.
+	const unsigned int bake_tile = 128;
+	// Tiles the GPU may bake ahead of the file writes.
+	const unsigned int bake_ring = 4;
+	// Share of the energy of the diffuse profile the bakers drop: texels
+	// farther from the kernel center than profileCutoffRadius of it are 0.
+	const double profile_cutoff_energy = 1e-6;
+	// Dirty rects RenderPass2 takes per dispatch; more redo the whole map.
+	const unsigned int max_dirty_rects = 16;
+	// World-space distance the point light of the SSS mode reaches, with
+	// haar-test -point-light.
+	const float light_range = 0.1f;
+
+	// World position map the HAAR mode renders, saved for tssss-bake. It is
+	// the RGBA32F texture as glGetTexImage returns it: texel (row, col) of
+	// the shaders, which address it as ivec2(row, col), starts at float
+	// 4 * (col * tex_w + row), and texels the mesh does not cover are 0.
+	const char *const world_pos_file = "test.wpos";
+	const char *const coef_file = "test.sstx";
+	// Codebook the SSS mode samples kernels through, made from coef_file by
+	// tssss-bake -codebook, and its default size.
+	const char *const codebook_file = "test.sstc";
+	const unsigned int codebook_entries = 4096;
+	const unsigned int codebook_iterations = 20;
+	// Low-rank factorization tssss-bake -lowrank makes from coef_file, the
+	// share of the kernels' squared norm it may lose, its largest rank and
+	// the power iterations of its randomized SVD. At rank coef_k a texel
+	// reads half the floats of its sparse kernel.
+	const char *const lowrank_file = "test.sstl";
+	const double lowrank_error = 0.01;
+	const unsigned int lowrank_max_rank = coef_k;
+	const unsigned int lowrank_power_iterations = 2;
+
+	// Parameters of the diffuse profile, recorded in baked files: the albedo
+	// A that scales it, and s that sets its width.
+	const float profile_a = 0.6f;
+	const float profile_s = 4.031441f;
+
+	// Diffuse profile of the kernels, as fDiffuseProfile in HaarPass2.
+	// exp(-s * r) is the cube of exp(-s * r / 3), which saves an exp per
+	// texel when baking.
+	inline float fDiffuseProfile(float r, float A = profile_a, float s = profile_s)
+	{
+		float e = std::exp(-s * r / 3);
+		return A * s * ((e * e * e + e) / (8 * 3.14159265358979f));
+	}
+
+	// Distance beyond which the profile, spread over a plane, holds ENERGY of
+	// its total; infinite for an ENERGY of 0. A term e^(-a r) of the profile
+	// holds 2 pi e^(-a r) (r / a + 1 / a^2) beyond r, out of 2 pi / a^2.
+	inline float profileCutoffRadius(double energy, float s = profile_s)
+	{
+		if (energy <= 0)
+			return INFINITY;
+		auto beyond = [s](double r) {
+			double sum = 0;
+			for (double a : {(double)s, s / 3.0})
+				sum += std::exp(-a * r) * (r / a + 1 / (a * a));
+			return sum;
+		};
+		double target = energy * beyond(0);
+		double lo = 0;
+		double hi = 1;
+		while (target < beyond(hi))
+			hi *= 2;
+		for (int i = 0; i < 64; i++)
+		{
+			double mid = (lo + hi) / 2;
+			if (target < beyond(mid))
+				lo = mid;
+			else
+				hi = mid;
+		}
+		return (float)hi;
+	}
+
+	// World-space bounds of the texels of each box of the coef_w x coef_h
+	// low-pass band, which the bakers cull kernels by: box (r, c) holds rows
+	// r * k_h / coef_h on and cols c * k_w / coef_w on, k_h and k_w the
+	// largest powers of 2 in tex_h and tex_w. TEXELS is the map as in
+	// world_pos_file, uncovered texels at the origin as the kernels see them.
+	// Box (r, c) has its low corner at 8 * (r * coef_w + c) and its high
+	// corner 4 floats on, as vec4 pairs in a std430 buffer.
+	inline std::vector<float> boxBounds(const float texels[])
+	{
+		unsigned int k_h = 1;
+		while (k_h * 2 <= tex_h)
+			k_h *= 2;
+		unsigned int k_w = 1;
+		while (k_w * 2 <= tex_w)
+			k_w *= 2;
+		unsigned int box_h = k_h / coef_h;
+		unsigned int box_w = k_w / coef_w;
+		std::vector<float> bounds(8 * coef_w * coef_h);
+		for (unsigned int box = 0; box < coef_w * coef_h; box++)
+		{
+			float *lo = &bounds[8 * box];
+			float *hi = lo + 4;
+			for (int d = 0; d < 3; d++)
+			{
+				lo[d] = INFINITY;
+				hi[d] = -INFINITY;
+			}
+			for (unsigned int row = box / coef_w * box_h; row < (box / coef_w + 1) * box_h; row++)
+			{
+				for (unsigned int col = box % coef_w * box_w; col < (box % coef_w + 1) * box_w; col++)
+				{
+					const float *t = texels + 4 * ((size_t)col * tex_w + row);
+					for (int d = 0; d < 3; d++)
+					{
+						lo[d] = std::min(lo[d], t[d]);
+						hi[d] = std::max(hi[d], t[d]);
+					}
+				}
+			}
+		}
+		return bounds;
+	}
+
+	// Squared distance from P to box BOX of BOUNDS, 0 inside it.
+	inline float boxDistance2(const std::vector<float> &bounds, unsigned int box, const float p[3])
+	{
+		float d2 = 0;
+		for (int d = 0; d < 3; d++)
+		{
+			float out = std::max(std::max(bounds[8 * box + d] - p[d], p[d] - bounds[8 * box + 4 + d]), 0.0f);
+			d2 += out * out;
+		}
+		return d2;
+	}
+}
@@ -11,8 +11,8 @@ in vec2 TexCoords;
 
 void main()
 {             
-	vec4 color = imageLoad(radiance_map, ivec2(TexCoords * imageSize(radiance_map)));
-	// vec4 color = imageLoad(radiance_map_after_sss, ivec2(TexCoords * imageSize(radiance_map_after_sss)));
+	// vec4 color = imageLoad(radiance_map, ivec2(TexCoords * imageSize(radiance_map)));
+	vec4 color = imageLoad(radiance_map_after_sss, ivec2(TexCoords * imageSize(radiance_map_after_sss)));
 	// vec4 color = imageLoad(world_pos_map, ivec2(TexCoords * imageSize(world_pos_map)));
 	// vec4 color = imageLoad(kernel, ivec2(TexCoords * imageSize(kernel)));
 	// vec4 color = texture(tex, TexCoords);
@@ -2,8 +2,9 @@
 
 layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
 
-uniform int coef_w, coef_h;
+uniform int coef_w, coef_h, coef_k;
 uniform int tex_w, tex_h;
+uniform int lowrank_rank;
 
 layout(rgba32f, binding = 0) uniform image2D radiance_map_after_sss;
 
@@ -12,10 +13,32 @@ layout(std430, binding = 0) buffer RadianceCoef
 	vec4 data[];
 } radiance_coef;
 
+struct SparseCoef
+{
+	int index;
+	float value;
+};
 layout(std430, binding = 1) buffer KernelCoef
 {
-	vec4 data[];
+	SparseCoef data[];
 } kernel_coef;
+// Codebook entry of the kernel of each texel, row * tex_w + col; the entries
+// are in KernelCoef, coef_k each.
+layout(std430, binding = 5) buffer KernelIndex
+{
+	uint data[];
+} kernel_index;
+// Weights of the kernel of each texel over the basis of tssss-bake -lowrank,
+// lowrank_rank each, and the basis vectors' dot products with RadianceCoef
+// (see LowRankProject). At lowrank_rank 0 the kernels are sampled sparse.
+layout(std430, binding = 7) buffer LowRankWeights
+{
+	float data[];
+} lowrank_weights;
+layout(std430, binding = 8) buffer LowRankProjection
+{
+	vec4 data[];
+} lowrank_projection;
 
 void main() {
 	uint size_coef_array = coef_w * coef_h;
@@ -24,9 +47,24 @@ void main() {
 	for (uint col = 0; col < tex_w; col++)
 	{
 		vec3 sum = vec3(0, 0, 0);
-		for (int i = 0; i < coef_w * coef_h; i++)
+		if (lowrank_rank > 0)
+		{
+			uint weight_base = (row * tex_w + col) * lowrank_rank;
+			for (int r = 0; r < lowrank_rank; r++)
+			{
+				sum += lowrank_projection.data[r].rgb * lowrank_weights.data[weight_base + r];
+			}
+		}
+		else
 		{
-			sum += vec3(radiance_coef.data[i]) * kernel_coef.data[(row * tex_w + col) * size_coef_array + i].r;
+			// Each kernel keeps its coef_k largest coefficients; the radiance
+			// block is dense, so the dot product gathers from it.
+			uint kernel_index_base = kernel_index.data[row * tex_w + col] * coef_k;
+			for (int i = 0; i < coef_k; i++)
+			{
+				SparseCoef c = kernel_coef.data[kernel_index_base + i];
+				sum += vec3(radiance_coef.data[c.index]) * c.value;
+			}
 		}
 		imageStore(radiance_map_after_sss, ivec2(row, col), vec4(sum, 1));
 	}
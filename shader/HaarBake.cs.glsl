@@ -0,0 +1,463 @@
+#version 450
+
+// Bakes a tile of kernels per dispatch, one workgroup per kernel, with the
+// same result as HaarPass2 dispatched once for each. Workgroup g bakes the
+// kernel centered on texel kernel_first + g (row * tex_w + col) and writes
+// its coef_k coefficients to KernelCoef entries [g * coef_k, (g + 1) * coef_k).
+// The workgroups share nothing: the Haar band is summed straight from the
+// profile, and the CDF wavelets lift in slice g of the Scratch buffer.
+// The profile is 0 farther than cutoff_radius from the center, and boxes of
+// the band whose BoxBounds are all that far are not evaluated.
+// GLSL 4.50 so that it also runs on Mesa llvmpipe.
+
+#define M_PI 3.1415926535897932384626433832795
+
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+// coef_w * coef_h must not exceed MAX_COEF_SIZE, nor coef_w and coef_h MAX_COEF_DIM.
+#define MAX_COEF_SIZE 1024
+#define MAX_COEF_DIM 64
+#define HAAR_NONSTANDARD 1
+#define WAVELET_HAAR 0
+#define WAVELET_CDF53 1
+#define WAVELET_CDF97 2
+
+uniform int coef_w, coef_h, coef_k, tex_w, tex_h;
+uniform int haar_mode;
+uniform int wavelet;
+uniform int kernel_first;
+uniform float cutoff_radius;
+shared int WorkGroupSize;
+shared int size_coef_array;
+shared float coef_block[MAX_COEF_SIZE];
+shared vec3 pos_i_j;
+
+layout(rgba32f, binding = 0) uniform readonly image2D world_pos_map;
+struct SparseCoef
+{
+	int index;
+	float value;
+};
+layout(std430, binding = 1) writeonly buffer KernelCoef {
+	SparseCoef data[];
+} kernel_coef;
+// The largest power of 2 rows by the largest power of 2 cols of each kernel
+// of the tile, only used by the CDF wavelets.
+layout(std430, binding = 3) buffer Scratch {
+	float data[];
+} scratch;
+// World-space bounds of the texels of each box of the band, the low corner
+// of box index_coef at 2 * index_coef and the high one after it.
+layout(std430, binding = 4) readonly buffer BoxBounds {
+	vec4 data[];
+} box_bounds;
+
+ivec2 powerOf2Size();
+float kernelTexel(int row, int col);
+bool boxCulled(int index_coef);
+void boxLowPass();
+void liftingLowPass();
+int liftingScheme(out float lift[4], out float scale);
+void waveletStep(inout float line[MAX_COEF_DIM], int k);
+void transformBlock();
+void selectLargest();
+float fDiffuseProfile(float r, float A, float s);
+
+void main() {
+	int LocalInvocationIndex = int(gl_LocalInvocationIndex);
+	if (LocalInvocationIndex == 0)
+	{
+		WorkGroupSize = int(gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z);
+		size_coef_array = coef_w * coef_h;
+		int index_kernel = kernel_first + int(gl_WorkGroupID.x);
+		pos_i_j = imageLoad(world_pos_map, ivec2(index_kernel / tex_w, index_kernel % tex_w)).xyz;
+	}
+	barrier();
+	// Texels the mesh does not cover have a zero kernel.
+	if (pos_i_j == vec3(0, 0, 0))
+	{
+		for (int index_coef = LocalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+		{
+			coef_block[index_coef] = 0;
+		}
+	}
+	else
+	{
+		// Reduce the kernel to the low-pass band of the block, then transform
+		// the band as a whole.
+		if (wavelet == WAVELET_HAAR)
+		{
+			boxLowPass();
+		}
+		else
+		{
+			liftingLowPass();
+		}
+		barrier();
+		transformBlock();
+	}
+	barrier();
+	// Store the coef_k largest coefficients.
+	selectLargest();
+}
+
+ivec2 powerOf2Size()
+{
+	int k_h = 1;
+	while (k_h * 2 <= tex_h)
+	{
+		k_h = k_h * 2;
+	}
+	int k_w = 1;
+	while (k_w * 2 <= tex_w)
+	{
+		k_w = k_w * 2;
+	}
+	return ivec2(k_h, k_w);
+}
+
+float kernelTexel(int row, int col)
+{
+	vec3 d = pos_i_j - imageLoad(world_pos_map, ivec2(row, col)).xyz;
+	float d2 = dot(d, d);
+	return d2 <= cutoff_radius * cutoff_radius ? fDiffuseProfile(sqrt(d2), 0.6, 4.031441) : 0;
+}
+
+// Whether all texels of box index_coef are beyond the cutoff.
+bool boxCulled(int index_coef)
+{
+	vec3 out_d = max(max(box_bounds.data[2 * index_coef].xyz - pos_i_j, pos_i_j - box_bounds.data[2 * index_coef + 1].xyz), 0);
+	return cutoff_radius * cutoff_radius < dot(out_d, out_d);
+}
+
+// The kernel is never stored: each box of the Haar band sums the profile
+// over its texels, split over several invocations when there are more
+// invocations than boxes.
+void boxLowPass()
+{
+	int LocalInvocationIndex = int(gl_LocalInvocationIndex);
+	int i, j, k;
+	ivec2 size = powerOf2Size();
+	int box_h = size.x / coef_h;
+	int box_w = size.y / coef_w;
+	int slices = max(WorkGroupSize / size_coef_array, 1);
+	for (int index = LocalInvocationIndex; index < slices * size_coef_array; index += WorkGroupSize)
+	{
+		int index_coef = index % size_coef_array;
+		int row0 = (index_coef / coef_w) * box_h;
+		int col0 = (index_coef % coef_w) * box_w;
+		float sum = 0;
+		if (!boxCulled(index_coef))
+		{
+			for (i = index / size_coef_array; i < box_h; i += slices)
+			{
+				for (j = 0; j < box_w; j++)
+				{
+					sum += kernelTexel(row0 + i, col0 + j);
+				}
+			}
+		}
+		coef_block[index] = sum;
+	}
+	barrier();
+	// Add up the slices and scale the boxes as HaarPass2 does.
+	for (int index_coef = LocalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		float sum = coef_block[index_coef];
+		for (k = 1; k < slices; k++)
+		{
+			sum += coef_block[index_coef + k * size_coef_array];
+		}
+		coef_block[index_coef] = sum / sqrt(float(box_h * box_w));
+	}
+	barrier();
+}
+
+// As liftingLowPass in HaarPass2, with the dual steps, on the slice of
+// Scratch of the workgroup, which holds row r, col c of the kernel at
+// r * k_w + c.
+void liftingLowPass()
+{
+	int LocalInvocationIndex = int(gl_LocalInvocationIndex);
+	int i, l, st;
+	float lift[4];
+	float scale;
+	int steps = liftingScheme(lift, scale);
+	ivec2 size = powerOf2Size();
+	int k_h = size.x;
+	int k_w = size.y;
+	int box_h = k_h / coef_h;
+	int box_w = k_w / coef_w;
+	int base = int(gl_WorkGroupID.x) * k_h * k_w;
+	for (i = LocalInvocationIndex; i < k_h * k_w; i += WorkGroupSize)
+	{
+		int row = i / k_w;
+		int col = i % k_w;
+		bool culled = boxCulled((row / box_h) * coef_w + col / box_w);
+		scratch.data[base + i] = culled ? 0 : kernelTexel(row, col);
+	}
+	memoryBarrierBuffer();
+	barrier();
+	// Columns, a level of k_h / st samples st apart at a time.
+	for (st = 1; st < box_h; st *= 2)
+	{
+		int pairs = k_h / (2 * st);
+		for (l = 0; l < steps; l++)
+		{
+			for (i = LocalInvocationIndex; i < k_w * pairs; i += WorkGroupSize)
+			{
+				int col = i / pairs;
+				int p = i % pairs;
+				int even = base + 2 * p * st * k_w + col;
+				int odd = even + st * k_w;
+				if (l % 2 == 0)
+				{
+					float odd_sum = scratch.data[odd] * (p + 1 < pairs ? 1.0 : 2.0) + (0 < p ? scratch.data[even - st * k_w] : 0.0);
+					scratch.data[even] -= lift[l] * odd_sum;
+				}
+				else
+				{
+					float even_sum = scratch.data[even] * (0 < p ? 1.0 : 2.0) + (p + 1 < pairs ? scratch.data[odd + st * k_w] : 0.0);
+					scratch.data[odd] -= lift[l] * even_sum;
+				}
+			}
+			memoryBarrierBuffer();
+			barrier();
+		}
+		for (i = LocalInvocationIndex; i < k_w * pairs; i += WorkGroupSize)
+		{
+			scratch.data[base + 2 * (i % pairs) * st * k_w + i / pairs] /= scale;
+		}
+		memoryBarrierBuffer();
+		barrier();
+	}
+	// Rows, only those holding the band.
+	for (st = 1; st < box_w; st *= 2)
+	{
+		int pairs = k_w / (2 * st);
+		for (l = 0; l < steps; l++)
+		{
+			for (i = LocalInvocationIndex; i < coef_h * pairs; i += WorkGroupSize)
+			{
+				int p = i % pairs;
+				int even = base + (i / pairs) * box_h * k_w + 2 * p * st;
+				int odd = even + st;
+				if (l % 2 == 0)
+				{
+					float odd_sum = scratch.data[odd] * (p + 1 < pairs ? 1.0 : 2.0) + (0 < p ? scratch.data[even - st] : 0.0);
+					scratch.data[even] -= lift[l] * odd_sum;
+				}
+				else
+				{
+					float even_sum = scratch.data[even] * (0 < p ? 1.0 : 2.0) + (p + 1 < pairs ? scratch.data[odd + st] : 0.0);
+					scratch.data[odd] -= lift[l] * even_sum;
+				}
+			}
+			memoryBarrierBuffer();
+			barrier();
+		}
+		for (i = LocalInvocationIndex; i < coef_h * pairs; i += WorkGroupSize)
+		{
+			scratch.data[base + (i / pairs) * box_h * k_w + 2 * (i % pairs) * st] /= scale;
+		}
+		memoryBarrierBuffer();
+		barrier();
+	}
+	for (int index_coef = LocalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		coef_block[index_coef] = scratch.data[base + (index_coef / coef_w) * box_h * k_w + (index_coef % coef_w) * box_w];
+	}
+	barrier();
+}
+
+int liftingScheme(out float lift[4], out float scale)
+{
+	if (wavelet == WAVELET_CDF97)
+	{
+		lift = float[4](-1.586134342, -0.05298011857, 0.8829110755, 0.4435068520);
+		scale = 1.149604399;
+		return 4;
+	}
+	lift = float[4](-0.5, 0.25, 0, 0);
+	scale = sqrt(2.0);
+	return 2;
+}
+
+// One level of the dual wavelet on the 2k entries of line, leaving the
+// low-pass half in line[0, k) and the high-pass half in line[k, 2k).
+void waveletStep(inout float line[MAX_COEF_DIM], int k)
+{
+	int i, l;
+	float split[MAX_COEF_DIM];
+	if (wavelet == WAVELET_HAAR)
+	{
+		float s = sqrt(2.0);
+		for (i = 0; i < k; i++)
+		{
+			split[i] = (line[2 * i] + line[2 * i + 1]) / s;
+			split[k + i] = (line[2 * i] - line[2 * i + 1]) / s;
+		}
+	}
+	else
+	{
+		float lift[4];
+		float scale;
+		int steps = liftingScheme(lift, scale);
+		for (l = 0; l < steps; l++)
+		{
+			if (l % 2 == 0)
+			{
+				for (i = 0; i < k; i++)
+				{
+					line[2 * i] -= lift[l] * (line[2 * i + 1] * (i + 1 < k ? 1.0 : 2.0) + (0 < i ? line[2 * i - 1] : 0.0));
+				}
+			}
+			else
+			{
+				for (i = 0; i < k; i++)
+				{
+					line[2 * i + 1] -= lift[l] * (line[2 * i] * (0 < i ? 1.0 : 2.0) + (i + 1 < k ? line[2 * i + 2] : 0.0));
+				}
+			}
+		}
+		for (i = 0; i < k; i++)
+		{
+			split[i] = line[2 * i] / scale;
+			split[k + i] = line[2 * i + 1] * (-scale);
+		}
+	}
+	for (i = 0; i < 2 * k; i++)
+	{
+		line[i] = split[i];
+	}
+}
+
+void transformBlock()
+{
+	int LocalInvocationIndex = int(gl_LocalInvocationIndex);
+	int i, j, k;
+	float line[MAX_COEF_DIM];
+	if (haar_mode == HAAR_NONSTANDARD)
+	{
+		// One step on the columns, then one on the rows, of the current
+		// low-pass block per level.
+		int l_h = 0;
+		while ((2 << l_h) <= coef_h)
+		{
+			l_h++;
+		}
+		int l_w = 0;
+		while ((2 << l_w) <= coef_w)
+		{
+			l_w++;
+		}
+		for (int l = 0; l < max(l_h, l_w); l++)
+		{
+			int rows = coef_h >> min(l, l_h);
+			int cols = coef_w >> min(l, l_w);
+			if (l < l_h)
+			{
+				k = rows / 2;
+				for (j = LocalInvocationIndex; j < cols; j += WorkGroupSize)
+				{
+					for (i = 0; i < 2 * k; i++)
+					{
+						line[i] = coef_block[i * coef_w + j];
+					}
+					waveletStep(line, k);
+					for (i = 0; i < 2 * k; i++)
+					{
+						coef_block[i * coef_w + j] = line[i];
+					}
+				}
+			}
+			barrier();
+			if (l < l_w)
+			{
+				k = cols / 2;
+				for (i = LocalInvocationIndex; i < rows; i += WorkGroupSize)
+				{
+					for (j = 0; j < 2 * k; j++)
+					{
+						line[j] = coef_block[i * coef_w + j];
+					}
+					waveletStep(line, k);
+					for (j = 0; j < 2 * k; j++)
+					{
+						coef_block[i * coef_w + j] = line[j];
+					}
+				}
+			}
+			barrier();
+		}
+		return;
+	}
+	// Transform all columns of the block.
+	for (j = LocalInvocationIndex; j < coef_w; j += WorkGroupSize)
+	{
+		k = coef_h;
+		while (1 < k)
+		{
+			k = k / 2;
+			for (i = 0; i < 2 * k; i++)
+			{
+				line[i] = coef_block[i * coef_w + j];
+			}
+			waveletStep(line, k);
+			for (i = 0; i < 2 * k; i++)
+			{
+				coef_block[i * coef_w + j] = line[i];
+			}
+		}
+	}
+	barrier();
+	// Transform all rows of the block.
+	for (i = LocalInvocationIndex; i < coef_h; i += WorkGroupSize)
+	{
+		k = coef_w;
+		while (1 < k)
+		{
+			k = k / 2;
+			for (j = 0; j < 2 * k; j++)
+			{
+				line[j] = coef_block[i * coef_w + j];
+			}
+			waveletStep(line, k);
+			for (j = 0; j < 2 * k; j++)
+			{
+				coef_block[i * coef_w + j] = line[j];
+			}
+		}
+	}
+	barrier();
+}
+
+// As selectLargest in HaarPass2, into the entries of the workgroup.
+void selectLargest()
+{
+	int LocalInvocationIndex = int(gl_LocalInvocationIndex);
+	int base = int(gl_WorkGroupID.x) * coef_k;
+	for (int index_coef = LocalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		float magnitude = abs(coef_block[index_coef]);
+		int rank = 0;
+		for (int i = 0; i < size_coef_array && rank < coef_k; i++)
+		{
+			float other = abs(coef_block[i]);
+			if (other > magnitude || (other == magnitude && i < index_coef))
+			{
+				rank++;
+			}
+		}
+		if (rank < coef_k)
+		{
+			kernel_coef.data[base + rank].index = index_coef;
+			kernel_coef.data[base + rank].value = coef_block[index_coef];
+		}
+	}
+}
+
+float fDiffuseProfile(float r, float A, float s)
+{
+	return A * s * ( ( exp(-s * r) + exp(-s * r / 3) ) / (8 * M_PI) );
+}
@@ -4,10 +4,21 @@
 
 layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
 
-uniform int coef_w, coef_h, tex_w, tex_h;
+// coef_w * coef_h must not exceed MAX_COEF_SIZE, nor coef_w and coef_h MAX_COEF_DIM.
+#define MAX_COEF_SIZE 1024
+#define MAX_COEF_DIM 64
+#define HAAR_NONSTANDARD 1
+#define WAVELET_HAAR 0
+#define WAVELET_CDF53 1
+#define WAVELET_CDF97 2
+
+uniform int coef_w, coef_h, coef_k, tex_w, tex_h;
+uniform int haar_mode;
+uniform int wavelet;
 uniform ivec2 index_kernel_iv;
 shared int WorkGroupSize;
 shared int size_coef_array;
+shared vec4 coef_block[MAX_COEF_SIZE];
 shared int index_kernel_row, index_kernel_col;
 shared int index_kernel;
 shared vec3 pos_i_j;
@@ -15,11 +26,22 @@ shared vec3 pos_i_j;
 layout(rgba32f, binding = 0) uniform image2D world_pos_map;
 layout(rgba32f, binding = 1) uniform image2D kernel;
 layout(rgba32f, binding = 2) uniform image2D haar_wavelet_temp_image;
+struct SparseCoef
+{
+	int index;
+	float value;
+};
 layout(std430, binding = 1) buffer KernelCoef {
-	vec4 data[];
+	SparseCoef data[];
 } kernel_coef;
 
-void haar2D();
+void wavelet2DLowPass();
+void boxLowPass();
+void liftingLowPass();
+int liftingScheme(out float lift[4], out float scale);
+void waveletStep(inout vec4 line[MAX_COEF_DIM], int k);
+void transformBlock();
+void selectLargest();
 float fDiffuseProfile(float r, float A = 0.6, float s = 4.031441);
 
 void main() {
@@ -51,74 +73,374 @@ void main() {
 		}
 	}
 	barrier();
-	// Transform kernel.
-	haar2D();
+	// Transform kernel, keeping only the coefficient block.
+	wavelet2DLowPass();
 	barrier();
-	// Store some coefficients.
-	for (int index_coef = GlobalInvocationIndex; index_coef < coef_h * coef_w; index_coef += WorkGroupSize)
+	// Store the coef_k largest coefficients.
+	selectLargest();
+	barrier();
+}
+
+void wavelet2DLowPass()
+{
+	// Reduce the image to the low-pass band of the block, then transform
+	// the band as a whole.
+	if (wavelet == WAVELET_HAAR)
+	{
+		boxLowPass();
+	}
+	else
 	{
-		kernel_coef.data[index_coef] = vec4(imageLoad(kernel, ivec2(index_coef / coef_w, index_coef % coef_w)));
+		liftingLowPass();
 	}
 	barrier();
+	transformBlock();
 }
 
-void haar2D()
+void boxLowPass()
 {
 	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
 	int i, j, k;
-	float s = sqrt(2.0);
-	// copy kernel into haar_wavelet_temp_image
-	for (i = GlobalInvocationIndex; i < tex_w * tex_h; i += WorkGroupSize)
+	// The Haar band only depends on sums over boxes of box_h x box_w texels,
+	// so the detail bands of the full transform are never formed. Rows and
+	// columns past the largest power of 2 do not contribute. In the
+	// nonstandard decomposition tex_h / coef_h must equal tex_w / coef_w.
+	int k_h = 1;
+	while (k_h * 2 <= tex_h)
+	{
+		k_h = k_h * 2;
+	}
+	int k_w = 1;
+	while (k_w * 2 <= tex_w)
 	{
-		int row = i / tex_w;
-		int col = i % tex_w;
-		imageStore(haar_wavelet_temp_image, ivec2(row, col), imageLoad(kernel, ivec2(row, col)));
+		k_w = k_w * 2;
+	}
+	int box_h = k_h / coef_h;
+	int box_w = k_w / coef_w;
+	// Sum the boxes, each split over several invocations.
+	int slices = max(WorkGroupSize / size_coef_array, 1);
+	for (int index = GlobalInvocationIndex; index < slices * size_coef_array; index += WorkGroupSize)
+	{
+		int index_coef = index % size_coef_array;
+		int row0 = (index_coef / coef_w) * box_h;
+		int col0 = (index_coef % coef_w) * box_w;
+		vec4 sum = vec4(0, 0, 0, 0);
+		for (i = index / size_coef_array; i < box_h; i += slices)
+		{
+			for (j = 0; j < box_w; j++)
+			{
+				sum += imageLoad(kernel, ivec2(row0 + i, col0 + j));
+			}
+		}
+		coef_block[index] = sum;
+	}
+	barrier();
+	// Add up the slices. Each level of the full transform divides the low-pass
+	// band by sqrt(2), so a box of box_h x box_w texels is scaled by
+	// 1 / sqrt(box_h * box_w).
+	for (int index_coef = GlobalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		vec4 sum = coef_block[index_coef];
+		for (k = 1; k < slices; k++)
+		{
+			sum += coef_block[index_coef + k * size_coef_array];
+		}
+		coef_block[index_coef] = sum / sqrt(float(box_h * box_w));
 	}
 	barrier();
-	// Determine K, the largest power of 2 such that K <= M.
-	k = 1;
-	while (k * 2 <= tex_h)
+}
+
+// The CDF wavelets overlap neighboring samples, so their band is computed by
+// lifting the k_h x k_w corner of the image in haar_wavelet_temp_image, one
+// level after the other. Lifting is done in place: each level leaves its
+// low-pass samples where its even samples were and its high-pass samples,
+// which later levels do not need, where its odd ones were. Sample (r, c) of
+// the band thus ends up at (r * box_h, c * box_w), and only the rows holding
+// the band are lifted along.
+void liftingLowPass()
+{
+	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
+	int i, l, st;
+	float lift[4];
+	float scale;
+	int steps = liftingScheme(lift, scale);
+	int k_h = 1;
+	while (k_h * 2 <= tex_h)
+	{
+		k_h = k_h * 2;
+	}
+	int k_w = 1;
+	while (k_w * 2 <= tex_w)
+	{
+		k_w = k_w * 2;
+	}
+	int box_h = k_h / coef_h;
+	int box_w = k_w / coef_w;
+	for (i = GlobalInvocationIndex; i < k_h * k_w; i += WorkGroupSize)
+	{
+		ivec2 texel = ivec2(i / k_w, i % k_w);
+		imageStore(haar_wavelet_temp_image, texel, imageLoad(kernel, texel));
+	}
+	memoryBarrierImage();
+	barrier();
+	// Columns, a level of k_h / st samples st apart at a time. The kernel
+	// takes the dual steps, as wavelet_2d_dual in haar.cpp, so that its dot
+	// product with the radiance RenderPass2 transforms is the convolution.
+	// The dual of a predict step writes even samples from odd ones and that
+	// of an update step the other way round, so the pairs of a step are
+	// independent.
+	for (st = 1; st < box_h; st *= 2)
+	{
+		int pairs = k_h / (2 * st);
+		for (l = 0; l < steps; l++)
+		{
+			for (i = GlobalInvocationIndex; i < k_w * pairs; i += WorkGroupSize)
+			{
+				int col = i / pairs;
+				int p = i % pairs;
+				ivec2 even = ivec2(2 * p * st, col);
+				ivec2 odd = ivec2((2 * p + 1) * st, col);
+				if (l % 2 == 0)
+				{
+					vec4 odd_sum = imageLoad(haar_wavelet_temp_image, odd) * (p + 1 < pairs ? 1.0 : 2.0);
+					if (0 < p)
+					{
+						odd_sum += imageLoad(haar_wavelet_temp_image, ivec2((2 * p - 1) * st, col));
+					}
+					imageStore(haar_wavelet_temp_image, even, imageLoad(haar_wavelet_temp_image, even) - lift[l] * odd_sum);
+				}
+				else
+				{
+					vec4 even_sum = imageLoad(haar_wavelet_temp_image, even) * (0 < p ? 1.0 : 2.0);
+					if (p + 1 < pairs)
+					{
+						even_sum += imageLoad(haar_wavelet_temp_image, ivec2((2 * p + 2) * st, col));
+					}
+					imageStore(haar_wavelet_temp_image, odd, imageLoad(haar_wavelet_temp_image, odd) - lift[l] * even_sum);
+				}
+			}
+			memoryBarrierImage();
+			barrier();
+		}
+		for (i = GlobalInvocationIndex; i < k_w * pairs; i += WorkGroupSize)
+		{
+			ivec2 even = ivec2(2 * (i % pairs) * st, i / pairs);
+			imageStore(haar_wavelet_temp_image, even, imageLoad(haar_wavelet_temp_image, even) / scale);
+		}
+		memoryBarrierImage();
+		barrier();
+	}
+	// Rows, only those holding the band.
+	for (st = 1; st < box_w; st *= 2)
+	{
+		int pairs = k_w / (2 * st);
+		for (l = 0; l < steps; l++)
+		{
+			for (i = GlobalInvocationIndex; i < coef_h * pairs; i += WorkGroupSize)
+			{
+				int row = (i / pairs) * box_h;
+				int p = i % pairs;
+				ivec2 even = ivec2(row, 2 * p * st);
+				ivec2 odd = ivec2(row, (2 * p + 1) * st);
+				if (l % 2 == 0)
+				{
+					vec4 odd_sum = imageLoad(haar_wavelet_temp_image, odd) * (p + 1 < pairs ? 1.0 : 2.0);
+					if (0 < p)
+					{
+						odd_sum += imageLoad(haar_wavelet_temp_image, ivec2(row, (2 * p - 1) * st));
+					}
+					imageStore(haar_wavelet_temp_image, even, imageLoad(haar_wavelet_temp_image, even) - lift[l] * odd_sum);
+				}
+				else
+				{
+					vec4 even_sum = imageLoad(haar_wavelet_temp_image, even) * (0 < p ? 1.0 : 2.0);
+					if (p + 1 < pairs)
+					{
+						even_sum += imageLoad(haar_wavelet_temp_image, ivec2(row, (2 * p + 2) * st));
+					}
+					imageStore(haar_wavelet_temp_image, odd, imageLoad(haar_wavelet_temp_image, odd) - lift[l] * even_sum);
+				}
+			}
+			memoryBarrierImage();
+			barrier();
+		}
+		for (i = GlobalInvocationIndex; i < coef_h * pairs; i += WorkGroupSize)
+		{
+			ivec2 even = ivec2((i / pairs) * box_h, 2 * (i % pairs) * st);
+			imageStore(haar_wavelet_temp_image, even, imageLoad(haar_wavelet_temp_image, even) / scale);
+		}
+		memoryBarrierImage();
+		barrier();
+	}
+	for (int index_coef = GlobalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		ivec2 texel = ivec2((index_coef / coef_w) * box_h, (index_coef % coef_w) * box_w);
+		coef_block[index_coef] = imageLoad(haar_wavelet_temp_image, texel);
+	}
+	barrier();
+}
+
+// Lifting steps of the CDF wavelets, alternately predicting odd samples from
+// their even neighbors and updating even samples from their odd ones. The
+// low-pass band is then scaled by scale and the high-pass band by -1 / scale,
+// which matches the gains and signs of the Haar transform. The signal is
+// extended symmetrically at both ends.
+int liftingScheme(out float lift[4], out float scale)
+{
+	if (wavelet == WAVELET_CDF97)
 	{
-		k = k * 2;
+		lift = float[4](-1.586134342, -0.05298011857, 0.8829110755, 0.4435068520);
+		scale = 1.149604399;
+		return 4;
+	}
+	lift = float[4](-0.5, 0.25, 0, 0);
+	scale = sqrt(2.0);
+	return 2;
+}
+
+// One level of the dual wavelet on the 2k entries of line, leaving the
+// low-pass half in line[0, k) and the high-pass half in line[k, 2k).
+void waveletStep(inout vec4 line[MAX_COEF_DIM], int k)
+{
+	int i, l;
+	vec4 split[MAX_COEF_DIM];
+	if (wavelet == WAVELET_HAAR)
+	{
+		float s = sqrt(2.0);
+		for (i = 0; i < k; i++)
+		{
+			split[i] = (line[2 * i] + line[2 * i + 1]) / s;
+			split[k + i] = (line[2 * i] - line[2 * i + 1]) / s;
+		}
 	}
-	// Transform all columns.
-	for (j = GlobalInvocationIndex; j < tex_w; j += WorkGroupSize)
+	else
 	{
+		float lift[4];
+		float scale;
+		int steps = liftingScheme(lift, scale);
+		for (l = 0; l < steps; l++)
+		{
+			if (l % 2 == 0)
+			{
+				for (i = 0; i < k; i++)
+				{
+					line[2 * i] -= lift[l] * (line[2 * i + 1] * (i + 1 < k ? 1.0 : 2.0) + (0 < i ? line[2 * i - 1] : vec4(0)));
+				}
+			}
+			else
+			{
+				for (i = 0; i < k; i++)
+				{
+					line[2 * i + 1] -= lift[l] * (line[2 * i] * (0 < i ? 1.0 : 2.0) + (i + 1 < k ? line[2 * i + 2] : vec4(0)));
+				}
+			}
+		}
+		for (i = 0; i < k; i++)
+		{
+			split[i] = line[2 * i] / scale;
+			split[k + i] = line[2 * i + 1] * (-scale);
+		}
+	}
+	for (i = 0; i < 2 * k; i++)
+	{
+		line[i] = split[i];
+	}
+}
+
+void transformBlock()
+{
+	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
+	int i, j, k;
+	vec4 line[MAX_COEF_DIM];
+	if (haar_mode == HAAR_NONSTANDARD)
+	{
+		// One step on the columns, then one on the rows, of the current
+		// low-pass block per level.
+		int l_h = 0;
+		while ((2 << l_h) <= coef_h)
+		{
+			l_h++;
+		}
+		int l_w = 0;
+		while ((2 << l_w) <= coef_w)
+		{
+			l_w++;
+		}
+		for (int l = 0; l < max(l_h, l_w); l++)
+		{
+			int rows = coef_h >> min(l, l_h);
+			int cols = coef_w >> min(l, l_w);
+			if (l < l_h)
+			{
+				k = rows / 2;
+				for (j = GlobalInvocationIndex; j < cols; j += WorkGroupSize)
+				{
+					for (i = 0; i < 2 * k; i++)
+					{
+						line[i] = coef_block[i * coef_w + j];
+					}
+					waveletStep(line, k);
+					for (i = 0; i < 2 * k; i++)
+					{
+						coef_block[i * coef_w + j] = line[i];
+					}
+				}
+			}
+			barrier();
+			if (l < l_w)
+			{
+				k = cols / 2;
+				for (i = GlobalInvocationIndex; i < rows; i += WorkGroupSize)
+				{
+					for (j = 0; j < 2 * k; j++)
+					{
+						line[j] = coef_block[i * coef_w + j];
+					}
+					waveletStep(line, k);
+					for (j = 0; j < 2 * k; j++)
+					{
+						coef_block[i * coef_w + j] = line[j];
+					}
+				}
+			}
+			barrier();
+		}
+		return;
+	}
+	// Transform all columns of the block.
+	for (j = GlobalInvocationIndex; j < coef_w; j += WorkGroupSize)
+	{
+		k = coef_h;
 		while (1 < k)
 		{
 			k = k / 2;
-			for (i = 0; i < k; i++)
+			for (i = 0; i < 2 * k; i++)
 			{
-				imageStore(haar_wavelet_temp_image, ivec2(i, j), (imageLoad(kernel, ivec2(2 * i, j)) + imageLoad(kernel, ivec2(2 * i + 1, j))) / s);
-				imageStore(haar_wavelet_temp_image, ivec2(k + i, j), (imageLoad(kernel, ivec2(2 * i, j)) - imageLoad(kernel, ivec2(2 * i + 1, j))) / s);
+				line[i] = coef_block[i * coef_w + j];
 			}
+			waveletStep(line, k);
 			for (i = 0; i < 2 * k; i++)
 			{
-				imageStore(kernel, ivec2(i, j), imageLoad(haar_wavelet_temp_image, ivec2(i, j)));
+				coef_block[i * coef_w + j] = line[i];
 			}
 		}
 	}
 	barrier();
-	// Determine K, the largest power of 2 such that K <= N.
-	k = 1;
-	while (k * 2 <= tex_w)
-	{
-		k = k * 2;
-	}
-	// Transform all rows.
-	for (i = GlobalInvocationIndex; i < tex_h; i += WorkGroupSize)
+	// Transform all rows of the block.
+	for (i = GlobalInvocationIndex; i < coef_h; i += WorkGroupSize)
 	{
+		k = coef_w;
 		while (1 < k)
 		{
 			k = k / 2;
-			for (j = 0; j < k; j++)
+			for (j = 0; j < 2 * k; j++)
 			{
-				imageStore(haar_wavelet_temp_image, ivec2(i, j), (imageLoad(kernel, ivec2(i, 2 * j)) + imageLoad(kernel, ivec2(i, 2 * j + 1))) / s);
-				imageStore(haar_wavelet_temp_image, ivec2(i, k + j), (imageLoad(kernel, ivec2(i, 2 * j)) - imageLoad(kernel, ivec2(i, 2 * j + 1))) / s);
+				line[j] = coef_block[i * coef_w + j];
 			}
+			waveletStep(line, k);
 			for (j = 0; j < 2 * k; j++)
 			{
-				imageStore(kernel, ivec2(i, j), imageLoad(haar_wavelet_temp_image, ivec2(i, j)));
+				coef_block[i * coef_w + j] = line[j];
 			}
 		}
 	}
@@ -127,7 +449,34 @@ void haar2D()
 	return;
 }
 
+// Writes the coef_k coefficients of largest magnitude in the block as
+// (index, value) pairs, in order of decreasing magnitude with ties going to
+// the lower index. Each invocation finds the rank of its coefficients by
+// counting the ones that come before them.
+void selectLargest()
+{
+	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
+	for (int index_coef = GlobalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		float magnitude = abs(coef_block[index_coef].r);
+		int rank = 0;
+		for (int i = 0; i < size_coef_array && rank < coef_k; i++)
+		{
+			float other = abs(coef_block[i].r);
+			if (other > magnitude || (other == magnitude && i < index_coef))
+			{
+				rank++;
+			}
+		}
+		if (rank < coef_k)
+		{
+			kernel_coef.data[rank].index = index_coef;
+			kernel_coef.data[rank].value = coef_block[index_coef].r;
+		}
+	}
+}
+
 float fDiffuseProfile(float r, float A, float s)
 {
-	return s * ( ( exp(-s * r) + exp(-s * r / 3) ) / (8 * M_PI) );
+	return A * s * ( ( exp(-s * r) + exp(-s * r / 3) ) / (8 * M_PI) );
 }
@@ -2,9 +2,20 @@
 
 layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
 
+// coef_w * coef_h must not exceed MAX_COEF_SIZE, nor coef_w and coef_h MAX_COEF_DIM.
+#define MAX_COEF_SIZE 1024
+#define MAX_COEF_DIM 64
+#define HAAR_NONSTANDARD 1
+#define WAVELET_HAAR 0
+#define WAVELET_CDF53 1
+#define WAVELET_CDF97 2
+
 uniform int coef_w, coef_h, tex_w, tex_h;
+uniform int haar_mode;
+uniform int wavelet;
 shared int WorkGroupSize;
 shared int size_coef_array;
+shared vec4 coef_block[MAX_COEF_SIZE];
 
 layout(rgba32f, binding = 0) uniform image2D img;
 layout(rgba32f, binding = 1) uniform image2D tmp;
@@ -14,6 +25,11 @@ layout(std430, binding = 0) buffer RadianceCoef
 } radiance_coef;
 
 void haar2dInverse();
+void haar2dInverseNonstandard();
+void liftingInverse();
+int liftingScheme(out float lift[4], out float scale);
+void waveletStepInverse(inout vec4 line[MAX_COEF_DIM], int k);
+void inverseTransformBlock();
 
 void main() {
 	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
@@ -30,7 +46,13 @@ void main() {
 		int col = index_texel % tex_w;
 		imageStore(img, ivec2(row, col), vec4(0, 0, 0, 0));
 	}
+	memoryBarrierImage();
 	barrier();
+	if (wavelet != WAVELET_HAAR)
+	{
+		liftingInverse();
+		return;
+	}
 	// Copy coefs into image
 	for (int index_coef = GlobalInvocationIndex; index_coef < coef_h * coef_w; index_coef += WorkGroupSize)
 	{
@@ -40,7 +62,14 @@ void main() {
 	}
 	barrier();
 	// Inversely transform radiance map.
-	haar2dInverse();
+	if (haar_mode == HAAR_NONSTANDARD)
+	{
+		haar2dInverseNonstandard();
+	}
+	else
+	{
+		haar2dInverse();
+	}
 	barrier();
 }
 
@@ -96,4 +125,323 @@ void haar2dInverse()
 	}
 
 	return;
-}
\ No newline at end of file
+}
+
+void haar2dInverseNonstandard()
+{
+	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
+	int i, j, l;
+	float s = sqrt(2.0);
+	// Number of steps taken on the columns and on the rows.
+	int l_h = 0;
+	while ((2 << l_h) <= tex_h)
+	{
+		l_h++;
+	}
+	int l_w = 0;
+	while ((2 << l_w) <= tex_w)
+	{
+		l_w++;
+	}
+	// Undo level l, which turned a rows x cols block into a k_h x k_w one.
+	for (l = max(l_h, l_w) - 1; 0 <= l; l--)
+	{
+		int k_h = 1 << max(l_h - l - 1, 0);
+		int k_w = 1 << max(l_w - l - 1, 0);
+		int rows = l < l_h ? 2 * k_h : k_h;
+		int cols = l < l_w ? 2 * k_w : k_w;
+		if (l < l_w)
+		{
+			for (i = GlobalInvocationIndex; i < rows; i += WorkGroupSize)
+			{
+				for (j = 0; j < k_w; j++)
+				{
+					imageStore(tmp, ivec2(i, 2 * j), (imageLoad(img, ivec2(i, j)) + imageLoad(img, ivec2(i, k_w + j))) / s);
+					imageStore(tmp, ivec2(i, 2 * j + 1), (imageLoad(img, ivec2(i, j)) - imageLoad(img, ivec2(i, k_w + j))) / s);
+				}
+				for (j = 0; j < cols; j++)
+				{
+					imageStore(img, ivec2(i, j), imageLoad(tmp, ivec2(i, j)));
+				}
+			}
+		}
+		memoryBarrierImage();
+		barrier();
+		if (l < l_h)
+		{
+			for (j = GlobalInvocationIndex; j < cols; j += WorkGroupSize)
+			{
+				for (i = 0; i < k_h; i++)
+				{
+					imageStore(tmp, ivec2(2 * i, j), (imageLoad(img, ivec2(i, j)) + imageLoad(img, ivec2(k_h + i, j))) / s);
+					imageStore(tmp, ivec2(2 * i + 1, j), (imageLoad(img, ivec2(i, j)) - imageLoad(img, ivec2(k_h + i, j))) / s);
+				}
+				for (i = 0; i < rows; i++)
+				{
+					imageStore(img, ivec2(i, j), imageLoad(tmp, ivec2(i, j)));
+				}
+			}
+		}
+		memoryBarrierImage();
+		barrier();
+	}
+
+	return;
+}
+
+// Inverse of the CDF transforms, whose coefficients past the block are all
+// zero. The block is turned back into the low-pass band in shared memory,
+// and the band is placed at (r * box_h, c * box_w) in img and lifted back
+// up in place, the reverse of liftingLowPass() in RenderPass2. The odd
+// samples of each level start out as zero high-pass coefficients.
+void liftingInverse()
+{
+	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
+	int i, l, st;
+	float lift[4];
+	float scale;
+	int steps = liftingScheme(lift, scale);
+	int k_h = 1;
+	while (k_h * 2 <= tex_h)
+	{
+		k_h = k_h * 2;
+	}
+	int k_w = 1;
+	while (k_w * 2 <= tex_w)
+	{
+		k_w = k_w * 2;
+	}
+	int box_h = k_h / coef_h;
+	int box_w = k_w / coef_w;
+	for (int index_coef = GlobalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		coef_block[index_coef] = radiance_coef.data[index_coef];
+	}
+	barrier();
+	inverseTransformBlock();
+	barrier();
+	for (int index_coef = GlobalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		ivec2 texel = ivec2((index_coef / coef_w) * box_h, (index_coef % coef_w) * box_w);
+		imageStore(img, texel, coef_block[index_coef]);
+	}
+	memoryBarrierImage();
+	barrier();
+	// Rows holding the band, coarsest level first.
+	for (st = box_w / 2; 1 <= st; st /= 2)
+	{
+		int pairs = k_w / (2 * st);
+		for (i = GlobalInvocationIndex; i < coef_h * pairs; i += WorkGroupSize)
+		{
+			ivec2 even = ivec2((i / pairs) * box_h, 2 * (i % pairs) * st);
+			ivec2 odd = ivec2((i / pairs) * box_h, (2 * (i % pairs) + 1) * st);
+			imageStore(img, even, imageLoad(img, even) / scale);
+			imageStore(img, odd, imageLoad(img, odd) * -scale);
+		}
+		memoryBarrierImage();
+		barrier();
+		for (l = steps - 1; 0 <= l; l--)
+		{
+			for (i = GlobalInvocationIndex; i < coef_h * pairs; i += WorkGroupSize)
+			{
+				int row = (i / pairs) * box_h;
+				int p = i % pairs;
+				ivec2 even = ivec2(row, 2 * p * st);
+				ivec2 odd = ivec2(row, (2 * p + 1) * st);
+				if (l % 2 == 0)
+				{
+					ivec2 next = p + 1 < pairs ? ivec2(row, (2 * p + 2) * st) : even;
+					imageStore(img, odd, imageLoad(img, odd) - lift[l] * (imageLoad(img, even) + imageLoad(img, next)));
+				}
+				else
+				{
+					ivec2 prev = 0 < p ? ivec2(row, (2 * p - 1) * st) : odd;
+					imageStore(img, even, imageLoad(img, even) - lift[l] * (imageLoad(img, prev) + imageLoad(img, odd)));
+				}
+			}
+			memoryBarrierImage();
+			barrier();
+		}
+	}
+	// All columns of the k_h x k_w corner.
+	for (st = box_h / 2; 1 <= st; st /= 2)
+	{
+		int pairs = k_h / (2 * st);
+		for (i = GlobalInvocationIndex; i < k_w * pairs; i += WorkGroupSize)
+		{
+			ivec2 even = ivec2(2 * (i % pairs) * st, i / pairs);
+			ivec2 odd = ivec2((2 * (i % pairs) + 1) * st, i / pairs);
+			imageStore(img, even, imageLoad(img, even) / scale);
+			imageStore(img, odd, imageLoad(img, odd) * -scale);
+		}
+		memoryBarrierImage();
+		barrier();
+		for (l = steps - 1; 0 <= l; l--)
+		{
+			for (i = GlobalInvocationIndex; i < k_w * pairs; i += WorkGroupSize)
+			{
+				int col = i / pairs;
+				int p = i % pairs;
+				ivec2 even = ivec2(2 * p * st, col);
+				ivec2 odd = ivec2((2 * p + 1) * st, col);
+				if (l % 2 == 0)
+				{
+					ivec2 next = p + 1 < pairs ? ivec2((2 * p + 2) * st, col) : even;
+					imageStore(img, odd, imageLoad(img, odd) - lift[l] * (imageLoad(img, even) + imageLoad(img, next)));
+				}
+				else
+				{
+					ivec2 prev = 0 < p ? ivec2((2 * p - 1) * st, col) : odd;
+					imageStore(img, even, imageLoad(img, even) - lift[l] * (imageLoad(img, prev) + imageLoad(img, odd)));
+				}
+			}
+			memoryBarrierImage();
+			barrier();
+		}
+	}
+}
+
+// Same lifting schemes as in RenderPass2.
+int liftingScheme(out float lift[4], out float scale)
+{
+	if (wavelet == WAVELET_CDF97)
+	{
+		lift = float[4](-1.586134342, -0.05298011857, 0.8829110755, 0.4435068520);
+		scale = 1.149604399;
+		return 4;
+	}
+	lift = float[4](-0.5, 0.25, 0, 0);
+	scale = sqrt(2.0);
+	return 2;
+}
+
+// Undo one level of the wavelet: line[0, k) holds the low-pass half and
+// line[k, 2k) the high-pass half, and on return line holds the 2k samples.
+void waveletStepInverse(inout vec4 line[MAX_COEF_DIM], int k)
+{
+	int i, l;
+	vec4 merged[MAX_COEF_DIM];
+	float lift[4];
+	float scale;
+	int steps = liftingScheme(lift, scale);
+	for (i = 0; i < k; i++)
+	{
+		merged[2 * i] = line[i] / scale;
+		merged[2 * i + 1] = line[k + i] * -scale;
+	}
+	for (l = steps - 1; 0 <= l; l--)
+	{
+		if (l % 2 == 0)
+		{
+			for (i = 0; i < k; i++)
+			{
+				merged[2 * i + 1] -= lift[l] * (merged[2 * i] + merged[i + 1 < k ? 2 * i + 2 : 2 * i]);
+			}
+		}
+		else
+		{
+			for (i = 0; i < k; i++)
+			{
+				merged[2 * i] -= lift[l] * (merged[0 < i ? 2 * i - 1 : 2 * i + 1] + merged[2 * i + 1]);
+			}
+		}
+	}
+	for (i = 0; i < 2 * k; i++)
+	{
+		line[i] = merged[i];
+	}
+}
+
+void inverseTransformBlock()
+{
+	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
+	int i, j, k;
+	vec4 line[MAX_COEF_DIM];
+	if (haar_mode == HAAR_NONSTANDARD)
+	{
+		int l_h = 0;
+		while ((2 << l_h) <= coef_h)
+		{
+			l_h++;
+		}
+		int l_w = 0;
+		while ((2 << l_w) <= coef_w)
+		{
+			l_w++;
+		}
+		// Undo level l: its step on the rows, then its step on the columns.
+		for (int l = max(l_h, l_w) - 1; 0 <= l; l--)
+		{
+			int rows = coef_h >> min(l, l_h);
+			int cols = coef_w >> min(l, l_w);
+			if (l < l_w)
+			{
+				k = cols / 2;
+				for (i = GlobalInvocationIndex; i < rows; i += WorkGroupSize)
+				{
+					for (j = 0; j < 2 * k; j++)
+					{
+						line[j] = coef_block[i * coef_w + j];
+					}
+					waveletStepInverse(line, k);
+					for (j = 0; j < 2 * k; j++)
+					{
+						coef_block[i * coef_w + j] = line[j];
+					}
+				}
+			}
+			barrier();
+			if (l < l_h)
+			{
+				k = rows / 2;
+				for (j = GlobalInvocationIndex; j < cols; j += WorkGroupSize)
+				{
+					for (i = 0; i < 2 * k; i++)
+					{
+						line[i] = coef_block[i * coef_w + j];
+					}
+					waveletStepInverse(line, k);
+					for (i = 0; i < 2 * k; i++)
+					{
+						coef_block[i * coef_w + j] = line[i];
+					}
+				}
+			}
+			barrier();
+		}
+		return;
+	}
+	// Inverse transform of all rows of the block, then all columns.
+	for (i = GlobalInvocationIndex; i < coef_h; i += WorkGroupSize)
+	{
+		for (k = 1; k < coef_w; k = k * 2)
+		{
+			for (j = 0; j < 2 * k; j++)
+			{
+				line[j] = coef_block[i * coef_w + j];
+			}
+			waveletStepInverse(line, k);
+			for (j = 0; j < 2 * k; j++)
+			{
+				coef_block[i * coef_w + j] = line[j];
+			}
+		}
+	}
+	barrier();
+	for (j = GlobalInvocationIndex; j < coef_w; j += WorkGroupSize)
+	{
+		for (k = 1; k < coef_h; k = k * 2)
+		{
+			for (i = 0; i < 2 * k; i++)
+			{
+				line[i] = coef_block[i * coef_w + j];
+			}
+			waveletStepInverse(line, k);
+			for (i = 0; i < 2 * k; i++)
+			{
+				coef_block[i * coef_w + j] = line[i];
+			}
+		}
+	}
+	barrier();
+}
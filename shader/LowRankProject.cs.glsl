@@ -0,0 +1,36 @@
+#version 450
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+uniform int coef_w, coef_h;
+uniform int lowrank_rank;
+
+layout(std430, binding = 0) buffer RadianceCoef
+{
+	vec4 data[];
+} radiance_coef;
+
+// Basis vectors of the kernels of tssss-bake -lowrank, coef_w * coef_h
+// floats each, and the dot product of each with the radiance coefficients.
+layout(std430, binding = 6) buffer LowRankBasis
+{
+	float data[];
+} lowrank_basis;
+layout(std430, binding = 8) buffer LowRankProjection
+{
+	vec4 data[];
+} lowrank_projection;
+
+void main() {
+	int r = int(gl_GlobalInvocationID.x);
+	if (r >= lowrank_rank)
+		return;
+	int size_coef_array = coef_w * coef_h;
+	int basis_base = r * size_coef_array;
+	vec3 sum = vec3(0, 0, 0);
+	for (int i = 0; i < size_coef_array; i++)
+	{
+		sum += radiance_coef.data[i].rgb * lowrank_basis.data[basis_base + i];
+	}
+	lowrank_projection.data[r] = vec4(sum, 0);
+}
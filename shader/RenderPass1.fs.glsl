@@ -6,10 +6,24 @@ in vec3 FragPos;
 in vec2 TexCoord;
 in vec3 Normal;
 
+// Point light of -point-light, which falls off to exactly 0 at light_range.
+uniform bool point_light;
+uniform vec3 light_pos;
+uniform float light_range;
+
 void main()
 {
 	vec3 light_dir = normalize(vec3(10.0, 1.0, -1.0));
 	vec3 lighting = max(dot(Normal, light_dir), 0.0) * vec3(1, 1, 1);
+	if (point_light)
+	{
+		vec3 to_light = light_pos - FragPos;
+		float falloff = max(1.0 - dot(to_light, to_light) / (light_range * light_range), 0.0);
+		if (0.0 < falloff)
+		{
+			lighting += max(dot(Normal, normalize(to_light)), 0.0) * falloff * falloff * vec3(1, 1, 1);
+		}
+	}
 
 	radiance = vec4(lighting, 1.0);
 }
\ No newline at end of file
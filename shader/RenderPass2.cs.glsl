@@ -2,19 +2,53 @@
 
 layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
 
+// coef_w * coef_h must not exceed MAX_COEF_SIZE, nor coef_w and coef_h MAX_COEF_DIM.
+#define MAX_COEF_SIZE 1024
+#define MAX_COEF_DIM 64
+#define HAAR_NONSTANDARD 1
+#define WAVELET_HAAR 0
+#define WAVELET_CDF53 1
+#define WAVELET_CDF97 2
+#define MAX_DIRTY_RECTS 16
+#define GAUSS_RADIUS 4
+
 uniform int coef_w, coef_h, tex_w, tex_h;
+uniform int haar_mode;
+uniform int wavelet;
+// Rectangles (row, col, rows, cols) of the radiance map that changed since
+// the last dispatch. With none, or with a CDF wavelet, everything is redone.
+uniform int dirty_count;
+uniform ivec4 dirty_rects[MAX_DIRTY_RECTS];
 shared int WorkGroupSize;
 shared int size_coef_array;
+shared vec4 coef_block[MAX_COEF_SIZE];
+shared bool box_dirty[MAX_COEF_SIZE];
 
-layout(rgba32f, binding = 0) uniform image2D radiance_map;
+layout(rgba32f, binding = 0) uniform readonly image2D radiance_map;
 layout(rgba32f, binding = 1) uniform image2D haar_wavelet_temp_image;
+// The blurred radiance map, which keeps the texels of the last dispatch
+// outside the regions.
+layout(rgba32f, binding = 2) uniform image2D blurred_map;
 layout(std430, binding = 0) buffer RadianceCoef
 {
 	vec4 data[];
 } radiance_coef;
+// Scaled box sums of the last dispatch, kept for the boxes that do not change.
+layout(std430, binding = 2) buffer BoxSums
+{
+	vec4 data[];
+} box_sums;
 
+ivec2 boxSize();
+int regionCount();
+ivec4 region(int r);
 void gauss();
-void haar2D();
+void wavelet2DLowPass();
+void boxLowPass();
+void liftingLowPass();
+int liftingScheme(out float lift[4], out float scale);
+void waveletStep(inout vec4 line[MAX_COEF_DIM], int k);
+void transformBlock();
 
 void main() {
 	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
@@ -27,136 +61,487 @@ void main() {
 	// Gaussian blur.
 	gauss();
 	barrier();
-	// Transform radiance map.
-	haar2D();
+	// Transform radiance map, keeping only the coefficient block.
+	wavelet2DLowPass();
 	barrier();
 	// Store some coefficients.
 	for (int index_coef = GlobalInvocationIndex; index_coef < coef_h * coef_w; index_coef += WorkGroupSize)
 	{
-		int row = index_coef / coef_w;
-		int col = index_coef % coef_w;
-		radiance_coef.data[index_coef] = vec4(imageLoad(radiance_map, ivec2(row, col)).xyz, 0);
+		radiance_coef.data[index_coef] = vec4(coef_block[index_coef].xyz, 0);
 	}
 	barrier();
 }
 
-void gauss()
+// Size of the boxes of texels the Haar band sums over. Rows and columns
+// past the largest power of 2 do not contribute.
+ivec2 boxSize()
 {
-	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
-	float weight[5] = float[] (0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);	
-	// copy radiance_map into haar_wavelet_temp_image
-	for (int i = GlobalInvocationIndex; i < tex_w * tex_h; i += WorkGroupSize)
+	int k_h = 1;
+	while (k_h * 2 <= tex_h)
 	{
-		int row = i / tex_w;
-		int col = i % tex_w;
-		imageStore(haar_wavelet_temp_image, ivec2(row, col), imageLoad(radiance_map, ivec2(row, col)));
+		k_h = k_h * 2;
 	}
-	barrier();
-	// Transform rows.
-	for (int row = GlobalInvocationIndex; row < tex_h; row += WorkGroupSize)
+	int k_w = 1;
+	while (k_w * 2 <= tex_w)
+	{
+		k_w = k_w * 2;
+	}
+	return ivec2(k_h / coef_h, k_w / coef_w);
+}
+
+// The Haar band is redone in regions: the whole map, or for each dirty rect
+// the boxes whose blurred texels it reaches. Their box sums are the only ones
+// that change.
+int regionCount()
+{
+	return 0 < dirty_count && wavelet == WAVELET_HAAR ? min(dirty_count, MAX_DIRTY_RECTS) : 1;
+}
+
+// Region r as (first row, first col, last row + 1, last col + 1).
+ivec4 region(int r)
+{
+	if (dirty_count <= 0 || wavelet != WAVELET_HAAR)
 	{
-		for (int col = 0; col < tex_w; col++)
+		return ivec4(0, 0, tex_h, tex_w);
+	}
+	ivec2 box = boxSize();
+	ivec4 rect = dirty_rects[r];
+	int row0 = max(rect.x - GAUSS_RADIUS, 0) / box.x;
+	int col0 = max(rect.y - GAUSS_RADIUS, 0) / box.y;
+	int row1 = min((rect.x + rect.z + GAUSS_RADIUS - 1) / box.x + 1, coef_h);
+	int col1 = min((rect.y + rect.w + GAUSS_RADIUS - 1) / box.y + 1, coef_w);
+	return ivec4(row0 * box.x, col0 * box.y, max(row0, row1) * box.x, max(col0, col1) * box.y);
+}
+
+// Blurs the regions of radiance_map into blurred_map. The row pass reads
+// texels around a region, which must not have been blurred already, so
+// radiance_map is never written. Regions may overlap: every pass writes the
+// same values to a texel, and the row pass of all regions is done before
+// the column pass reads it.
+void gauss()
+{
+	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
+	float weight[GAUSS_RADIUS + 1] = float[] (0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
+	int i, r;
+	// Transform rows, including those the column pass reads above and below.
+	for (r = 0; r < regionCount(); r++)
+	{
+		ivec4 rect = region(r);
+		int row0 = max(rect.x - GAUSS_RADIUS, 0);
+		int row1 = min(rect.z + GAUSS_RADIUS, tex_h);
+		int cols = rect.w - rect.y;
+		for (i = GlobalInvocationIndex; i < (row1 - row0) * cols; i += WorkGroupSize)
 		{
-			float sum = 0;
-			sum += imageLoad(radiance_map, ivec2(row, col)).r * weight[0];
-			for (int i = 1; i < 5; i++)
+			int row = row0 + i / cols;
+			int col = rect.y + i % cols;
+			float sum = imageLoad(radiance_map, ivec2(row, col)).r * weight[0];
+			for (int k = 1; k <= GAUSS_RADIUS; k++)
 			{
-				if (col - i >= 0)
+				if (col - k >= 0)
 				{
-					sum += imageLoad(radiance_map, ivec2(row, col - i)).r * weight[i];
+					sum += imageLoad(radiance_map, ivec2(row, col - k)).r * weight[k];
 				}
-				if (col + i < tex_h)
+				if (col + k < tex_w)
 				{
-					sum += imageLoad(radiance_map, ivec2(row, col + i)).r * weight[i];
+					sum += imageLoad(radiance_map, ivec2(row, col + k)).r * weight[k];
 				}
-
 			}
 			imageStore(haar_wavelet_temp_image, ivec2(row, col), vec4(sum, 0, 0, 0));
 		}
 	}
+	memoryBarrierImage();
 	barrier();
 	// Transform cols.
-	for (int col = GlobalInvocationIndex; col < tex_w; col += WorkGroupSize)
+	for (r = 0; r < regionCount(); r++)
 	{
-		for (int row = 0; row < tex_w; row++)
+		ivec4 rect = region(r);
+		int cols = rect.w - rect.y;
+		for (i = GlobalInvocationIndex; i < (rect.z - rect.x) * cols; i += WorkGroupSize)
 		{
-			float sum = 0;
-			sum += imageLoad(haar_wavelet_temp_image, ivec2(row, col)).r * weight[0];
-			for (int i = 1; i < 5; i++)
+			int row = rect.x + i / cols;
+			int col = rect.y + i % cols;
+			float sum = imageLoad(haar_wavelet_temp_image, ivec2(row, col)).r * weight[0];
+			for (int k = 1; k <= GAUSS_RADIUS; k++)
 			{
-				if (row - i >= 0)
+				if (row - k >= 0)
 				{
-					sum += imageLoad(haar_wavelet_temp_image, ivec2(row - i, col)).r * weight[i];
+					sum += imageLoad(haar_wavelet_temp_image, ivec2(row - k, col)).r * weight[k];
 				}
-				if (row + i < tex_h)
+				if (row + k < tex_h)
 				{
-					sum += imageLoad(haar_wavelet_temp_image, ivec2(row + i, col)).r * weight[i];
+					sum += imageLoad(haar_wavelet_temp_image, ivec2(row + k, col)).r * weight[k];
 				}
+			}
+			imageStore(blurred_map, ivec2(row, col), vec4(sum, 0, 0, 0));
+		}
+	}
+	memoryBarrierImage();
+	barrier();
+}
+
+void wavelet2DLowPass()
+{
+	// Reduce the image to the low-pass band of the block, then transform
+	// the band as a whole.
+	if (wavelet == WAVELET_HAAR)
+	{
+		boxLowPass();
+	}
+	else
+	{
+		liftingLowPass();
+	}
+	barrier();
+	transformBlock();
+}
 
+void boxLowPass()
+{
+	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
+	int i, j, k, r;
+	// The Haar band only depends on sums over boxes of box_h x box_w texels,
+	// so the detail bands of the full transform are never formed. In the
+	// nonstandard decomposition tex_h / coef_h must equal tex_w / coef_w.
+	ivec2 box = boxSize();
+	int box_h = box.x;
+	int box_w = box.y;
+	// Regions are made of whole boxes, so a box is in one if its corner is.
+	for (int index_coef = GlobalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		int row0 = (index_coef / coef_w) * box_h;
+		int col0 = (index_coef % coef_w) * box_w;
+		box_dirty[index_coef] = false;
+		for (r = 0; r < regionCount(); r++)
+		{
+			ivec4 rect = region(r);
+			box_dirty[index_coef] = box_dirty[index_coef]
+				|| (rect.x <= row0 && row0 < rect.z && rect.y <= col0 && col0 < rect.w);
+		}
+	}
+	barrier();
+	// Sum the boxes of the regions, each split over several invocations.
+	int slices = max(WorkGroupSize / size_coef_array, 1);
+	for (int index = GlobalInvocationIndex; index < slices * size_coef_array; index += WorkGroupSize)
+	{
+		int index_coef = index % size_coef_array;
+		int row0 = (index_coef / coef_w) * box_h;
+		int col0 = (index_coef % coef_w) * box_w;
+		if (!box_dirty[index_coef])
+		{
+			continue;
+		}
+		vec4 sum = vec4(0, 0, 0, 0);
+		for (i = index / size_coef_array; i < box_h; i += slices)
+		{
+			for (j = 0; j < box_w; j++)
+			{
+				sum += imageLoad(blurred_map, ivec2(row0 + i, col0 + j));
 			}
-			imageStore(radiance_map, ivec2(row, col), vec4(sum, 0, 0, 0));
 		}
+		coef_block[index] = sum;
+	}
+	barrier();
+	// Add up the slices of the boxes summed. Each level of the full transform
+	// divides the low-pass band by sqrt(2), so a box of box_h x box_w texels
+	// is scaled by 1 / sqrt(box_h * box_w).
+	for (int index_coef = GlobalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		if (!box_dirty[index_coef])
+		{
+			continue;
+		}
+		vec4 sum = coef_block[index_coef];
+		for (k = 1; k < slices; k++)
+		{
+			sum += coef_block[index_coef + k * size_coef_array];
+		}
+		box_sums.data[index_coef] = sum / sqrt(float(box_h * box_w));
+	}
+	memoryBarrierBuffer();
+	barrier();
+	for (int index_coef = GlobalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		coef_block[index_coef] = box_sums.data[index_coef];
 	}
 	barrier();
 }
 
-void haar2D()
+// The CDF wavelets overlap neighboring samples, so their band is computed by
+// lifting the k_h x k_w corner of the image in haar_wavelet_temp_image, one
+// level after the other. Lifting is done in place: each level leaves its
+// low-pass samples where its even samples were and its high-pass samples,
+// which later levels do not need, where its odd ones were. Sample (r, c) of
+// the band thus ends up at (r * box_h, c * box_w), and only the rows holding
+// the band are lifted along.
+void liftingLowPass()
 {
 	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
-	int i, j, k;
-	float s = sqrt(2.0);
-	// copy radiance_map into haar_wavelet_temp_image
-	for (i = GlobalInvocationIndex; i < tex_w * tex_h; i += WorkGroupSize)
+	int i, l, st;
+	float lift[4];
+	float scale;
+	int steps = liftingScheme(lift, scale);
+	int k_h = 1;
+	while (k_h * 2 <= tex_h)
+	{
+		k_h = k_h * 2;
+	}
+	int k_w = 1;
+	while (k_w * 2 <= tex_w)
+	{
+		k_w = k_w * 2;
+	}
+	int box_h = k_h / coef_h;
+	int box_w = k_w / coef_w;
+	for (i = GlobalInvocationIndex; i < k_h * k_w; i += WorkGroupSize)
+	{
+		ivec2 texel = ivec2(i / k_w, i % k_w);
+		imageStore(haar_wavelet_temp_image, texel, imageLoad(blurred_map, texel));
+	}
+	memoryBarrierImage();
+	barrier();
+	// Columns, a level of k_h / st samples st apart at a time. Predict steps
+	// write odd samples from even ones and update steps the other way
+	// round, so the pairs of a step are independent.
+	for (st = 1; st < box_h; st *= 2)
+	{
+		int pairs = k_h / (2 * st);
+		for (l = 0; l < steps; l++)
+		{
+			for (i = GlobalInvocationIndex; i < k_w * pairs; i += WorkGroupSize)
+			{
+				int col = i / pairs;
+				int p = i % pairs;
+				ivec2 even = ivec2(2 * p * st, col);
+				ivec2 odd = ivec2((2 * p + 1) * st, col);
+				if (l % 2 == 0)
+				{
+					ivec2 next = p + 1 < pairs ? ivec2((2 * p + 2) * st, col) : even;
+					imageStore(haar_wavelet_temp_image, odd, imageLoad(haar_wavelet_temp_image, odd)
+						+ lift[l] * (imageLoad(haar_wavelet_temp_image, even) + imageLoad(haar_wavelet_temp_image, next)));
+				}
+				else
+				{
+					ivec2 prev = 0 < p ? ivec2((2 * p - 1) * st, col) : odd;
+					imageStore(haar_wavelet_temp_image, even, imageLoad(haar_wavelet_temp_image, even)
+						+ lift[l] * (imageLoad(haar_wavelet_temp_image, prev) + imageLoad(haar_wavelet_temp_image, odd)));
+				}
+			}
+			memoryBarrierImage();
+			barrier();
+		}
+		for (i = GlobalInvocationIndex; i < k_w * pairs; i += WorkGroupSize)
+		{
+			ivec2 even = ivec2(2 * (i % pairs) * st, i / pairs);
+			imageStore(haar_wavelet_temp_image, even, imageLoad(haar_wavelet_temp_image, even) * scale);
+		}
+		memoryBarrierImage();
+		barrier();
+	}
+	// Rows, only those holding the band.
+	for (st = 1; st < box_w; st *= 2)
 	{
-		int row = i / tex_w;
-		int col = i % tex_w;
-		imageStore(haar_wavelet_temp_image, ivec2(row, col), imageLoad(radiance_map, ivec2(row, col)));
+		int pairs = k_w / (2 * st);
+		for (l = 0; l < steps; l++)
+		{
+			for (i = GlobalInvocationIndex; i < coef_h * pairs; i += WorkGroupSize)
+			{
+				int row = (i / pairs) * box_h;
+				int p = i % pairs;
+				ivec2 even = ivec2(row, 2 * p * st);
+				ivec2 odd = ivec2(row, (2 * p + 1) * st);
+				if (l % 2 == 0)
+				{
+					ivec2 next = p + 1 < pairs ? ivec2(row, (2 * p + 2) * st) : even;
+					imageStore(haar_wavelet_temp_image, odd, imageLoad(haar_wavelet_temp_image, odd)
+						+ lift[l] * (imageLoad(haar_wavelet_temp_image, even) + imageLoad(haar_wavelet_temp_image, next)));
+				}
+				else
+				{
+					ivec2 prev = 0 < p ? ivec2(row, (2 * p - 1) * st) : odd;
+					imageStore(haar_wavelet_temp_image, even, imageLoad(haar_wavelet_temp_image, even)
+						+ lift[l] * (imageLoad(haar_wavelet_temp_image, prev) + imageLoad(haar_wavelet_temp_image, odd)));
+				}
+			}
+			memoryBarrierImage();
+			barrier();
+		}
+		for (i = GlobalInvocationIndex; i < coef_h * pairs; i += WorkGroupSize)
+		{
+			ivec2 even = ivec2((i / pairs) * box_h, 2 * (i % pairs) * st);
+			imageStore(haar_wavelet_temp_image, even, imageLoad(haar_wavelet_temp_image, even) * scale);
+		}
+		memoryBarrierImage();
+		barrier();
+	}
+	for (int index_coef = GlobalInvocationIndex; index_coef < size_coef_array; index_coef += WorkGroupSize)
+	{
+		ivec2 texel = ivec2((index_coef / coef_w) * box_h, (index_coef % coef_w) * box_w);
+		coef_block[index_coef] = imageLoad(haar_wavelet_temp_image, texel);
 	}
 	barrier();
-	// Determine K, the largest power of 2 such that K <= M.
-	k = 1;
-	while (k * 2 <= tex_h)
+}
+
+// Lifting steps of the CDF wavelets, alternately predicting odd samples from
+// their even neighbors and updating even samples from their odd ones. The
+// low-pass band is then scaled by scale and the high-pass band by -1 / scale,
+// which matches the gains and signs of the Haar transform. The signal is
+// extended symmetrically at both ends.
+int liftingScheme(out float lift[4], out float scale)
+{
+	if (wavelet == WAVELET_CDF97)
+	{
+		lift = float[4](-1.586134342, -0.05298011857, 0.8829110755, 0.4435068520);
+		scale = 1.149604399;
+		return 4;
+	}
+	lift = float[4](-0.5, 0.25, 0, 0);
+	scale = sqrt(2.0);
+	return 2;
+}
+
+// One level of the wavelet on the 2k entries of line, leaving the low-pass
+// half in line[0, k) and the high-pass half in line[k, 2k).
+void waveletStep(inout vec4 line[MAX_COEF_DIM], int k)
+{
+	int i, l;
+	vec4 split[MAX_COEF_DIM];
+	if (wavelet == WAVELET_HAAR)
+	{
+		float s = sqrt(2.0);
+		for (i = 0; i < k; i++)
+		{
+			split[i] = (line[2 * i] + line[2 * i + 1]) / s;
+			split[k + i] = (line[2 * i] - line[2 * i + 1]) / s;
+		}
+	}
+	else
+	{
+		float lift[4];
+		float scale;
+		int steps = liftingScheme(lift, scale);
+		for (l = 0; l < steps; l++)
+		{
+			if (l % 2 == 0)
+			{
+				for (i = 0; i < k; i++)
+				{
+					line[2 * i + 1] += lift[l] * (line[2 * i] + line[i + 1 < k ? 2 * i + 2 : 2 * i]);
+				}
+			}
+			else
+			{
+				for (i = 0; i < k; i++)
+				{
+					line[2 * i] += lift[l] * (line[0 < i ? 2 * i - 1 : 2 * i + 1] + line[2 * i + 1]);
+				}
+			}
+		}
+		for (i = 0; i < k; i++)
+		{
+			split[i] = line[2 * i] * scale;
+			split[k + i] = line[2 * i + 1] * (-1.0 / scale);
+		}
+	}
+	for (i = 0; i < 2 * k; i++)
 	{
-		k = k * 2;
+		line[i] = split[i];
 	}
-	// Transform all columns.
-	for (j = GlobalInvocationIndex; j < tex_w; j += WorkGroupSize)
+}
+
+void transformBlock()
+{
+	int GlobalInvocationIndex = int(gl_WorkGroupID.x * gl_WorkGroupSize.x + gl_LocalInvocationID.x);
+	int i, j, k;
+	vec4 line[MAX_COEF_DIM];
+	if (haar_mode == HAAR_NONSTANDARD)
 	{
+		// One step on the columns, then one on the rows, of the current
+		// low-pass block per level.
+		int l_h = 0;
+		while ((2 << l_h) <= coef_h)
+		{
+			l_h++;
+		}
+		int l_w = 0;
+		while ((2 << l_w) <= coef_w)
+		{
+			l_w++;
+		}
+		for (int l = 0; l < max(l_h, l_w); l++)
+		{
+			int rows = coef_h >> min(l, l_h);
+			int cols = coef_w >> min(l, l_w);
+			if (l < l_h)
+			{
+				k = rows / 2;
+				for (j = GlobalInvocationIndex; j < cols; j += WorkGroupSize)
+				{
+					for (i = 0; i < 2 * k; i++)
+					{
+						line[i] = coef_block[i * coef_w + j];
+					}
+					waveletStep(line, k);
+					for (i = 0; i < 2 * k; i++)
+					{
+						coef_block[i * coef_w + j] = line[i];
+					}
+				}
+			}
+			barrier();
+			if (l < l_w)
+			{
+				k = cols / 2;
+				for (i = GlobalInvocationIndex; i < rows; i += WorkGroupSize)
+				{
+					for (j = 0; j < 2 * k; j++)
+					{
+						line[j] = coef_block[i * coef_w + j];
+					}
+					waveletStep(line, k);
+					for (j = 0; j < 2 * k; j++)
+					{
+						coef_block[i * coef_w + j] = line[j];
+					}
+				}
+			}
+			barrier();
+		}
+		return;
+	}
+	// Transform all columns of the block.
+	for (j = GlobalInvocationIndex; j < coef_w; j += WorkGroupSize)
+	{
+		k = coef_h;
 		while (1 < k)
 		{
 			k = k / 2;
-			for (i = 0; i < k; i++)
+			for (i = 0; i < 2 * k; i++)
 			{
-				imageStore(haar_wavelet_temp_image, ivec2(i, j), (imageLoad(radiance_map, ivec2(2 * i, j)) + imageLoad(radiance_map, ivec2(2 * i + 1, j))) / s);
-				imageStore(haar_wavelet_temp_image, ivec2(k + i, j), (imageLoad(radiance_map, ivec2(2 * i, j)) - imageLoad(radiance_map, ivec2(2 * i + 1, j))) / s);
+				line[i] = coef_block[i * coef_w + j];
 			}
+			waveletStep(line, k);
 			for (i = 0; i < 2 * k; i++)
 			{
-				imageStore(radiance_map, ivec2(i, j), imageLoad(haar_wavelet_temp_image, ivec2(i, j)));
+				coef_block[i * coef_w + j] = line[i];
 			}
 		}
 	}
 	barrier();
-	// Determine K, the largest power of 2 such that K <= N.
-	k = 1;
-	while (k * 2 <= tex_w)
-	{
-		k = k * 2;
-	}
-	// Transform all rows.
-	for (i = GlobalInvocationIndex; i < tex_h; i += WorkGroupSize)
+	// Transform all rows of the block.
+	for (i = GlobalInvocationIndex; i < coef_h; i += WorkGroupSize)
 	{
+		k = coef_w;
 		while (1 < k)
 		{
 			k = k / 2;
-			for (j = 0; j < k; j++)
+			for (j = 0; j < 2 * k; j++)
 			{
-				imageStore(haar_wavelet_temp_image, ivec2(i, j), (imageLoad(radiance_map, ivec2(i, 2 * j)) + imageLoad(radiance_map, ivec2(i, 2 * j + 1))) / s);
-				imageStore(haar_wavelet_temp_image, ivec2(i, k + j), (imageLoad(radiance_map, ivec2(i, 2 * j)) - imageLoad(radiance_map, ivec2(i, 2 * j + 1))) / s);
+				line[j] = coef_block[i * coef_w + j];
 			}
+			waveletStep(line, k);
 			for (j = 0; j < 2 * k; j++)
 			{
-				imageStore(radiance_map, ivec2(i, j), imageLoad(haar_wavelet_temp_image, ivec2(i, j)));
+				coef_block[i * coef_w + j] = line[j];
 			}
 		}
 	}
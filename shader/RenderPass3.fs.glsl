@@ -11,15 +11,39 @@ layout(std430, binding = 0) buffer RadianceCoef
 	vec4 data[];
 } radiance_coef;
 
+struct SparseCoef
+{
+	int index;
+	float value;
+};
 layout(std430, binding = 1) buffer KernelCoef
 {
-	vec4 data[];
+	SparseCoef data[];
 } kernel_coef;
+// Codebook entry of the kernel of each texel, row * tex_w + col; the entries
+// are in KernelCoef, coef_k each.
+layout(std430, binding = 5) buffer KernelIndex
+{
+	uint data[];
+} kernel_index;
+// Weights of the kernel of each texel over the basis of tssss-bake -lowrank,
+// lowrank_rank each, and the basis vectors' dot products with RadianceCoef
+// (see LowRankProject). At lowrank_rank 0 the kernels are sampled sparse.
+layout(std430, binding = 7) buffer LowRankWeights
+{
+	float data[];
+} lowrank_weights;
+layout(std430, binding = 8) buffer LowRankProjection
+{
+	vec4 data[];
+} lowrank_projection;
 
 uniform int tex_h;
 uniform int tex_w;
 uniform int coef_h;
 uniform int coef_w;
+uniform int coef_k;
+uniform int lowrank_rank;
 uniform vec3 view_pos;
 layout(binding = 0) uniform sampler2D diffuse_map;
 
@@ -38,11 +62,22 @@ void main()
 
 vec3 colorAt(int row, int col)
 {
-	int kernel_index_base = (row * tex_w + col) * coef_h * coef_w;
+	if (lowrank_rank > 0)
+	{
+		int weight_base = (row * tex_w + col) * lowrank_rank;
+		vec3 color = vec3(0, 0, 0);
+		for (int r = 0; r < lowrank_rank; r++)
+		{
+			color += lowrank_projection.data[r].rgb * lowrank_weights.data[weight_base + r];
+		}
+		return color;
+	}
+	int kernel_index_base = int(kernel_index.data[row * tex_w + col]) * coef_k;
 	vec3 color = vec3(0, 0, 0);
-	for (int i = 0; i < coef_h * coef_w; i++)
+	for (int i = 0; i < coef_k; i++)
 	{
-		color += radiance_coef.data[i].rgb * kernel_coef.data[kernel_index_base + i].r;
+		SparseCoef c = kernel_coef.data[kernel_index_base + i];
+		color += radiance_coef.data[c.index].rgb * c.value;
 	}
 	return color;
 }
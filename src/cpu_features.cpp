@@ -0,0 +1,69 @@
+#include "cpu_features.hpp"
+
+#if TSSSS_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static SimdLevel detectSimdLevel()
+{
+#if TSSSS_X86 && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	if (max_leaf < 7)
+		return SimdLevel::SCALAR;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	if (!osxsave || !avx)
+		return SimdLevel::SCALAR;
+	unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+	bool avx512f = (info[1] & (1 << 16)) != 0;
+	bool avx512dq = (info[1] & (1 << 17)) != 0;
+	// XMM, YMM and the three AVX-512 state components must be enabled by the OS.
+	if (avx512f && avx512dq && (xcr0 & 0xe6) == 0xe6)
+		return SimdLevel::AVX512;
+	if (avx2 && fma && (xcr0 & 0x6) == 0x6)
+		return SimdLevel::AVX2;
+	return SimdLevel::SCALAR;
+#elif TSSSS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+		return SimdLevel::AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SimdLevel::AVX2;
+	return SimdLevel::SCALAR;
+#else
+	return SimdLevel::SCALAR;
+#endif
+}
+
+static SimdLevel supported_level = detectSimdLevel();
+static SimdLevel current_level = supported_level;
+
+SimdLevel simd_level()
+{
+	return current_level;
+}
+
+void simd_set_level(SimdLevel level)
+{
+	current_level = (int)level < (int)supported_level ? level : supported_level;
+}
+
+const char *simd_level_name(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::AVX2:
+		return "avx2";
+	case SimdLevel::AVX512:
+		return "avx512";
+	default:
+		return "scalar";
+	}
+}
@@ -1,8 +1,10 @@
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
 #include <ctime>
+#include <vector>
 
 using namespace std;
 
@@ -23,6 +25,10 @@ void haar_1d(int n, double x[])
 //    For the classical Haar transform, N should be a power of 2.
 //    However, this is not required here.
 //
+//    This version allocates its own workspace on every call.  Callers
+//    transforming many arrays should use the templated overload, which
+//    takes a caller-owned workspace.
+//
 //  Licensing:
 //
 //    This code is distributed under the GNU LGPL license.
@@ -43,45 +49,13 @@ void haar_1d(int n, double x[])
 //    On output, the transformed vector.
 //
 {
-	int i;
-	int k;
-	double s;
-	double *y;
-
-	s = sqrt(2.0);
+	double *w;
 
-	y = new double[n];
-	//
-	//  Initialize.
-	//
-	for (i = 0; i < n; i++)
-	{
-		y[i] = 0.0;
-	}
-	//
-	//  Determine K, the largest power of 2 such that K <= N.
-	//
-	k = 1;
-	while (k * 2 <= n)
-	{
-		k = k * 2;
-	}
+	w = new double[haar_1d_work_size(n)];
 
-	while (1 < k)
-	{
-		k = k / 2;
-		for (i = 0; i < k; i++)
-		{
-			y[i] = (x[2 * i] + x[2 * i + 1]) / s;
-			y[i + k] = (x[2 * i] - x[2 * i + 1]) / s;
-		}
-		for (i = 0; i < k * 2; i++)
-		{
-			x[i] = y[i];
-		}
-	}
+	haar_1d<double>(n, x, w);
 
-	delete[] y;
+	delete[] w;
 
 	return;
 }
@@ -100,6 +74,10 @@ void haar_1d_inverse(int n, double x[])
 //    For the classical Haar transform, N should be a power of 2.
 //    However, this is not required here.
 //
+//    This version allocates its own workspace on every call.  Callers
+//    transforming many arrays should use the templated overload, which
+//    takes a caller-owned workspace.
+//
 //  Licensing:
 //
 //    This code is distributed under the GNU LGPL license.
@@ -120,38 +98,13 @@ void haar_1d_inverse(int n, double x[])
 //    On output, the transformed vector.
 //
 {
-	int i;
-	int k;
-	double s;
-	double *y;
-
-	s = sqrt(2.0);
+	double *w;
 
-	y = new double[n];
-	//
-	//  Initialize.
-	//
-	for (i = 0; i < n; i++)
-	{
-		y[i] = 0.0;
-	}
+	w = new double[haar_1d_work_size(n)];
 
-	k = 1;
-	while (k * 2 <= n)
-	{
-		for (i = 0; i < k; i++)
-		{
-			y[2 * i] = (x[i] + x[i + k]) / s;
-			y[2 * i + 1] = (x[i] - x[i + k]) / s;
-		}
-		for (i = 0; i < k * 2; i++)
-		{
-			x[i] = y[i];
-		}
-		k = k * 2;
-	}
+	haar_1d_inverse<double>(n, x, w);
 
-	delete[] y;
+	delete[] w;
 
 	return;
 }
@@ -170,6 +123,10 @@ void haar_2d(int m, int n, double u[])
 //    For the classical Haar transform, M and N should be a power of 2.
 //    However, this is not required here.
 //
+//    This version allocates its own workspace on every call.  Callers
+//    transforming many arrays should use the templated overload, which
+//    takes a caller-owned workspace.
+//
 //  Licensing:
 //
 //    This code is distributed under the GNU LGPL license.
@@ -189,54 +146,139 @@ void haar_2d(int m, int n, double u[])
 //    Input/output, double U[M*N], the array to be transformed.
 //
 {
-	int i;
-	int j;
-	int k;
-	double s;
-	double *v;
+	double *w;
 
-	s = sqrt(2.0);
+	w = new double[haar_2d_work_size(m, n)];
 
-	v = new double[m * n];
+	haar_2d<double>(m, n, u, w);
 
-	for (j = 0; j < n; j++)
-	{
-		for (i = 0; i < m; i++)
-		{
-			v[i + j * m] = u[i + j * m];
-		}
-	}
-	//
-	//  Determine K, the largest power of 2 such that K <= M.
-	//
-	k = 1;
-	while (k * 2 <= m)
-	{
-		k = k * 2;
-	}
-	//
-	//  Transform all columns.
-	//
-	while (1 < k)
-	{
-		k = k / 2;
+	delete[] w;
 
-		for (j = 0; j < n; j++)
-		{
-			for (i = 0; i < k; i++)
-			{
-				v[i + j * m] = (u[2 * i + j * m] + u[2 * i + 1 + j * m]) / s;
-				v[k + i + j * m] = (u[2 * i + j * m] - u[2 * i + 1 + j * m]) / s;
-			}
-		}
-		for (j = 0; j < n; j++)
-		{
-			for (i = 0; i < 2 * k; i++)
-			{
-				u[i + j * m] = v[i + j * m];
-			}
-		}
-	}
+	return;
+}
+//****************************************************************************80
+
+void haar_2d_inverse(int m, int n, double u[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INVERSE inverts the Haar transform of an array.
+//
+//  Discussion:
+//
+//    For the classical Haar transform, M and N should be a power of 2.
+//    However, this is not required here.
+//
+//    This version allocates its own workspace on every call.  Callers
+//    transforming many arrays should use the templated overload, which
+//    takes a caller-owned workspace.
+//
+//  Licensing:
+//
+//    This code is distributed under the GNU LGPL license.
+//
+//  Modified:
+//
+//    06 March 2014
+//
+//  Author:
+//
+//    John Burkardt
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, double U[M*N], the array to be transformed.
+//
+{
+	double *w;
+
+	w = new double[haar_2d_work_size(m, n)];
+
+	haar_2d_inverse<double>(m, n, u, w);
+
+	delete[] w;
+
+	return;
+}
+//****************************************************************************80
+
+int haar_1d_work_size(int n)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_1D_WORK_SIZE returns the workspace size needed by the 1D transforms.
+//
+//  Parameters:
+//
+//    Input, int N, the dimension of the vector.
+//
+//    Output, int HAAR_1D_WORK_SIZE, the number of entries the workspace W
+//    passed to HAAR_1D and HAAR_1D_INVERSE must hold.
+//
+{
+	return i4_max(n / 2, 1);
+}
+//****************************************************************************80
+
+int haar_2d_work_size(int m, int n)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_WORK_SIZE returns the workspace size needed by the 2D transforms.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Output, int HAAR_2D_WORK_SIZE, the number of entries the workspace W
+//    passed to HAAR_2D and HAAR_2D_INVERSE must hold.
+//
+{
+	return i4_max(haar_1d_work_size(m), m * (n / 2));
+}
+//****************************************************************************80
+
+template <typename T>
+void haar_1d(int n, T x[], T w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_1D computes the Haar transform of a vector using a given workspace.
+//
+//  Discussion:
+//
+//    The low-pass half of each level is written back in place, since
+//    X[I] has always been consumed by the time it is overwritten, and only
+//    the high-pass half goes through the workspace.  The arithmetic is the
+//    same as in the allocating version, so the results are bit-identical.
+//
+//  Parameters:
+//
+//    Input, int N, the dimension of the vector.
+//
+//    Input/output, T X[N], on input, the vector to be transformed.
+//    On output, the transformed vector.
+//
+//    Workspace, T W[HAAR_1D_WORK_SIZE(N)].
+//
+{
+	int i;
+	int k;
+	T s;
+	T a;
+	T b;
+
+	s = sqrt(T(2));
 	//
 	//  Determine K, the largest power of 2 such that K <= N.
 	//
@@ -245,139 +287,2199 @@ void haar_2d(int m, int n, double u[])
 	{
 		k = k * 2;
 	}
-	//
-	//  Transform all rows.
-	//
+
 	while (1 < k)
 	{
 		k = k / 2;
-
-		for (j = 0; j < k; j++)
+		for (i = 0; i < k; i++)
 		{
-			for (i = 0; i < m; i++)
-			{
-				v[i + (j)*m] = (u[i + 2 * j * m] + u[i + (2 * j + 1) * m]) / s;
-				v[i + (k + j) * m] = (u[i + 2 * j * m] - u[i + (2 * j + 1) * m]) / s;
-			}
+			a = x[2 * i];
+			b = x[2 * i + 1];
+			x[i] = (a + b) / s;
+			w[i] = (a - b) / s;
 		}
-
-		for (j = 0; j < 2 * k; j++)
+		for (i = 0; i < k; i++)
 		{
-			for (i = 0; i < m; i++)
-			{
-				u[i + j * m] = v[i + j * m];
-			}
+			x[i + k] = w[i];
 		}
 	}
-	delete[] v;
 
 	return;
 }
+template void haar_1d<float>(int n, float x[], float w[]);
+template void haar_1d<double>(int n, double x[], double w[]);
 //****************************************************************************80
 
-void haar_2d_inverse(int m, int n, double u[])
+template <typename T>
+void haar_1d_inverse(int n, T x[], T w[])
 
 //****************************************************************************80
 //
 //  Purpose:
 //
-//    HAAR_2D_INVERSE inverts the Haar transform of an array.
+//    HAAR_1D_INVERSE inverts the Haar transform of a vector using a given
+//    workspace.
 //
 //  Discussion:
 //
-//    For the classical Haar transform, M and N should be a power of 2.
-//    However, this is not required here.
+//    The high-pass half of each level is saved in the workspace, then the
+//    outputs are written in place from the top down.
 //
-//  Licensing:
+//  Parameters:
 //
-//    This code is distributed under the GNU LGPL license.
+//    Input, int N, the dimension of the vector.
 //
-//  Modified:
+//    Input/output, T X[N], on input, the vector to be transformed.
+//    On output, the transformed vector.
 //
-//    06 March 2014
+//    Workspace, T W[HAAR_1D_WORK_SIZE(N)].
 //
-//  Author:
+{
+	int i;
+	int k;
+	T s;
+	T a;
+	T b;
+
+	s = sqrt(T(2));
+
+	k = 1;
+	while (k * 2 <= n)
+	{
+		for (i = 0; i < k; i++)
+		{
+			w[i] = x[i + k];
+		}
+		for (i = k - 1; 0 <= i; i--)
+		{
+			a = x[i];
+			b = w[i];
+			x[2 * i] = (a + b) / s;
+			x[2 * i + 1] = (a - b) / s;
+		}
+		k = k * 2;
+	}
+
+	return;
+}
+template void haar_1d_inverse<float>(int n, float x[], float w[]);
+template void haar_1d_inverse<double>(int n, double x[], double w[]);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_rows(int m, int n, T u[], int ldu, T w[])
+
+//****************************************************************************80
 //
-//    John Burkardt
+//  Purpose:
+//
+//    HAAR_2D_ROWS applies the 1D Haar transform to every row of an array.
+//
+//  Discussion:
+//
+//    This is the second half of HAAR_2D.  The levels are done one after
+//    the other over the whole array, so that the inner loop runs down
+//    contiguous columns.
+//
+//    U may be a block of M rows of a larger column-major array whose
+//    columns are LDU entries apart.
 //
 //  Parameters:
 //
 //    Input, int M, N, the dimensions of the array.
 //
-//    Input/output, double U[M*N], the array to be transformed.
+//    Input/output, T U[LDU*N], the array whose rows are to be transformed.
+//
+//    Input, int LDU, the distance between columns of U, at least M.
+//
+//    Workspace, T W[M*(N/2)].
 //
 {
 	int i;
 	int j;
 	int k;
-	double s;
-	double *v;
-
-	s = sqrt(2.0);
+	T s;
+	T a;
+	T b;
 
-	v = new double[m * n];
-
-	for (j = 0; j < n; j++)
-	{
-		for (i = 0; i < m; i++)
-		{
-			v[i + j * m] = u[i + j * m];
-		}
-	}
+	s = sqrt(T(2));
 	//
-	//  Inverse transform of all rows.
+	//  Determine K, the largest power of 2 such that K <= N.
 	//
 	k = 1;
-
 	while (k * 2 <= n)
 	{
+		k = k * 2;
+	}
+
+	while (1 < k)
+	{
+		k = k / 2;
+
 		for (j = 0; j < k; j++)
 		{
 			for (i = 0; i < m; i++)
 			{
-				v[i + (2 * j) * m] = (u[i + j * m] + u[i + (k + j) * m]) / s;
-				v[i + (2 * j + 1) * m] = (u[i + j * m] - u[i + (k + j) * m]) / s;
+				a = u[i + 2 * j * ldu];
+				b = u[i + (2 * j + 1) * ldu];
+				u[i + j * ldu] = (a + b) / s;
+				w[i + j * m] = (a - b) / s;
 			}
 		}
 
-		for (j = 0; j < 2 * k; j++)
+		for (j = 0; j < k; j++)
 		{
 			for (i = 0; i < m; i++)
 			{
-				u[i + j * m] = v[i + j * m];
+				u[i + (k + j) * ldu] = w[i + j * m];
 			}
 		}
-		k = k * 2;
+	}
+
+	return;
+}
+template void haar_2d_rows<float>(int m, int n, float u[], int ldu, float w[]);
+template void haar_2d_rows<double>(int m, int n, double u[], int ldu, double w[]);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_rows_inverse(int m, int n, T u[], int ldu, T w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_ROWS_INVERSE inverts the Haar transform of every row of an array.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[LDU*N], the array whose rows are to be transformed.
+//
+//    Input, int LDU, the distance between columns of U, at least M.
+//
+//    Workspace, T W[M*(N/2)].
+//
+{
+	int i;
+	int j;
+	int k;
+	T s;
+	T a;
+	T b;
+
+	s = sqrt(T(2));
+
+	k = 1;
+	while (k * 2 <= n)
+	{
+		for (j = 0; j < k; j++)
+		{
+			for (i = 0; i < m; i++)
+			{
+				w[i + j * m] = u[i + (k + j) * ldu];
+			}
+		}
+
+		for (j = k - 1; 0 <= j; j--)
+		{
+			for (i = 0; i < m; i++)
+			{
+				a = u[i + j * ldu];
+				b = w[i + j * m];
+				u[i + (2 * j) * ldu] = (a + b) / s;
+				u[i + (2 * j + 1) * ldu] = (a - b) / s;
+			}
+		}
+		k = k * 2;
+	}
+
+	return;
+}
+template void haar_2d_rows_inverse<float>(int m, int n, float u[], int ldu, float w[]);
+template void haar_2d_rows_inverse<double>(int m, int n, double u[], int ldu, double w[]);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d(int m, int n, T u[], T w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D computes the Haar transform of an array using a given workspace.
+//
+//  Discussion:
+//
+//    Each column is independent, so all levels of one column are done
+//    before moving on to the next.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_WORK_SIZE(M,N)].
+//
+{
+	int j;
+	//
+	//  Transform all columns.
+	//
+	for (j = 0; j < n; j++)
+	{
+		haar_1d(m, u + j * m, w);
+	}
+	//
+	//  Transform all rows.
+	//
+	haar_2d_rows(m, n, u, m, w);
+
+	return;
+}
+template void haar_2d<float>(int m, int n, float u[], float w[]);
+template void haar_2d<double>(int m, int n, double u[], double w[]);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_inverse(int m, int n, T u[], T w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INVERSE inverts the Haar transform of an array using a given
+//    workspace.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_WORK_SIZE(M,N)].
+//
+{
+	int j;
+	//
+	//  Inverse transform of all rows.
+	//
+	haar_2d_rows_inverse(m, n, u, m, w);
+	//
+	//  Inverse transform of all columns.
+	//
+	for (j = 0; j < n; j++)
+	{
+		haar_1d_inverse(m, u + j * m, w);
+	}
+
+	return;
+}
+template void haar_2d_inverse<float>(int m, int n, float u[], float w[]);
+template void haar_2d_inverse<double>(int m, int n, double u[], double w[]);
+//****************************************************************************80
+
+int haar_2d_panel_rows(int m, int n, int elem_size)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_PANEL_ROWS picks a panel height for the blocked 2D transforms.
+//
+//  Discussion:
+//
+//    A panel of B rows touches B*N entries of the array plus B*(N/2)
+//    entries of high-pass scratch.  B is chosen so that both fit in about
+//    1 MB, which stays inside L2 on current CPUs.  B is rounded down to a
+//    multiple of 8, so that every column segment covers whole cache
+//    lines, and kept at 8 or more, so only rows longer than about 11000
+//    doubles or 22000 floats go past the budget.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input, int ELEM_SIZE, the size in bytes of one entry.
+//
+//    Output, int HAAR_2D_PANEL_ROWS, the panel height, between 1 and M.
+//
+{
+	const int cache_bytes = 1024 * 1024;
+	int b;
+
+	b = cache_bytes / (elem_size * i4_max(n + n / 2, 1));
+	b = (b / 8) * 8;
+	b = i4_max(b, 8);
+	b = i4_min(b, m);
+
+	return i4_max(b, 1);
+}
+//****************************************************************************80
+
+int haar_2d_blocked_work_size(int m, int n, int panel)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_BLOCKED_WORK_SIZE returns the workspace size needed by the
+//    blocked 2D transforms.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input, int PANEL, the panel height.
+//
+//    Output, int HAAR_2D_BLOCKED_WORK_SIZE, the number of entries the
+//    workspace W passed to HAAR_2D_BLOCKED and HAAR_2D_INVERSE_BLOCKED
+//    must hold.
+//
+{
+	return i4_max(haar_1d_work_size(m), panel * (n / 2));
+}
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_blocked(int m, int n, T u[], T w[], int panel)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_BLOCKED computes the Haar transform of an array, one panel of
+//    rows at a time.
+//
+//  Discussion:
+//
+//    In HAAR_2D the row pass combines columns 2J and 2J+1, which are a
+//    whole column apart, and each level streams the whole array through
+//    memory again.  Once the array is larger than the cache that costs
+//    about four times the traffic of a single read and write.  Here the
+//    rows are split into panels of PANEL rows, and all levels of a panel's
+//    row transform are done while the panel is still in cache.
+//
+//    The arithmetic is the same as in HAAR_2D, so the coefficients are
+//    bit-identical.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_BLOCKED_WORK_SIZE(M,N,PANEL)].
+//
+//    Input, int PANEL, the panel height, as from HAAR_2D_PANEL_ROWS.
+//
+{
+	int i0;
+	int j;
+
+	for (j = 0; j < n; j++)
+	{
+		haar_1d(m, u + j * m, w);
+	}
+
+	for (i0 = 0; i0 < m; i0 = i0 + panel)
+	{
+		haar_2d_rows(i4_min(panel, m - i0), n, u + i0, m, w);
+	}
+
+	return;
+}
+template void haar_2d_blocked<float>(int m, int n, float u[], float w[], int panel);
+template void haar_2d_blocked<double>(int m, int n, double u[], double w[], int panel);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_inverse_blocked(int m, int n, T u[], T w[], int panel)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INVERSE_BLOCKED inverts the Haar transform of an array, one
+//    panel of rows at a time.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_BLOCKED_WORK_SIZE(M,N,PANEL)].
+//
+//    Input, int PANEL, the panel height, as from HAAR_2D_PANEL_ROWS.
+//
+{
+	int i0;
+	int j;
+
+	for (i0 = 0; i0 < m; i0 = i0 + panel)
+	{
+		haar_2d_rows_inverse(i4_min(panel, m - i0), n, u + i0, m, w);
+	}
+
+	for (j = 0; j < n; j++)
+	{
+		haar_1d_inverse(m, u + j * m, w);
+	}
+
+	return;
+}
+template void haar_2d_inverse_blocked<float>(int m, int n, float u[], float w[], int panel);
+template void haar_2d_inverse_blocked<double>(int m, int n, double u[], double w[], int panel);
+//****************************************************************************80
+
+int haar_2d_interleaved_work_size(int m, int n, int c)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INTERLEAVED_WORK_SIZE returns the workspace size needed by the
+//    interleaved 2D transforms.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array, in pixels.
+//
+//    Input, int C, the number of channels per pixel.
+//
+//    Output, int HAAR_2D_INTERLEAVED_WORK_SIZE, the number of entries the
+//    workspace W passed to HAAR_2D_INTERLEAVED and
+//    HAAR_2D_INVERSE_INTERLEAVED must hold.
+//
+{
+	return i4_max(c * haar_1d_work_size(m), m * c * (n / 2));
+}
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_interleaved(int m, int n, int c, T u[], T w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INTERLEAVED computes the Haar transform of every channel of an
+//    array of interleaved pixels.
+//
+//  Discussion:
+//
+//    Channel K of pixel (I,J) is U[K+I*C+J*M*C].  For C = 4 this is the
+//    layout of an RGBA32F texture read back with glGetTexImage, with I the
+//    x coordinate, and an array of glm::vec4 may be passed through a cast.
+//
+//    Seen with the channels folded into the first index, column J is a
+//    C by M array whose rows are the channels, and the whole image is an
+//    M*C by N array, so both passes are row passes and all channels of a
+//    pixel move through the cache together.  The second pass is split into
+//    panels as in HAAR_2D_BLOCKED.  The arithmetic for each
+//    channel is the one HAAR_2D applies to that channel alone, so the
+//    coefficients are bit-identical to transforming the planes one by one.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array, in pixels.
+//
+//    Input, int C, the number of channels per pixel.
+//
+//    Input/output, T U[C*M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_INTERLEAVED_WORK_SIZE(M,N,C)].
+//
+{
+	int i0;
+	int j;
+	int panel;
+	//
+	//  Transform all columns.
+	//
+	for (j = 0; j < n; j++)
+	{
+		haar_2d_rows(c, m, u + j * m * c, c, w);
+	}
+	//
+	//  Transform all rows, one panel at a time.
+	//
+	panel = haar_2d_panel_rows(m * c, n, sizeof(T));
+	for (i0 = 0; i0 < m * c; i0 = i0 + panel)
+	{
+		haar_2d_rows(i4_min(panel, m * c - i0), n, u + i0, m * c, w);
+	}
+
+	return;
+}
+template void haar_2d_interleaved<float>(int m, int n, int c, float u[], float w[]);
+template void haar_2d_interleaved<double>(int m, int n, int c, double u[], double w[]);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_inverse_interleaved(int m, int n, int c, T u[], T w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INVERSE_INTERLEAVED inverts the Haar transform of every channel
+//    of an array of interleaved pixels.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array, in pixels.
+//
+//    Input, int C, the number of channels per pixel.
+//
+//    Input/output, T U[C*M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_INTERLEAVED_WORK_SIZE(M,N,C)].
+//
+{
+	int i0;
+	int j;
+	int panel;
+	//
+	//  Inverse transform of all rows, one panel at a time.
+	//
+	panel = haar_2d_panel_rows(m * c, n, sizeof(T));
+	for (i0 = 0; i0 < m * c; i0 = i0 + panel)
+	{
+		haar_2d_rows_inverse(i4_min(panel, m * c - i0), n, u + i0, m * c, w);
+	}
+	//
+	//  Inverse transform of all columns.
+	//
+	for (j = 0; j < n; j++)
+	{
+		haar_2d_rows_inverse(c, m, u + j * m * c, c, w);
+	}
+
+	return;
+}
+template void haar_2d_inverse_interleaved<float>(int m, int n, int c, float u[], float w[]);
+template void haar_2d_inverse_interleaved<double>(int m, int n, int c, double u[], double w[]);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_nonstandard(int m, int n, T u[], T w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_NONSTANDARD computes the nonstandard Haar transform of an array.
+//
+//  Discussion:
+//
+//    HAAR_2D does every level of the column transform before any level of
+//    the row transform, so most of its coefficients mix a fine scale in one
+//    direction with a coarse scale in the other.  The nonstandard, or
+//    pyramid, decomposition alternates instead: each level does one step on
+//    the columns and one step on the rows of the current low-pass block,
+//    then moves on to the low-pass quarter.  Every coefficient then belongs
+//    to a single scale, which compacts smooth data such as the diffuse
+//    profile kernels into fewer coefficients.
+//
+//    Once one dimension is down to a single entry, the remaining levels
+//    only step the other.  As in HAAR_2D, rows and columns past the
+//    largest power of 2 are left alone.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_WORK_SIZE(M,N)].
+//
+{
+	int i;
+	int j;
+	int km;
+	int kn;
+	int rows;
+	T s;
+	T a;
+	T b;
+	T *x;
+
+	s = sqrt(T(2));
+
+	km = 1;
+	while (km * 2 <= m)
+	{
+		km = km * 2;
+	}
+	kn = 1;
+	while (kn * 2 <= n)
+	{
+		kn = kn * 2;
+	}
+	//
+	//  The current low-pass block is KM by KN.
+	//
+	while (1 < km || 1 < kn)
+	{
+		rows = km;
+		if (1 < km)
+		{
+			km = km / 2;
+			for (j = 0; j < kn; j++)
+			{
+				x = u + j * m;
+				for (i = 0; i < km; i++)
+				{
+					a = x[2 * i];
+					b = x[2 * i + 1];
+					x[i] = (a + b) / s;
+					w[i] = (a - b) / s;
+				}
+				for (i = 0; i < km; i++)
+				{
+					x[i + km] = w[i];
+				}
+			}
+		}
+
+		if (1 < kn)
+		{
+			kn = kn / 2;
+			for (j = 0; j < kn; j++)
+			{
+				for (i = 0; i < rows; i++)
+				{
+					a = u[i + 2 * j * m];
+					b = u[i + (2 * j + 1) * m];
+					u[i + j * m] = (a + b) / s;
+					w[i + j * rows] = (a - b) / s;
+				}
+			}
+			for (j = 0; j < kn; j++)
+			{
+				for (i = 0; i < rows; i++)
+				{
+					u[i + (kn + j) * m] = w[i + j * rows];
+				}
+			}
+		}
+	}
+
+	return;
+}
+template void haar_2d_nonstandard<float>(int m, int n, float u[], float w[]);
+template void haar_2d_nonstandard<double>(int m, int n, double u[], double w[]);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_nonstandard_inverse(int m, int n, T u[], T w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_NONSTANDARD_INVERSE inverts the nonstandard Haar transform of an
+//    array.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_WORK_SIZE(M,N)].
+//
+{
+	int cols;
+	int i;
+	int j;
+	int km;
+	int kn;
+	int l;
+	int levels;
+	int lm;
+	int ln;
+	int rows;
+	T s;
+	T a;
+	T b;
+	T *x;
+
+	s = sqrt(T(2));
+	//
+	//  LM and LN are the number of steps taken on the columns and the rows.
+	//
+	lm = 0;
+	while ((2 << lm) <= m)
+	{
+		lm = lm + 1;
+	}
+	ln = 0;
+	while ((2 << ln) <= n)
+	{
+		ln = ln + 1;
+	}
+	levels = i4_max(lm, ln);
+	//
+	//  Undo level L, which turned a ROWS by COLS block into a KM by KN one.
+	//
+	for (l = levels - 1; 0 <= l; l--)
+	{
+		km = 1 << i4_max(lm - l - 1, 0);
+		kn = 1 << i4_max(ln - l - 1, 0);
+		rows = (l < lm) ? 2 * km : km;
+		cols = (l < ln) ? 2 * kn : kn;
+
+		if (l < ln)
+		{
+			for (j = 0; j < kn; j++)
+			{
+				for (i = 0; i < rows; i++)
+				{
+					w[i + j * rows] = u[i + (kn + j) * m];
+				}
+			}
+			for (j = kn - 1; 0 <= j; j--)
+			{
+				for (i = 0; i < rows; i++)
+				{
+					a = u[i + j * m];
+					b = w[i + j * rows];
+					u[i + 2 * j * m] = (a + b) / s;
+					u[i + (2 * j + 1) * m] = (a - b) / s;
+				}
+			}
+		}
+
+		if (l < lm)
+		{
+			for (j = 0; j < cols; j++)
+			{
+				x = u + j * m;
+				for (i = 0; i < km; i++)
+				{
+					w[i] = x[i + km];
+				}
+				for (i = km - 1; 0 <= i; i--)
+				{
+					a = x[i];
+					b = w[i];
+					x[2 * i] = (a + b) / s;
+					x[2 * i + 1] = (a - b) / s;
+				}
+			}
+		}
+	}
+
+	return;
+}
+template void haar_2d_nonstandard_inverse<float>(int m, int n, float u[], float w[]);
+template void haar_2d_nonstandard_inverse<double>(int m, int n, double u[], double w[]);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d(int m, int n, T u[], T w[], HaarMode mode)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D computes the Haar transform of an array in a given decomposition.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_WORK_SIZE(M,N)].
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+{
+	if (mode == HaarMode::NONSTANDARD)
+	{
+		haar_2d_nonstandard(m, n, u, w);
+	}
+	else
+	{
+		haar_2d(m, n, u, w);
+	}
+
+	return;
+}
+template void haar_2d<float>(int m, int n, float u[], float w[], HaarMode mode);
+template void haar_2d<double>(int m, int n, double u[], double w[], HaarMode mode);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_inverse(int m, int n, T u[], T w[], HaarMode mode)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INVERSE inverts the Haar transform of an array in a given
+//    decomposition.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_WORK_SIZE(M,N)].
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+{
+	if (mode == HaarMode::NONSTANDARD)
+	{
+		haar_2d_nonstandard_inverse(m, n, u, w);
+	}
+	else
+	{
+		haar_2d_inverse(m, n, u, w);
+	}
+
+	return;
+}
+template void haar_2d_inverse<float>(int m, int n, float u[], float w[], HaarMode mode);
+template void haar_2d_inverse<double>(int m, int n, double u[], double w[], HaarMode mode);
+//****************************************************************************80
+
+int haar_2d_lowpass_work_size(int m, int n, int cm, int cn)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_LOWPASS_WORK_SIZE returns the workspace size needed by
+//    HAAR_2D_LOWPASS.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input, int CM, CN, the dimensions of the block of coefficients.
+//
+//    Output, int HAAR_2D_LOWPASS_WORK_SIZE, the number of entries the
+//    workspace W passed to HAAR_2D_LOWPASS must hold.
+//
+{
+	int km;
+	int kn;
+
+	km = 1;
+	while (km * 2 <= m)
+	{
+		km = km * 2;
+	}
+	kn = 1;
+	while (kn * 2 <= n)
+	{
+		kn = kn * 2;
+	}
+
+	return cm * kn + i4_max(i4_max(km / 2, cm * (cn / 2)), 1);
+}
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_lowpass(int m, int n, const T u[], int cm, int cn, T c[], T w[], HaarMode mode)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_LOWPASS computes only the leading CM by CN block of the Haar
+//    transform of an array.
+//
+//  Discussion:
+//
+//    Entry (I,J) of the block is the same as U[I+J*M] after HAAR_2D, but
+//    the detail bands that fall outside the block are never formed.
+//
+//    Each level of HAAR_2D replaces the low-pass half by sums of pairs
+//    divided by sqrt(2), and the block only depends on the low-pass band
+//    left once the transform has come down to CM by CN.  That band is built
+//    here by halving each column, then each row, with the same pairwise
+//    arithmetic, and then transformed with HAAR_1D and HAAR_2D_ROWS.  The
+//    result is therefore bit-identical to the full transform, at the cost of
+//    reading U once.
+//
+//    In the nonstandard decomposition the block is the nonstandard
+//    transform of the same low-pass band.  That band is only reached by
+//    both dimensions at once, and the block only holds it, when the largest
+//    powers of 2 in M and N are the same multiple of CM and CN.  The
+//    band is built in a different order than in HAAR_2D_NONSTANDARD, so
+//    the results agree to rounding rather than bit for bit.
+//
+//    CM and CN must be powers of 2 no larger than M and N.  As in HAAR_2D,
+//    rows and columns past the largest power of 2 do not contribute.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input, const T U[M*N], the array to be transformed.  It is not changed.
+//
+//    Input, int CM, CN, the dimensions of the block of coefficients.
+//
+//    Output, T C[CM*CN], the leading block of the transform, stored by
+//    columns.
+//
+//    Workspace, T W[HAAR_2D_LOWPASS_WORK_SIZE(M,N,CM,CN)].
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+{
+	int i;
+	int j;
+	int k;
+	int km;
+	int kn;
+	T s;
+	T *t;
+	T *v;
+	const T *x;
+
+	s = sqrt(T(2));
+
+	km = 1;
+	while (km * 2 <= m)
+	{
+		km = km * 2;
+	}
+	kn = 1;
+	while (kn * 2 <= n)
+	{
+		kn = kn * 2;
+	}
+	//
+	//  T holds the low-pass band of the first KN columns, V is scratch.
+	//
+	t = w;
+	v = w + cm * kn;
+	//
+	//  Reduce each column to its low-pass band of CM entries, then finish
+	//  its transform in the standard decomposition.
+	//
+	for (j = 0; j < kn; j++)
+	{
+		x = u + j * m;
+		k = km;
+		if (cm < k)
+		{
+			k = k / 2;
+			for (i = 0; i < k; i++)
+			{
+				v[i] = (x[2 * i] + x[2 * i + 1]) / s;
+			}
+			while (cm < k)
+			{
+				k = k / 2;
+				for (i = 0; i < k; i++)
+				{
+					v[i] = (v[2 * i] + v[2 * i + 1]) / s;
+				}
+			}
+			x = v;
+		}
+		for (i = 0; i < cm; i++)
+		{
+			t[i + j * cm] = x[i];
+		}
+		if (mode == HaarMode::STANDARD)
+		{
+			haar_1d(cm, t + j * cm, v);
+		}
+	}
+	//
+	//  Reduce the rows to their low-pass band of CN entries, then finish
+	//  the transform.
+	//
+	k = kn;
+	while (cn < k)
+	{
+		k = k / 2;
+		for (j = 0; j < k; j++)
+		{
+			for (i = 0; i < cm; i++)
+			{
+				t[i + j * cm] = (t[i + 2 * j * cm] + t[i + (2 * j + 1) * cm]) / s;
+			}
+		}
+	}
+	if (mode == HaarMode::NONSTANDARD)
+	{
+		haar_2d_nonstandard(cm, cn, t, v);
+	}
+	else
+	{
+		haar_2d_rows(cm, cn, t, cm, v);
+	}
+
+	for (i = 0; i < cm * cn; i++)
+	{
+		c[i] = t[i];
+	}
+
+	return;
+}
+template void haar_2d_lowpass<float>(int m, int n, const float u[], int cm, int cn, float c[], float w[],
+	HaarMode mode);
+template void haar_2d_lowpass<double>(int m, int n, const double u[], int cm, int cn, double c[], double w[],
+	HaarMode mode);
+//****************************************************************************80
+
+template <typename T>
+int haar_select_largest(int n, const T c[], int k, int index[], T value[], int w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_SELECT_LARGEST keeps the K coefficients of largest magnitude.
+//
+//  Discussion:
+//
+//    The transform is orthonormal, so dropping a set of coefficients costs
+//    exactly their energy, and keeping the largest ones gives the smallest
+//    error for a given budget wherever in the array they lie.
+//
+//    The kept coefficients are returned in order of decreasing magnitude,
+//    ties going to the lower index, which is the order the compute shaders
+//    produce.
+//
+//  Parameters:
+//
+//    Input, int N, the number of coefficients.
+//
+//    Input, const T C[N], the coefficients.
+//
+//    Input, int K, the number of coefficients to keep.
+//
+//    Output, int INDEX[K], T VALUE[K], the positions in C and the values of
+//    the kept coefficients.
+//
+//    Workspace, int W[N].
+//
+//    Output, int HAAR_SELECT_LARGEST, the number of coefficients kept, the
+//    smaller of K and N.
+//
+{
+	int i;
+
+	k = i4_min(k, n);
+	if (k <= 0)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		w[i] = i;
+	}
+
+	auto larger = [c](int a, int b) {
+		T fa = fabs(c[a]);
+		T fb = fabs(c[b]);
+		return fb < fa || (fa == fb && a < b);
+	};
+	nth_element(w, w + k - 1, w + n, larger);
+	sort(w, w + k, larger);
+
+	for (i = 0; i < k; i++)
+	{
+		index[i] = w[i];
+		value[i] = c[w[i]];
+	}
+
+	return k;
+}
+template int haar_select_largest<float>(int n, const float c[], int k, int index[], float value[], int w[]);
+template int haar_select_largest<double>(int n, const double c[], int k, int index[], double value[], int w[]);
+//****************************************************************************80
+
+int wavelet_2d_work_size(int m, int n)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    WAVELET_2D_WORK_SIZE returns the workspace size needed by WAVELET_2D.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Output, int WAVELET_2D_WORK_SIZE, the number of entries the workspace
+//    W passed to WAVELET_2D, WAVELET_2D_DUAL and WAVELET_2D_INVERSE must hold.
+//
+{
+	return i4_max(haar_2d_work_size(m, n), i4_max(m, n));
+}
+//****************************************************************************80
+
+static int wavelet_lifting(Wavelet wavelet, double lift[], double &scale)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    WAVELET_LIFTING returns the lifting scheme of a CDF wavelet.
+//
+//  Discussion:
+//
+//    The steps alternate between predicting the odd samples from their
+//    even neighbors and updating the even samples from their odd ones,
+//    starting with a prediction.  The low-pass band is then multiplied by
+//    SCALE and the high-pass band by -1/SCALE, which gives both bands the
+//    gain of the orthonormal Haar transform, sqrt(2) on a constant and
+//    sqrt(2) on an alternating signal, with the same signs.
+//
+//    The 9/7 coefficients are those of JPEG 2000.
+//
+//  Parameters:
+//
+//    Input, Wavelet WAVELET, CDF53 or CDF97.
+//
+//    Output, double LIFT[4], the coefficient of each step.
+//
+//    Output, double &SCALE, the scale of the low-pass band.
+//
+//    Output, int WAVELET_LIFTING, the number of steps.
+//
+{
+	if (wavelet == Wavelet::CDF97)
+	{
+		lift[0] = -1.586134342059924;
+		lift[1] = -0.052980118572961;
+		lift[2] = 0.882911075530934;
+		lift[3] = 0.443506852043971;
+		scale = 1.149604398860241;
+		return 4;
+	}
+	lift[0] = -0.5;
+	lift[1] = 0.25;
+	scale = sqrt(2.0);
+	return 2;
+}
+//****************************************************************************80
+
+template <typename T>
+static void wavelet_step(int k, T x[], int incx, T w[], Wavelet wavelet)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    WAVELET_STEP does one level of a CDF wavelet transform on 2*K entries.
+//
+//  Discussion:
+//
+//    The entries are copied to W, lifted in place there, and written back
+//    with the low-pass band in the first K entries and the high-pass band
+//    in the next K, the layout HAAR_1D uses.  The signal is extended
+//    symmetrically about its first and last samples, so a step on two
+//    entries is a Haar step.
+//
+//  Parameters:
+//
+//    Input, int K, half the number of entries.
+//
+//    Input/output, T X[2*K*INCX], the entries, INCX apart.
+//
+//    Input, int INCX, the distance between entries.
+//
+//    Workspace, T W[2*K].
+//
+//    Input, Wavelet WAVELET, CDF53 or CDF97.
+//
+{
+	int i;
+	int s;
+	int steps;
+	double lift[4];
+	double scale;
+	T a;
+
+	steps = wavelet_lifting(wavelet, lift, scale);
+
+	for (i = 0; i < 2 * k; i++)
+	{
+		w[i] = x[i * incx];
+	}
+	for (s = 0; s < steps; s++)
+	{
+		a = T(lift[s]);
+		if (s % 2 == 0)
+		{
+			for (i = 0; i < k; i++)
+			{
+				w[2 * i + 1] = w[2 * i + 1] + a * (w[2 * i] + w[i + 1 < k ? 2 * i + 2 : 2 * i]);
+			}
+		}
+		else
+		{
+			for (i = 0; i < k; i++)
+			{
+				w[2 * i] = w[2 * i] + a * (w[0 < i ? 2 * i - 1 : 2 * i + 1] + w[2 * i + 1]);
+			}
+		}
+	}
+	for (i = 0; i < k; i++)
+	{
+		x[i * incx] = w[2 * i] * T(scale);
+		x[(k + i) * incx] = w[2 * i + 1] * T(-1.0 / scale);
+	}
+
+	return;
+}
+//****************************************************************************80
+
+template <typename T>
+static void wavelet_step_inverse(int k, T x[], int incx, T w[], Wavelet wavelet)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    WAVELET_STEP_INVERSE undoes WAVELET_STEP.
+//
+//  Parameters:
+//
+//    Input, int K, half the number of entries.
+//
+//    Input/output, T X[2*K*INCX], the entries, INCX apart.
+//
+//    Input, int INCX, the distance between entries.
+//
+//    Workspace, T W[2*K].
+//
+//    Input, Wavelet WAVELET, CDF53 or CDF97.
+//
+{
+	int i;
+	int s;
+	int steps;
+	double lift[4];
+	double scale;
+	T a;
+
+	steps = wavelet_lifting(wavelet, lift, scale);
+
+	for (i = 0; i < k; i++)
+	{
+		w[2 * i] = x[i * incx] / T(scale);
+		w[2 * i + 1] = x[(k + i) * incx] / T(-1.0 / scale);
+	}
+	for (s = steps - 1; 0 <= s; s--)
+	{
+		a = T(lift[s]);
+		if (s % 2 == 0)
+		{
+			for (i = 0; i < k; i++)
+			{
+				w[2 * i + 1] = w[2 * i + 1] - a * (w[2 * i] + w[i + 1 < k ? 2 * i + 2 : 2 * i]);
+			}
+		}
+		else
+		{
+			for (i = 0; i < k; i++)
+			{
+				w[2 * i] = w[2 * i] - a * (w[0 < i ? 2 * i - 1 : 2 * i + 1] + w[2 * i + 1]);
+			}
+		}
+	}
+	for (i = 0; i < 2 * k; i++)
+	{
+		x[i * incx] = w[i];
+	}
+
+	return;
+}
+//****************************************************************************80
+
+template <typename T>
+static void wavelet_step_dual(int k, T x[], int incx, T w[], Wavelet wavelet)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    WAVELET_STEP_DUAL does one level of the dual of a CDF wavelet transform.
+//
+//  Discussion:
+//
+//    WAVELET_STEP is the product of a lifting matrix per step and a
+//    scaling; this applies the inverse transpose of each, in the same order.
+//    The transpose of a prediction updates the even samples from their odd
+//    neighbors and the other way round, and the symmetric extension turns
+//    into an extra term at the other end of the signal.  For any X and Y,
+//    the dot product of the dual step of X with the step of Y is the dot
+//    product of X with Y, as it would be for an orthonormal step, which the
+//    CDF steps are not.
+//
+//  Parameters:
+//
+//    Input, int K, half the number of entries.
+//
+//    Input/output, T X[2*K*INCX], the entries, INCX apart.
+//
+//    Input, int INCX, the distance between entries.
+//
+//    Workspace, T W[2*K].
+//
+//    Input, Wavelet WAVELET, CDF53 or CDF97.
+//
+{
+	int i;
+	int s;
+	int steps;
+	double lift[4];
+	double scale;
+	T a;
+
+	steps = wavelet_lifting(wavelet, lift, scale);
+
+	for (i = 0; i < 2 * k; i++)
+	{
+		w[i] = x[i * incx];
+	}
+	for (s = 0; s < steps; s++)
+	{
+		a = T(lift[s]);
+		if (s % 2 == 0)
+		{
+			for (i = 0; i < k; i++)
+			{
+				w[2 * i] = w[2 * i] - a * (w[2 * i + 1] + (0 < i ? w[2 * i - 1] : T(0)) + (i + 1 < k ? T(0) : w[2 * i + 1]));
+			}
+		}
+		else
+		{
+			for (i = 0; i < k; i++)
+			{
+				w[2 * i + 1] = w[2 * i + 1] - a * (w[2 * i] + (i + 1 < k ? w[2 * i + 2] : T(0)) + (0 < i ? T(0) : w[0]));
+			}
+		}
+	}
+	for (i = 0; i < k; i++)
+	{
+		x[i * incx] = w[2 * i] / T(scale);
+		x[(k + i) * incx] = w[2 * i + 1] * T(-scale);
+	}
+
+	return;
+}
+//****************************************************************************80
+
+template <typename T>
+static void wavelet_2d_levels(int m, int n, T u[], T w[], Wavelet wavelet, HaarMode mode, bool dual)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    WAVELET_2D_LEVELS does the CDF steps of WAVELET_2D or WAVELET_2D_DUAL.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[WAVELET_2D_WORK_SIZE(M,N)].
+//
+//    Input, Wavelet WAVELET, CDF53 or CDF97.
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+//    Input, bool DUAL, whether to do the dual steps.
+//
+{
+	int i;
+	int j;
+	int k;
+	int km;
+	int kn;
+	int rows;
+	void (*step)(int, T[], int, T[], Wavelet);
+
+	step = dual ? wavelet_step_dual<T> : wavelet_step<T>;
+
+	km = 1;
+	while (km * 2 <= m)
+	{
+		km = km * 2;
+	}
+	kn = 1;
+	while (kn * 2 <= n)
+	{
+		kn = kn * 2;
+	}
+
+	if (mode == HaarMode::NONSTANDARD)
+	{
+		//
+		//  The current low-pass block is KM by KN.
+		//
+		while (1 < km || 1 < kn)
+		{
+			rows = km;
+			if (1 < km)
+			{
+				km = km / 2;
+				for (j = 0; j < kn; j++)
+				{
+					step(km, u + j * m, 1, w, wavelet);
+				}
+			}
+			if (1 < kn)
+			{
+				kn = kn / 2;
+				for (i = 0; i < rows; i++)
+				{
+					step(kn, u + i, m, w, wavelet);
+				}
+			}
+		}
+		return;
+	}
+	//
+	//  Transform all columns, then all rows.
+	//
+	for (j = 0; j < n; j++)
+	{
+		for (k = km / 2; 1 <= k; k = k / 2)
+		{
+			step(k, u + j * m, 1, w, wavelet);
+		}
+	}
+	for (i = 0; i < m; i++)
+	{
+		for (k = kn / 2; 1 <= k; k = k / 2)
+		{
+			step(k, u + i, m, w, wavelet);
+		}
+	}
+
+	return;
+}
+//****************************************************************************80
+
+template <typename T>
+void wavelet_2d(int m, int n, T u[], T w[], Wavelet wavelet, HaarMode mode)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    WAVELET_2D computes the wavelet transform of an array.
+//
+//  Discussion:
+//
+//    The coefficients are laid out as HAAR_2D lays them out in the same
+//    decomposition, and Wavelet::HAAR calls it.  The CDF 5/3 and 9/7
+//    wavelets are smoother, so they need fewer coefficients for smooth
+//    data such as the diffuse profile kernels.  They are biorthogonal
+//    rather than orthonormal, so the dot product of two transforms is not
+//    that of the arrays; WAVELET_2D_DUAL transforms the other operand.
+//
+//    As in HAAR_2D, rows and columns past the largest power of 2 are left
+//    alone.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[WAVELET_2D_WORK_SIZE(M,N)].
+//
+//    Input, Wavelet WAVELET, the wavelet.
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+{
+	if (wavelet == Wavelet::HAAR)
+	{
+		haar_2d(m, n, u, w, mode);
+		return;
+	}
+
+	wavelet_2d_levels(m, n, u, w, wavelet, mode, false);
+
+	return;
+}
+template void wavelet_2d<float>(int m, int n, float u[], float w[], Wavelet wavelet, HaarMode mode);
+template void wavelet_2d<double>(int m, int n, double u[], double w[], Wavelet wavelet, HaarMode mode);
+//****************************************************************************80
+
+template <typename T>
+void wavelet_2d_dual(int m, int n, T u[], T w[], Wavelet wavelet, HaarMode mode)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    WAVELET_2D_DUAL computes the dual wavelet transform of an array.
+//
+//  Discussion:
+//
+//    The dual transform is the inverse transpose of WAVELET_2D, so the dot
+//    product of the dual transform of U with the transform of V is the dot
+//    product of U with V.  The renderer transforms the radiance with
+//    WAVELET_2D, so the kernels are baked with this, and the dot product of
+//    their coefficients is the convolution.  For Wavelet::HAAR, which is
+//    orthonormal, it is WAVELET_2D.
+//
+//    The coefficients are laid out as WAVELET_2D lays them out.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[WAVELET_2D_WORK_SIZE(M,N)].
+//
+//    Input, Wavelet WAVELET, the wavelet.
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+{
+	if (wavelet == Wavelet::HAAR)
+	{
+		haar_2d(m, n, u, w, mode);
+		return;
+	}
+
+	wavelet_2d_levels(m, n, u, w, wavelet, mode, true);
+
+	return;
+}
+template void wavelet_2d_dual<float>(int m, int n, float u[], float w[], Wavelet wavelet, HaarMode mode);
+template void wavelet_2d_dual<double>(int m, int n, double u[], double w[], Wavelet wavelet, HaarMode mode);
+//****************************************************************************80
+
+template <typename T>
+void wavelet_2d_inverse(int m, int n, T u[], T w[], Wavelet wavelet, HaarMode mode)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    WAVELET_2D_INVERSE inverts the wavelet transform of an array.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[WAVELET_2D_WORK_SIZE(M,N)].
+//
+//    Input, Wavelet WAVELET, the wavelet.
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+{
+	int i;
+	int j;
+	int k;
+	int km;
+	int kn;
+	int l;
+	int l_m;
+	int l_n;
+	int rows;
+	int cols;
+
+	if (wavelet == Wavelet::HAAR)
+	{
+		haar_2d_inverse(m, n, u, w, mode);
+		return;
+	}
+
+	km = 1;
+	l_m = 0;
+	while (km * 2 <= m)
+	{
+		km = km * 2;
+		l_m = l_m + 1;
+	}
+	kn = 1;
+	l_n = 0;
+	while (kn * 2 <= n)
+	{
+		kn = kn * 2;
+		l_n = l_n + 1;
+	}
+
+	if (mode == HaarMode::NONSTANDARD)
+	{
+		//
+		//  Undo level L, which stepped the columns of a ROWS by COLS block
+		//  and then its rows.
+		//
+		for (l = i4_max(l_m, l_n) - 1; 0 <= l; l--)
+		{
+			rows = km >> i4_min(l, l_m);
+			cols = kn >> i4_min(l, l_n);
+			if (l < l_n)
+			{
+				for (i = 0; i < rows; i++)
+				{
+					wavelet_step_inverse(cols / 2, u + i, m, w, wavelet);
+				}
+			}
+			if (l < l_m)
+			{
+				for (j = 0; j < cols; j++)
+				{
+					wavelet_step_inverse(rows / 2, u + j * m, 1, w, wavelet);
+				}
+			}
+		}
+		return;
 	}
 	//
-	//  Inverse transform of all columns.
-	//
-	k = 1;
+	//  Inverse transform of all rows, then all columns.
+	//
+	for (i = 0; i < m; i++)
+	{
+		for (k = 1; k < kn; k = k * 2)
+		{
+			wavelet_step_inverse(k, u + i, m, w, wavelet);
+		}
+	}
+	for (j = 0; j < n; j++)
+	{
+		for (k = 1; k < km; k = k * 2)
+		{
+			wavelet_step_inverse(k, u + j * m, 1, w, wavelet);
+		}
+	}
+
+	return;
+}
+template void wavelet_2d_inverse<float>(int m, int n, float u[], float w[], Wavelet wavelet, HaarMode mode);
+template void wavelet_2d_inverse<double>(int m, int n, double u[], double w[], Wavelet wavelet, HaarMode mode);
+//****************************************************************************80
+
+template <typename T>
+static int haar_1d_sparse(int k, int lo, int hi, T x[], int index[], T value[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_1D_SPARSE computes the Haar coefficients of a vector that is zero
+//    outside a range.
+//
+//  Discussion:
+//
+//    The vector has K entries, K a power of 2, of which only those in
+//    [LO,HI) may be nonzero.  A Haar coefficient only depends on the
+//    entries under its support, so each level only forms the pairs that
+//    overlap the range, and the range shrinks by half per level.  The
+//    coefficients are returned where HAAR_1D puts them; every other
+//    coefficient is zero.
+//
+//  Parameters:
+//
+//    Input, int K, the length of the vector, a power of 2.
+//
+//    Input, int LO, HI, the range, with 0 <= LO < HI <= K.
+//
+//    Input/output, T X[HI-LO], on input the entries in the range.  It is
+//    used as workspace.
+//
+//    Output, int INDEX[], T VALUE[], the positions and values of the
+//    coefficients, at most HI - LO + 2 * log2(K) + 1 of them.
+//
+//    Output, int HAAR_1D_SPARSE, the number of coefficients.
+//
+{
+	int count;
+	int p;
+	int plo;
+	int phi;
+	T a;
+	T b;
+	T s;
 
-	while (k * 2 <= m)
+	s = sqrt(T(2));
+	count = 0;
+
+	while (1 < k)
 	{
-		for (j = 0; j < n; j++)
+		k = k / 2;
+		plo = lo / 2;
+		phi = (hi - 1) / 2 + 1;
+		for (p = plo; p < phi; p++)
 		{
-			for (i = 0; i < k; i++)
+			a = lo <= 2 * p ? x[2 * p - lo] : T(0);
+			b = 2 * p + 1 < hi ? x[2 * p + 1 - lo] : T(0);
+			x[p - plo] = (a + b) / s;
+			index[count] = k + p;
+			value[count] = (a - b) / s;
+			count = count + 1;
+		}
+		lo = plo;
+		hi = phi;
+	}
+	index[count] = 0;
+	value[count] = x[0];
+	count = count + 1;
+
+	return count;
+}
+//****************************************************************************80
+
+template <typename T>
+static void haar_2d_update_block(int m, T c[], int i0, int j0, int rows, int cols, const T d[], int ldd)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_UPDATE_BLOCK adds a block to a block of coefficients.
+//
+//  Parameters:
+//
+//    Input, int M, the first dimension of C.
+//
+//    Input/output, T C[], the coefficients.
+//
+//    Input, int I0, J0, the position of the block in C.
+//
+//    Input, int ROWS, COLS, the dimensions of the block.
+//
+//    Input, const T D[LDD*COLS], the block, its columns LDD entries apart.
+//
+//    Input, int LDD, the distance between columns of D.
+//
+{
+	int i;
+	int j;
+
+	for (j = 0; j < cols; j++)
+	{
+		for (i = 0; i < rows; i++)
+		{
+			c[i0 + i + (j0 + j) * m] = c[i0 + i + (j0 + j) * m] + d[i + j * ldd];
+		}
+	}
+
+	return;
+}
+//****************************************************************************80
+
+template <typename T>
+static void haar_2d_update_standard(int m, int n, T c[], int i0, int j0, int rows, int cols, const T d[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_UPDATE_STANDARD adds the standard Haar transform of a block to
+//    the coefficients.
+//
+//  Discussion:
+//
+//    The array is zero outside the block.  The column pass runs
+//    HAAR_1D_SPARSE down each column of the block; every column has the
+//    same range, so they all produce the same list of rows.  The row pass
+//    then runs it along each of those rows.  Rows and columns past the
+//    largest power of 2 are carried through unchanged, as in HAAR_2D.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T C[M*N], the coefficients.
+//
+//    Input, int I0, J0, ROWS, COLS, the position and dimensions of the
+//    block, which lies within the array.
+//
+//    Input, const T D[ROWS*COLS], the block.
+//
+{
+	int i;
+	int j;
+	int km;
+	int kn;
+	int ie;
+	int je;
+	int levels;
+	int q;
+	int r;
+	int count;
+	int nr;
+
+	km = 1;
+	levels = 0;
+	while (km * 2 <= m)
+	{
+		km = km * 2;
+		levels = levels + 1;
+	}
+	kn = 1;
+	while (kn * 2 <= n)
+	{
+		kn = kn * 2;
+		levels = levels + 1;
+	}
+	ie = i4_min(i0 + rows, km);
+	je = i4_min(j0 + cols, kn);
+	//
+	//  Column pass: row R of E, at row ROW_INDEX[R] of the coefficients,
+	//  holds the block's contribution along the columns of the block.
+	//
+	vector<int> row_index(rows + 2 * levels + 1);
+	vector<int> index(i4_max(rows, cols) + 2 * levels + 1);
+	vector<T> value(i4_max(rows, cols) + 2 * levels + 1);
+	vector<T> x(i4_max(rows, cols));
+	vector<T> e((size_t)(rows + 2 * levels + 1) * cols);
+
+	nr = 0;
+	for (j = 0; j < cols; j++)
+	{
+		nr = 0;
+		if (i0 < ie)
+		{
+			for (i = i0; i < ie; i++)
+			{
+				x[i - i0] = d[i - i0 + j * rows];
+			}
+			count = haar_1d_sparse(km, i0, ie, x.data(), index.data(), value.data());
+			for (q = 0; q < count; q++)
+			{
+				row_index[nr] = index[q];
+				e[nr + (size_t)j * (rows + 2 * levels + 1)] = value[q];
+				nr = nr + 1;
+			}
+		}
+		for (i = i4_max(i0, km); i < i0 + rows; i++)
+		{
+			row_index[nr] = i;
+			e[nr + (size_t)j * (rows + 2 * levels + 1)] = d[i - i0 + j * rows];
+			nr = nr + 1;
+		}
+	}
+	//
+	//  Row pass.
+	//
+	for (r = 0; r < nr; r++)
+	{
+		const T *row = e.data() + r;
+		i = row_index[r];
+		if (j0 < je)
+		{
+			for (j = j0; j < je; j++)
+			{
+				x[j - j0] = row[(size_t)(j - j0) * (rows + 2 * levels + 1)];
+			}
+			count = haar_1d_sparse(kn, j0, je, x.data(), index.data(), value.data());
+			for (q = 0; q < count; q++)
+			{
+				c[i + index[q] * m] = c[i + index[q] * m] + value[q];
+			}
+		}
+		for (j = i4_max(j0, kn); j < j0 + cols; j++)
+		{
+			c[i + j * m] = c[i + j * m] + row[(size_t)(j - j0) * (rows + 2 * levels + 1)];
+		}
+	}
+
+	return;
+}
+//****************************************************************************80
+
+template <typename T>
+static void haar_2d_update_nonstandard(int m, int n, T c[], int i0, int j0, int rows, int cols, const T d[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_UPDATE_NONSTANDARD adds the nonstandard Haar transform of a
+//    block to the coefficients.
+//
+//  Discussion:
+//
+//    The array is zero outside the block.  Each level of the pyramid steps
+//    the columns and then the rows of the part of the low-pass block the
+//    block reaches, which halves in both directions per level.  The three
+//    detail bands of the level are added to the coefficients and the
+//    low-pass band goes on to the next level.  Entries past the largest
+//    power of 2 in either direction are added unchanged, as in
+//    HAAR_2D_NONSTANDARD.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T C[M*N], the coefficients.
+//
+//    Input, int I0, J0, ROWS, COLS, the position and dimensions of the
+//    block, which lies within the array.
+//
+//    Input, const T D[ROWS*COLS], the block.
+//
+{
+	int a0;
+	int a1;
+	int b0;
+	int b1;
+	int band;
+	int bands;
+	int i;
+	int j;
+	int km;
+	int kn;
+	int nr;
+	int nc;
+	int pa0;
+	int pa1;
+	int qb0;
+	int qb1;
+	T a;
+	T b;
+	T s;
+
+	s = sqrt(T(2));
+
+	km = 1;
+	while (km * 2 <= m)
+	{
+		km = km * 2;
+	}
+	kn = 1;
+	while (kn * 2 <= n)
+	{
+		kn = kn * 2;
+	}
+	//
+	//  The parts past KM or KN are not transformed.
+	//
+	if (km < i0 + rows)
+	{
+		i = i4_max(i0, km);
+		haar_2d_update_block(m, c, i, j0, i0 + rows - i, cols, d + (i - i0), rows);
+	}
+	if (kn < j0 + cols)
+	{
+		j = i4_max(j0, kn);
+		haar_2d_update_block(m, c, i0, j, i4_min(i0 + rows, km) - i0, j0 + cols - j, d + (j - j0) * rows, rows);
+	}
+	a0 = i0;
+	a1 = i4_min(i0 + rows, km);
+	b0 = j0;
+	b1 = i4_min(j0 + cols, kn);
+	if (a1 <= a0 || b1 <= b0)
+	{
+		return;
+	}
+	//
+	//  X holds the low-pass part [A0,A1) x [B0,B1), Y the one or two row
+	//  bands after the column step, and Z a band after the row step.
+	//
+	vector<T> x((size_t)(a1 - a0) * (b1 - b0));
+	vector<T> y(2 * x.size() + 2);
+	vector<T> z(2 * x.size() + 2);
+	for (j = b0; j < b1; j++)
+	{
+		for (i = a0; i < a1; i++)
+		{
+			x[i - a0 + (size_t)(j - b0) * (a1 - a0)] = d[i - i0 + (j - j0) * rows];
+		}
+	}
+
+	while (1 < km || 1 < kn)
+	{
+		nr = a1 - a0;
+		nc = b1 - b0;
+		//
+		//  Column step: band 0 is the low-pass rows [PA0,PA1), band 1 the
+		//  high-pass rows KM + [PA0,PA1).
+		//
+		if (1 < km)
+		{
+			km = km / 2;
+			pa0 = a0 / 2;
+			pa1 = (a1 - 1) / 2 + 1;
+			bands = 2;
+			for (j = 0; j < nc; j++)
 			{
-				v[2 * i + j * m] = (u[i + j * m] + u[k + i + j * m]) / s;
-				v[2 * i + 1 + j * m] = (u[i + j * m] - u[k + i + j * m]) / s;
+				for (i = pa0; i < pa1; i++)
+				{
+					a = a0 <= 2 * i ? x[2 * i - a0 + (size_t)j * nr] : T(0);
+					b = 2 * i + 1 < a1 ? x[2 * i + 1 - a0 + (size_t)j * nr] : T(0);
+					y[i - pa0 + (size_t)j * (pa1 - pa0)] = (a + b) / s;
+					y[i - pa0 + (size_t)j * (pa1 - pa0) + (size_t)(pa1 - pa0) * nc] = (a - b) / s;
+				}
 			}
 		}
+		else
+		{
+			pa0 = a0;
+			pa1 = a1;
+			bands = 1;
+			copy(x.begin(), x.begin() + (size_t)nr * nc, y.begin());
+		}
+		//
+		//  Row step on each band.  Everything but the low-pass columns of
+		//  band 0 is final.
+		//
+		if (1 < kn)
+		{
+			kn = kn / 2;
+			qb0 = b0 / 2;
+			qb1 = (b1 - 1) / 2 + 1;
+			for (band = 0; band < bands; band++)
+			{
+				const T *yb = y.data() + (size_t)band * (pa1 - pa0) * nc;
+				for (j = qb0; j < qb1; j++)
+				{
+					for (i = 0; i < pa1 - pa0; i++)
+					{
+						a = b0 <= 2 * j ? yb[i + (size_t)(2 * j - b0) * (pa1 - pa0)] : T(0);
+						b = 2 * j + 1 < b1 ? yb[i + (size_t)(2 * j + 1 - b0) * (pa1 - pa0)] : T(0);
+						z[i + (size_t)(j - qb0) * (pa1 - pa0)] = (a + b) / s;
+						z[i + (size_t)(j - qb0 + qb1 - qb0) * (pa1 - pa0)] = (a - b) / s;
+					}
+				}
+				haar_2d_update_block(m, c, band * km + pa0, kn + qb0, pa1 - pa0, qb1 - qb0,
+					z.data() + (size_t)(qb1 - qb0) * (pa1 - pa0), pa1 - pa0);
+				if (band == 1)
+				{
+					haar_2d_update_block(m, c, km + pa0, qb0, pa1 - pa0, qb1 - qb0, z.data(), pa1 - pa0);
+				}
+				else
+				{
+					copy(z.begin(), z.begin() + (size_t)(qb1 - qb0) * (pa1 - pa0), x.begin());
+				}
+			}
+		}
+		else
+		{
+			qb0 = b0;
+			qb1 = b1;
+			if (bands == 2)
+			{
+				haar_2d_update_block(m, c, km + pa0, qb0, pa1 - pa0, qb1 - qb0,
+					y.data() + (size_t)(pa1 - pa0) * nc, pa1 - pa0);
+			}
+			copy(y.begin(), y.begin() + (size_t)(pa1 - pa0) * nc, x.begin());
+		}
+		a0 = pa0;
+		a1 = pa1;
+		b0 = qb0;
+		b1 = qb1;
+	}
+	c[0] = c[0] + x[0];
+
+	return;
+}
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_update(int m, int n, T u[], T c[], const T v[], int count, const int rects[], HaarMode mode)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_UPDATE patches the Haar transform of an array after parts of
+//    it have changed.
+//
+//  Discussion:
+//
+//    C is the transform of U in the given decomposition, and V differs from
+//    U only inside COUNT rectangles.  The transform is linear, so adding
+//    the transform of V - U brings C up to date, and since the Haar basis
+//    functions have compact support, the transform of a difference confined
+//    to a rectangle of R by S entries only has about (R + 2 log2 M) by
+//    (S + 2 log2 N) nonzero coefficients in the standard decomposition and
+//    fewer in the nonstandard one.  Only those are formed and added.
+//
+//    U is brought up to V rectangle by rectangle, so rectangles may overlap.
+//    The result matches transforming V from scratch up to rounding, which
+//    builds up over many updates; an occasional full transform resets it.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the arrays.
+//
+//    Input/output, T U[M*N], the array C is the transform of.  On output it
+//    equals V inside the rectangles.
+//
+//    Input/output, T C[M*N], the coefficients.
+//
+//    Input, const T V[M*N], the changed array.
+//
+//    Input, int COUNT, the number of rectangles.
+//
+//    Input, const int RECTS[4*COUNT], the first row, first column, number
+//    of rows and number of columns of each rectangle.  Rectangles are
+//    clipped to the array.
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+{
+	int i;
+	int i0;
+	int i1;
+	int j;
+	int j0;
+	int j1;
+	int r;
+	vector<T> d;
 
-		for (j = 0; j < n; j++)
+	for (r = 0; r < count; r++)
+	{
+		i0 = i4_max(rects[4 * r], 0);
+		j0 = i4_max(rects[4 * r + 1], 0);
+		i1 = i4_min(rects[4 * r] + rects[4 * r + 2], m);
+		j1 = i4_min(rects[4 * r + 1] + rects[4 * r + 3], n);
+		if (i1 <= i0 || j1 <= j0)
+		{
+			continue;
+		}
+		d.resize((size_t)(i1 - i0) * (j1 - j0));
+		for (j = j0; j < j1; j++)
 		{
-			for (i = 0; i < 2 * k; i++)
+			for (i = i0; i < i1; i++)
 			{
+				d[i - i0 + (size_t)(j - j0) * (i1 - i0)] = v[i + j * m] - u[i + j * m];
 				u[i + j * m] = v[i + j * m];
 			}
 		}
-		k = k * 2;
+		if (mode == HaarMode::NONSTANDARD)
+		{
+			haar_2d_update_nonstandard(m, n, c, i0, j0, i1 - i0, j1 - j0, d.data());
+		}
+		else
+		{
+			haar_2d_update_standard(m, n, c, i0, j0, i1 - i0, j1 - j0, d.data());
+		}
 	}
-	delete[] v;
 
 	return;
 }
+template void haar_2d_update<float>(int m, int n, float u[], float c[], const float v[], int count, const int rects[],
+	HaarMode mode);
+template void haar_2d_update<double>(int m, int n, double u[], double c[], const double v[], int count,
+	const int rects[], HaarMode mode);
 //****************************************************************************80
 
 int i4_max(int i1, int i2)
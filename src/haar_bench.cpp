@@ -0,0 +1,991 @@
+#include <algorithm>
+#include <chrono>
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "cpu_features.hpp"
+#include "haar.hpp"
+#include "mapped_file.hpp"
+#include "sstx.hpp"
+#include "thread_pool.hpp"
+
+// Benchmark for the 2D Haar transforms.
+// --------------------------------
+// Times the scalar Burkardt routine against the vectorized kernels on square
+// arrays and prints the speedup and the round-trip error.
+//
+// usage: haar-bench [size ...]
+//        haar-bench --json file
+//
+// Sizes must be at least 32, the largest coefficient block benchmarked.
+// --json runs every transform on sizes from 16 to 8192 and writes the times,
+// throughput and round-trip errors to file, for tracking regressions.
+
+// Best of REPEATS runs of F, each preceded by an untimed call to SETUP.
+template <typename S, typename F>
+double timeMs(S setup, F f, int repeats)
+{
+	double best = 1e300;
+	for (int r = 0; r < repeats; r++)
+	{
+		setup();
+		auto start = chrono::steady_clock::now();
+		f();
+		auto end = chrono::steady_clock::now();
+		best = fmin(best, chrono::duration<double, milli>(end - start).count());
+	}
+	return best;
+}
+
+void benchSize(int size, ThreadPool &pool)
+{
+	int m = size;
+	int n = size;
+	int seed = 123456789;
+	int repeats = size <= 1024 ? 10 : 3;
+	double *u = r8mat_uniform_01_new(m, n, seed);
+	double *v = r8mat_copy_new(m, n, u);
+	double *w = new double[haar_2d_work_size(m, n)];
+
+	memcpy(v, u, (size_t)m * n * sizeof(double));
+	haar_2d(m, n, v);
+	double *c = r8mat_copy_new(m, n, v);
+
+	auto reset_data = [&]() { memcpy(v, u, (size_t)m * n * sizeof(double)); };
+	auto reset_coef = [&]() { memcpy(v, c, (size_t)m * n * sizeof(double)); };
+	double t_ref = timeMs(reset_data, [&]() { haar_2d(m, n, v); }, repeats);
+	double t_ref_inv = timeMs(reset_coef, [&]() { haar_2d_inverse(m, n, v); }, repeats);
+
+	cout << "\n";
+	cout << "  " << m << " x " << n << "\n";
+	cout << "    burkardt     forward " << t_ref << " ms, inverse " << t_ref_inv << " ms\n";
+
+	int panel = haar_2d_panel_rows(m, n, sizeof(double));
+	double *wb = new double[haar_2d_blocked_work_size(m, n, panel)];
+	double t_blk = timeMs(reset_data, [&]() { haar_2d_blocked(m, n, v, wb, panel); }, repeats);
+	bool same = memcmp(v, c, (size_t)m * n * sizeof(double)) == 0;
+	double t_blk_inv = timeMs(reset_coef, [&]() { haar_2d_inverse_blocked(m, n, v, wb, panel); }, repeats);
+	cout << "    blocked      forward " << t_blk << " ms (x" << t_ref / t_blk << "), inverse " << t_blk_inv
+		 << " ms (x" << t_ref_inv / t_blk_inv << "), panel " << panel << " rows, "
+		 << (same ? "bit-identical" : "MISMATCH") << "\n";
+	delete[] wb;
+
+	double t_par = timeMs(reset_data, [&]() { haar_2d_parallel(m, n, v, pool); }, repeats);
+	same = memcmp(v, c, (size_t)m * n * sizeof(double)) == 0;
+	double t_par_inv = timeMs(reset_coef, [&]() { haar_2d_inverse_parallel(m, n, v, pool); }, repeats);
+	string threads = to_string(pool.size()) + " threads";
+	cout << "    " << threads << string(13 - threads.size(), ' ') << "forward " << t_par
+		 << " ms (x" << t_ref / t_par << "), inverse " << t_par_inv << " ms (x" << t_ref_inv / t_par_inv << "), "
+		 << (same ? "bit-identical" : "MISMATCH") << "\n";
+
+	int cm = 16;
+	int cn = 16;
+	double *block = new double[cm * cn];
+	double *wl = new double[haar_2d_lowpass_work_size(m, n, cm, cn)];
+	double t_low = timeMs([]() {}, [&]() { haar_2d_lowpass(m, n, u, cm, cn, block, wl); }, repeats);
+	same = true;
+	for (int j = 0; j < cn; j++)
+		same = same && memcmp(block + j * cm, c + (size_t)j * m, cm * sizeof(double)) == 0;
+	cout << "    lowpass " << cm << "x" << cn << " forward " << t_low << " ms (x" << t_ref / t_low << "), "
+		 << (same ? "bit-identical" : "MISMATCH") << "\n";
+	delete[] block;
+	delete[] wl;
+
+	double t_ns = timeMs(reset_data, [&]() { haar_2d(m, n, v, w, HaarMode::NONSTANDARD); }, repeats);
+	double t_ns_inv = timeMs(reset_data, [&]() { haar_2d_inverse(m, n, v, w, HaarMode::NONSTANDARD); }, repeats);
+	memcpy(v, u, (size_t)m * n * sizeof(double));
+	haar_2d(m, n, v, w, HaarMode::NONSTANDARD);
+	haar_2d_inverse(m, n, v, w, HaarMode::NONSTANDARD);
+	cout << "    nonstandard  forward " << t_ns << " ms (x" << t_ref / t_ns << "), inverse " << t_ns_inv << " ms (x"
+		 << t_ref_inv / t_ns_inv << "), round trip = " << r8mat_dif_fro(m, n, v, u) << "\n";
+
+	SimdLevel levels[3] = {SimdLevel::SCALAR, SimdLevel::AVX2, SimdLevel::AVX512};
+	for (SimdLevel level : levels)
+	{
+		simd_set_level(level);
+		if (simd_level() != level)
+			continue;
+		double t_fwd = timeMs(reset_data, [&]() { haar_2d_simd(m, n, v, w); }, repeats);
+		double t_inv = timeMs(reset_coef, [&]() { haar_2d_inverse_simd(m, n, v, w); }, repeats);
+
+		memcpy(v, u, (size_t)m * n * sizeof(double));
+		haar_2d_simd(m, n, v, w);
+		double coef_err = r8mat_dif_fro(m, n, v, c);
+		haar_2d_inverse_simd(m, n, v, w);
+		double trip_err = r8mat_dif_fro(m, n, v, u);
+
+		cout << "    " << simd_level_name(level) << string(13 - strlen(simd_level_name(level)), ' ')
+			 << "forward " << t_fwd << " ms (x" << t_ref / t_fwd << "), inverse " << t_inv
+			 << " ms (x" << t_ref_inv / t_inv << "), |c - c_ref| = " << coef_err
+			 << ", round trip = " << trip_err << "\n";
+	}
+	simd_set_level(SimdLevel::AVX512);
+
+	delete[] u;
+	delete[] v;
+	delete[] w;
+	delete[] c;
+}
+
+// Interleaved RGBA float transform against splitting into four planes,
+// transforming each and interleaving the result again.
+void benchRgba(int size)
+{
+	int m = size;
+	int n = size;
+	int seed = 123456789;
+	int repeats = size <= 1024 ? 10 : 3;
+	size_t count = (size_t)4 * m * n;
+	double *r = r8mat_uniform_01_new(4 * m, n, seed);
+	float *u = new float[count];
+	float *v = new float[count];
+	float *c = new float[count];
+	float *plane = new float[(size_t)m * n];
+	float *w = new float[haar_2d_interleaved_work_size(m, n, 4)];
+	for (size_t i = 0; i < count; i++)
+		u[i] = (float)r[i];
+
+	auto planar = [&]() {
+		for (int k = 0; k < 4; k++)
+		{
+			for (size_t i = 0; i < (size_t)m * n; i++)
+				plane[i] = v[k + 4 * i];
+			haar_2d(m, n, plane, w);
+			for (size_t i = 0; i < (size_t)m * n; i++)
+				v[k + 4 * i] = plane[i];
+		}
+	};
+	auto reset_data = [&]() { memcpy(v, u, count * sizeof(float)); };
+	double t_planar = timeMs(reset_data, planar, repeats);
+	memcpy(c, v, count * sizeof(float));
+	double t_rgba = timeMs(reset_data, [&]() { haar_2d_interleaved(m, n, 4, v, w); }, repeats);
+	bool same = memcmp(v, c, count * sizeof(float)) == 0;
+	haar_2d_inverse_interleaved(m, n, 4, v, w);
+	double trip_err = 0.0;
+	for (size_t i = 0; i < count; i++)
+		trip_err = fmax(trip_err, fabs((double)v[i] - (double)u[i]));
+
+	cout << "    rgba float   forward " << t_rgba << " ms, 4 planes " << t_planar << " ms (x"
+		 << t_planar / t_rgba << "), " << (same ? "bit-identical" : "MISMATCH") << ", max round trip error "
+		 << trip_err << "\n";
+
+	delete[] r;
+	delete[] u;
+	delete[] v;
+	delete[] c;
+	delete[] plane;
+	delete[] w;
+}
+
+// Diffuse profile kernel sampled on an M x N grid of texels 0.02 mm apart,
+// centered off the middle.
+void profileKernel(int m, int n, double u[])
+{
+	for (int j = 0; j < n; j++)
+	{
+		for (int i = 0; i < m; i++)
+		{
+			double r = 0.02 * hypot(i - 0.4 * m, j - 0.6 * n);
+			double s = 4.031441;
+			u[i + (size_t)j * m] = s * (exp(-s * r) + exp(-s * r / 3)) / (8 * M_PI);
+		}
+	}
+}
+
+// Error of keeping K coefficients of a diffuse profile kernel, chosen by
+// position (the leading block) or by magnitude (from a candidate block or
+// from the whole transform), in each wavelet and decomposition. The CDF
+// wavelets are not orthonormal, so the error is measured on the kernel
+// rebuilt from the kept coefficients.
+void benchSelection(int size)
+{
+	int m = size;
+	int n = size;
+	int k = 64;
+	int cand = 32;
+	double *u = new double[(size_t)m * n];
+	double *v = new double[(size_t)m * n];
+	double *x = new double[(size_t)m * n];
+	double *w = new double[wavelet_2d_work_size(m, n)];
+	int *iw = new int[(size_t)m * n];
+	int *index = new int[k];
+	double *value = new double[k];
+	double *block = new double[cand * cand];
+
+	profileKernel(m, n, u);
+	double norm = 0.0;
+	for (size_t i = 0; i < (size_t)m * n; i++)
+		norm += u[i] * u[i];
+
+	cout << "\n";
+	cout << "  " << m << " x " << n << " profile kernel, relative error keeping " << k << " coefficients\n";
+	Wavelet wavelets[3] = {Wavelet::HAAR, Wavelet::CDF53, Wavelet::CDF97};
+	const char *wavelet_names[3] = {"haar ", "cdf53", "cdf97"};
+	HaarMode modes[2] = {HaarMode::STANDARD, HaarMode::NONSTANDARD};
+	for (int wv = 0; wv < 3; wv++)
+	{
+		for (HaarMode mode : modes)
+		{
+			memcpy(v, u, (size_t)m * n * sizeof(double));
+			wavelet_2d(m, n, v, w, wavelets[wv], mode);
+
+			// Rebuild the kernel from the COUNT coefficients at INDEX (of
+			// the candidate block if FROM_BLOCK) and return its error.
+			auto kept_error = [&](int count, const int *idx, bool from_block) {
+				memset(x, 0, (size_t)m * n * sizeof(double));
+				for (int i = 0; i < count; i++)
+				{
+					size_t at = from_block ? idx[i] % cand + (size_t)(idx[i] / cand) * m : idx[i];
+					x[at] = v[at];
+				}
+				wavelet_2d_inverse(m, n, x, w, wavelets[wv], mode);
+				double err = 0.0;
+				for (size_t i = 0; i < (size_t)m * n; i++)
+					err += (x[i] - u[i]) * (x[i] - u[i]);
+				return sqrt(err / norm);
+			};
+			int side = (int)sqrt((double)k);
+			for (int j = 0; j < side; j++)
+				for (int i = 0; i < side; i++)
+					index[i + j * side] = i + j * cand;
+			double err_block = kept_error(side * side, index, true);
+			for (int j = 0; j < cand; j++)
+				for (int i = 0; i < cand; i++)
+					block[i + j * cand] = v[i + (size_t)j * m];
+			int kept = haar_select_largest(cand * cand, block, k, index, value, iw);
+			double err_cand = kept_error(kept, index, true);
+			kept = haar_select_largest(m * n, v, k, index, value, iw);
+			double err_all = kept_error(kept, index, false);
+
+			cout << "    " << wavelet_names[wv] << " " << (mode == HaarMode::STANDARD ? "standard   " : "nonstandard")
+				 << "  leading " << side << "x" << side << " " << err_block << ", largest of " << cand << "x" << cand
+				 << " " << err_cand << ", largest overall " << err_all << "\n";
+		}
+	}
+
+	delete[] u;
+	delete[] v;
+	delete[] x;
+	delete[] w;
+	delete[] iw;
+	delete[] index;
+	delete[] value;
+	delete[] block;
+}
+
+// Transform of an array stored in a file, within a memory budget of an
+// eighth of the array, against HAAR_2D in memory.
+void benchFile(int size)
+{
+	int m = size;
+	int n = size;
+	int seed = 123456789;
+	size_t count = (size_t)m * n;
+	size_t budget = count * sizeof(double) / 8;
+	const char *path = "haar-bench.tmp";
+	double *u = r8mat_uniform_01_new(m, n, seed);
+	double *c = r8mat_copy_new(m, n, u);
+	double *w = new double[haar_2d_work_size(m, n)];
+	haar_2d(m, n, c, w);
+
+	ofstream out(path, ios::binary);
+	out.write((const char *)u, count * sizeof(double));
+	out.close();
+	MappedFile file;
+	if (!out || !file.open(path, true))
+	{
+		cout << "    file         cannot create " << path << "\n";
+		delete[] u;
+		delete[] c;
+		delete[] w;
+		return;
+	}
+
+	auto start = chrono::steady_clock::now();
+	bool ok = haar_2d_file<double>(file, 0, m, n, budget);
+	auto end = chrono::steady_clock::now();
+	double t_fwd = chrono::duration<double, milli>(end - start).count();
+	double *v = ok ? (double *)file.map(0, count * sizeof(double)) : nullptr;
+	bool same = v && memcmp(v, c, count * sizeof(double)) == 0;
+	file.unmap();
+	start = chrono::steady_clock::now();
+	ok = ok && haar_2d_inverse_file<double>(file, 0, m, n, budget);
+	end = chrono::steady_clock::now();
+	double t_inv = chrono::duration<double, milli>(end - start).count();
+	v = ok ? (double *)file.map(0, count * sizeof(double)) : nullptr;
+	double trip_err = v ? r8mat_dif_fro(m, n, v, u) : -1.0;
+	file.close();
+	remove(path);
+
+	if (!ok)
+		cout << "    file         FAILED\n";
+	else
+		cout << "    file         forward " << t_fwd << " ms, inverse " << t_inv << " ms, budget " << budget / 1024
+			 << " KiB, " << (same ? "bit-identical" : "MISMATCH") << ", round trip = " << trip_err << "\n";
+
+	delete[] u;
+	delete[] c;
+	delete[] w;
+}
+
+// Integer Haar transform of 16 bit data on each instruction set. Checks
+// that every kernel gives the same coefficients and an exact round trip,
+// and compares the zeroth-order entropy of a quantized profile kernel
+// before and after the transform.
+void benchInteger(int size)
+{
+	int m = size;
+	int n = size;
+	int seed = 123456789;
+	int repeats = size <= 1024 ? 10 : 3;
+	size_t count = (size_t)m * n;
+	double *r = r8mat_uniform_01_new(m, n, seed);
+	int *u = new int[count];
+	int *v = new int[count];
+	int *c = new int[count];
+	int *w = new int[haar_2d_work_size(m, n)];
+
+	auto entropy = [&](const int *x) {
+		vector<int> sorted(x, x + count);
+		sort(sorted.begin(), sorted.end());
+		double bits = 0.0;
+		for (size_t i = 0, j; i < count; i = j)
+		{
+			for (j = i; j < count && sorted[j] == sorted[i]; j++)
+				;
+			double p = (double)(j - i) / count;
+			bits -= p * log2(p);
+		}
+		return bits;
+	};
+
+	cout << "\n";
+	cout << "  " << m << " x " << n << " integer, 16 bit samples\n";
+
+	for (size_t i = 0; i < count; i++)
+		u[i] = (int)(r[i] * 65535.0);
+	simd_set_level(SimdLevel::SCALAR);
+	memcpy(c, u, count * sizeof(int));
+	haar_2d_integer(m, n, c, w);
+
+	auto reset_data = [&]() { memcpy(v, u, count * sizeof(int)); };
+	auto reset_coef = [&]() { memcpy(v, c, count * sizeof(int)); };
+	SimdLevel levels[3] = {SimdLevel::SCALAR, SimdLevel::AVX2, SimdLevel::AVX512};
+	for (SimdLevel level : levels)
+	{
+		simd_set_level(level);
+		if (simd_level() != level)
+			continue;
+		double t_fwd = timeMs(reset_data, [&]() { haar_2d_integer(m, n, v, w); }, repeats);
+		bool same = memcmp(v, c, count * sizeof(int)) == 0;
+		double t_inv = timeMs(reset_coef, [&]() { haar_2d_inverse_integer(m, n, v, w); }, repeats);
+		bool exact = memcmp(v, u, count * sizeof(int)) == 0;
+
+		cout << "    " << simd_level_name(level) << string(13 - strlen(simd_level_name(level)), ' ')
+			 << "forward " << t_fwd << " ms, inverse " << t_inv << " ms, "
+			 << (same ? "same coefficients" : "MISMATCH") << ", " << (exact ? "exact round trip" : "ROUND TRIP FAILED")
+			 << "\n";
+	}
+	simd_set_level(SimdLevel::AVX512);
+
+	profileKernel(m, n, r);
+	double peak = r[0];
+	for (size_t i = 0; i < count; i++)
+		peak = fmax(peak, r[i]);
+	for (size_t i = 0; i < count; i++)
+		u[i] = (int)lround(r[i] / peak * 65535.0);
+	memcpy(v, u, count * sizeof(int));
+	haar_2d_integer(m, n, v, w);
+	double bits_data = entropy(u);
+	double bits_coef = entropy(v);
+	haar_2d_inverse_integer(m, n, v, w);
+	bool exact = memcmp(v, u, count * sizeof(int)) == 0;
+	cout << "    profile kernel " << bits_data << " bits/sample, coefficients " << bits_coef << " bits/sample, "
+		 << (exact ? "exact round trip" : "ROUND TRIP FAILED") << "\n";
+
+	delete[] r;
+	delete[] u;
+	delete[] v;
+	delete[] c;
+	delete[] w;
+}
+
+// Incremental update of the transform after two overlapping rectangles of
+// the array change, against transforming the whole array again, in both
+// decompositions.
+void benchUpdate(int size)
+{
+	int m = size;
+	int n = size;
+	int seed = 123456789;
+	int repeats = size <= 1024 ? 10 : 3;
+	size_t count = (size_t)m * n;
+	int rects[8] = {m / 3, n / 5, 24, 40, m / 3 + 11, n / 5 + 29, 33, 17};
+	double *r = r8mat_uniform_01_new(m, n, seed);
+	vector<double> u(count);
+	vector<double> v(count);
+	vector<double> c(count);
+	vector<double> c0(count);
+	vector<double> full(count);
+	vector<double> w(haar_2d_work_size(m, n));
+
+	cout << "\n";
+	cout << "  " << m << " x " << n << " update of a " << rects[2] << " x " << rects[3] << " and a " << rects[6]
+		 << " x " << rects[7] << " rectangle\n";
+
+	memcpy(v.data(), r, count * sizeof(double));
+	for (int k = 0; k < 2; k++)
+	{
+		for (int j = rects[4 * k + 1]; j < min(rects[4 * k + 1] + rects[4 * k + 3], n); j++)
+			for (int i = rects[4 * k]; i < min(rects[4 * k] + rects[4 * k + 2], m); i++)
+				v[i + (size_t)j * m] = 2.0 * r[i + (size_t)j * m] - 0.5;
+	}
+
+	HaarMode modes[2] = {HaarMode::STANDARD, HaarMode::NONSTANDARD};
+	for (HaarMode mode : modes)
+	{
+		memcpy(c0.data(), r, count * sizeof(double));
+		haar_2d(m, n, c0.data(), w.data(), mode);
+
+		double t_full = timeMs([&]() { full = v; }, [&]() { haar_2d(m, n, full.data(), w.data(), mode); }, repeats);
+		double t_update = timeMs(
+			[&]() {
+				memcpy(u.data(), r, count * sizeof(double));
+				c = c0;
+			},
+			[&]() { haar_2d_update(m, n, u.data(), c.data(), v.data(), 2, rects, mode); }, repeats);
+
+		double err = 0.0;
+		for (size_t i = 0; i < count; i++)
+			err = fmax(err, fabs(c[i] - full[i]));
+		cout << "    " << (mode == HaarMode::NONSTANDARD ? "nonstandard" : "standard   ") << "  full " << t_full
+			 << " ms, update " << t_update << " ms (" << t_full / t_update << "x), max error " << err << "\n";
+	}
+
+	delete[] r;
+}
+
+// Low-pass block of many float kernels, one haar_2d_lowpass call per kernel
+// against batched calls at every instruction set, on one thread and on the
+// pool.
+void benchBatch(int size, ThreadPool &pool)
+{
+	int m = size;
+	int n = size;
+	int cm = 32;
+	int cn = 32;
+	int count = max(16, (1 << 24) / (m * n));
+	int repeats = 3;
+	int seed = 123456789;
+	size_t total = (size_t)count * m * n;
+	double *r = r8mat_uniform_01_new(count, m * n, seed);
+	float *u = new float[total];
+	float *c = new float[(size_t)count * cm * cn];
+	float *cb = new float[(size_t)count * cm * cn];
+	float *w = new float[haar_2d_lowpass_work_size(m, n, cm, cn)];
+	vector<const float *> images(count);
+	for (int b = 0; b < count; b++)
+	{
+		for (int i = 0; i < m * n; i++)
+			u[(size_t)b * m * n + i] = (float)r[b + (size_t)i * count];
+		images[b] = u + (size_t)b * m * n;
+	}
+
+	double t_single = timeMs([]() {}, [&]() {
+		for (int b = 0; b < count; b++)
+			haar_2d_lowpass(m, n, images[b], cm, cn, c + (size_t)b * cm * cn, w);
+	}, repeats);
+
+	cout << "\n";
+	cout << "  " << count << " float kernels of " << m << " x " << n << ", " << cm << "x" << cn << " block\n";
+	cout << "    one at a time " << t_single << " ms\n";
+	SimdLevel levels[3] = {SimdLevel::SCALAR, SimdLevel::AVX2, SimdLevel::AVX512};
+	for (SimdLevel level : levels)
+	{
+		simd_set_level(level);
+		if (simd_level() != level)
+			continue;
+		vector<float> wb(haar_2d_lowpass_batch_work_size<float>(m, n, cm, cn));
+		double t_batch = timeMs([]() {}, [&]() {
+			haar_2d_lowpass_batch(count, m, n, images.data(), cm, cn, cb, wb.data());
+		}, repeats);
+		bool same = memcmp(c, cb, (size_t)count * cm * cn * sizeof(float)) == 0;
+		double t_pool = timeMs([]() {}, [&]() {
+			haar_2d_lowpass_batch(count, m, n, images.data(), cm, cn, cb, pool);
+		}, repeats);
+		same = same && memcmp(c, cb, (size_t)count * cm * cn * sizeof(float)) == 0;
+		cout << "    " << simd_level_name(level) << string(13 - strlen(simd_level_name(level)), ' ') << "batched "
+			 << haar_2d_lowpass_batch_lanes<float>() << " lanes " << t_batch << " ms (x" << t_single / t_batch
+			 << "), on " << pool.size() << " threads " << t_pool << " ms, " << (same ? "bit-identical" : "MISMATCH")
+			 << "\n";
+	}
+	simd_set_level(SimdLevel::AVX512);
+
+	delete[] r;
+	delete[] u;
+	delete[] c;
+	delete[] cb;
+	delete[] w;
+}
+
+// Wavelet-domain convolution of a radiance block with one kernel per texel
+// of a size x size map, dense over 256 coefficients and sparse with 64 of
+// them, on each instruction set. The sparse kernels are the dense ones'
+// nonzeros, so both give the same colors; the error is against a double
+// precision reference.
+void benchConvolve(int size, ThreadPool &pool)
+{
+	int texels = size * size;
+	int coefs = 256;
+	int k = 64;
+	int seed = 123456789;
+	int repeats = 3;
+	vector<float> kernel((size_t)texels * coefs, 0.0f);
+	vector<SstxCoef> sparse((size_t)texels * k);
+	vector<float> radiance(4 * coefs);
+	vector<float> color(4 * (size_t)texels);
+	vector<double> reference(4 * (size_t)texels, 0.0);
+
+	double *r = r8vec_uniform_01_new(4 * coefs, seed);
+	for (int i = 0; i < 4 * coefs; i++)
+		radiance[i] = (float)r[i];
+	delete[] r;
+	for (int t = 0; t < texels; t++)
+	{
+		r = r8vec_uniform_01_new(2 * k, seed);
+		for (int i = 0; i < k; i++)
+		{
+			SstxCoef &c = sparse[(size_t)t * k + i];
+			c.index = min((int)(r[2 * i] * coefs), coefs - 1);
+			c.value = (float)(r[2 * i + 1] - 0.5);
+			kernel[(size_t)t * coefs + c.index] += c.value;
+			for (int ch = 0; ch < 4; ch++)
+				reference[4 * (size_t)t + ch] += (double)c.value * radiance[4 * c.index + ch];
+		}
+		delete[] r;
+	}
+
+	auto error = [&]() {
+		double err = 0.0;
+		for (size_t i = 0; i < color.size(); i++)
+			err = fmax(err, fabs(color[i] - reference[i]));
+		return err;
+	};
+
+	cout << "\n";
+	cout << "  " << size << " x " << size << " texels, convolution with " << coefs << " dense and " << k
+		 << " sparse coefficients on " << pool.size() << " threads\n";
+
+	SimdLevel levels[3] = {SimdLevel::SCALAR, SimdLevel::AVX2, SimdLevel::AVX512};
+	for (SimdLevel level : levels)
+	{
+		simd_set_level(level);
+		if (simd_level() != level)
+			continue;
+		double t_dense = timeMs([]() {}, [&]() {
+			haar_convolve(texels, coefs, kernel.data(), radiance.data(), color.data(), pool);
+		}, repeats);
+		double err_dense = error();
+		double t_sparse = timeMs([]() {}, [&]() {
+			haar_convolve_sparse(texels, k, sparse.data(), radiance.data(), color.data(), pool);
+		}, repeats);
+		double err_sparse = error();
+
+		cout << "    " << simd_level_name(level) << string(13 - strlen(simd_level_name(level)), ' ') << "dense "
+			 << t_dense << " ms (" << kernel.size() * sizeof(float) / t_dense * 1e-6 << " GB/s), sparse " << t_sparse
+			 << " ms, max error " << fmax(err_dense, err_sparse) << "\n";
+	}
+	simd_set_level(SimdLevel::AVX512);
+}
+
+// Legacy Lehmer generator against the counter-based one on each instruction
+// set. The counter-based values must not depend on the kernel.
+void benchRandom(int size, ThreadPool &pool)
+{
+	int m = size;
+	int n = size;
+	int repeats = size <= 1024 ? 10 : 3;
+	size_t count = (size_t)m * n;
+	uint64_t seed = 123456789;
+	double *r = nullptr;
+	vector<double> reference;
+
+	cout << "\n";
+	cout << "  " << m << " x " << n << " uniform matrix\n";
+
+	double t_legacy = timeMs([&]() { delete[] r; }, [&]() {
+		int legacy_seed = 123456789;
+		r = r8mat_uniform_01_new(m, n, legacy_seed);
+	}, repeats);
+	cout << "    lehmer       " << t_legacy << " ms\n";
+
+	SimdLevel levels[3] = {SimdLevel::SCALAR, SimdLevel::AVX2, SimdLevel::AVX512};
+	for (SimdLevel level : levels)
+	{
+		simd_set_level(level);
+		if (simd_level() != level)
+			continue;
+		double t_counter = timeMs([&]() { delete[] r; }, [&]() { r = r8mat_uniform_01_counter_new(m, n, seed, pool); },
+			repeats);
+		if (reference.empty())
+			reference.assign(r, r + count);
+		bool same = memcmp(r, reference.data(), count * sizeof(double)) == 0;
+		same = same && r[count - 1] == r8_uniform_01_counter(seed, count - 1);
+		double mean = 0.0;
+		for (size_t i = 0; i < count; i++)
+			mean += r[i];
+		mean = mean / count;
+
+		cout << "    " << simd_level_name(level) << string(13 - strlen(simd_level_name(level)), ' ') << t_counter
+			 << " ms (x" << t_legacy / t_counter << ") on " << pool.size() << " threads, mean " << mean << ", "
+			 << (same ? "same values" : "MISMATCH") << "\n";
+	}
+	simd_set_level(SimdLevel::AVX512);
+
+	delete[] r;
+}
+
+// Error metrics of a reconstruction: r8mat_dif_fro against image_error on
+// one double channel and on RGBA floats, on each instruction set.
+void benchMetrics(int size, ThreadPool &pool)
+{
+	int m = size;
+	int n = size;
+	int repeats = size <= 1024 ? 10 : 3;
+	size_t count = (size_t)m * n;
+	double *u = r8mat_uniform_01_counter_new(m, n, 1, pool);
+	double *v = r8mat_uniform_01_counter_new(m, n, 2, pool);
+	double *r = r8mat_uniform_01_counter_new(4 * m, n, 3, pool);
+	vector<float> fu(4 * count);
+	vector<float> fv(4 * count);
+	for (size_t i = 0; i < count; i++)
+		v[i] = u[i] + 0.01 * (v[i] - 0.5);
+	for (size_t i = 0; i < 4 * count; i++)
+	{
+		fu[i] = (float)r[i];
+		fv[i] = (float)(r[i] + 0.01 * (u[i / 4] - 0.5));
+	}
+
+	double fro = 0.0;
+	double t_fro = timeMs([]() {}, [&]() { fro = r8mat_dif_fro(m, n, v, u); }, repeats);
+
+	cout << "\n";
+	cout << "  " << m << " x " << n << " error metrics\n";
+	cout << "    r8mat_dif_fro " << t_fro << " ms, fro " << fro << "\n";
+
+	SimdLevel levels[3] = {SimdLevel::SCALAR, SimdLevel::AVX2, SimdLevel::AVX512};
+	for (SimdLevel level : levels)
+	{
+		simd_set_level(level);
+		if (simd_level() != level)
+			continue;
+		ImageError e;
+		ImageError rgba[4];
+		double t_one = timeMs([]() {}, [&]() { e = image_error(m, n, 1, v, u, 1.0, pool); }, repeats);
+		double t_rgba = timeMs([]() {}, [&]() { image_error(m, n, 4, fv.data(), fu.data(), 1.0, pool, rgba); },
+			repeats);
+
+		cout << "    " << simd_level_name(level) << string(13 - strlen(simd_level_name(level)), ' ') << "double "
+			 << t_one << " ms (x" << t_fro / t_one << "), fro " << e.fro << ", psnr " << e.psnr << " dB, max "
+			 << e.max_abs << ", rel " << e.rel_l2 << "; rgba float " << t_rgba << " ms, psnr " << rgba[0].psnr
+			 << " " << rgba[1].psnr << " " << rgba[2].psnr << " " << rgba[3].psnr << " dB\n";
+	}
+	simd_set_level(SimdLevel::AVX512);
+
+	delete[] u;
+	delete[] v;
+	delete[] r;
+}
+
+// One timing of the JSON suite. Times are the best of the repeats; a
+// negative time or error means the variant has no inverse or no round trip.
+struct SuiteResult
+{
+	string name;
+	int m;
+	int n;
+	int channels;
+	int bytes;
+	double forward_ms;
+	double inverse_ms;
+	double round_trip;
+};
+
+// Writes the results of benchSuite. The bandwidth counts one read and one
+// write of the array per call, so for the low-pass variants, which only
+// write a block, it is twice what they move.
+void writeSuiteJson(ostream &out, const vector<SuiteResult> &results, ThreadPool &pool)
+{
+	auto number = [&](double x) {
+		char text[32];
+		if (x < 0.0 || !isfinite(x))
+			return string("null");
+		snprintf(text, sizeof(text), "%.6g", x);
+		return string(text);
+	};
+
+	out << "{\n";
+	out << "  \"schema\": 1,\n";
+	out << "  \"simd\": \"" << simd_level_name(simd_level()) << "\",\n";
+	out << "  \"threads\": " << pool.size() << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t r = 0; r < results.size(); r++)
+	{
+		const SuiteResult &s = results[r];
+		double elements = (double)s.m * s.n * s.channels;
+		double bytes = 2.0 * elements * s.bytes;
+		double inverse_ms = s.inverse_ms;
+		out << "    {\"name\": \"" << s.name << "\", \"m\": " << s.m << ", \"n\": " << s.n << ", \"channels\": "
+			<< s.channels << ", \"bytes_per_element\": " << s.bytes << ",\n";
+		out << "     \"forward_ms\": " << number(s.forward_ms) << ", \"forward_ns_per_element\": "
+			<< number(s.forward_ms * 1e6 / elements) << ", \"forward_gb_per_s\": "
+			<< number(bytes / s.forward_ms * 1e-6) << ",\n";
+		out << "     \"inverse_ms\": " << number(inverse_ms) << ", \"inverse_ns_per_element\": "
+			<< number(inverse_ms < 0.0 ? -1.0 : inverse_ms * 1e6 / elements) << ", \"inverse_gb_per_s\": "
+			<< number(inverse_ms < 0.0 ? -1.0 : bytes / inverse_ms * 1e-6) << ",\n";
+		out << "     \"round_trip\": " << number(s.round_trip) << "}" << (r + 1 < results.size() ? "," : "")
+			<< "\n";
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+// Every transform on square arrays of 16 to 8192 entries a side. The round
+// trip error is r8mat_dif_fro between the data and the inverse of its
+// transform. Small sizes are repeated more, as the clock is coarse next to
+// them. Variants that would need more than about 1.5 GB at a size are
+// skipped there. The data come from the counter-based generator, which is
+// timed against the Lehmer one first.
+vector<SuiteResult> benchSuite(ThreadPool &pool)
+{
+	vector<SuiteResult> results;
+
+	for (int size = 16; size <= 8192; size *= 2)
+	{
+		int m = size;
+		int n = size;
+		int seed = 123456789;
+		size_t count = (size_t)m * n;
+		int repeats = (int)max((size_t)1, min((size_t)1000, ((size_t)1 << 24) / count));
+		int cm = min(32, size);
+		double *u = nullptr;
+		SuiteResult lehmer = {"r8mat_uniform_01_new", m, n, 1, (int)sizeof(double), -1.0, -1.0, -1.0};
+		lehmer.forward_ms = timeMs([&]() { delete[] u; }, [&]() {
+			int lehmer_seed = seed;
+			u = r8mat_uniform_01_new(m, n, lehmer_seed);
+		}, repeats);
+		results.push_back(lehmer);
+		SuiteResult counter = {"r8mat_uniform_01_counter_new", m, n, 1, (int)sizeof(double), -1.0, -1.0, -1.0};
+		counter.forward_ms = timeMs([&]() { delete[] u; }, [&]() { u = r8mat_uniform_01_counter_new(m, n, seed, pool); },
+			repeats);
+		results.push_back(counter);
+		double *v = new double[count];
+		double *c = new double[count];
+		double *w = new double[max(haar_2d_work_size(m, n), wavelet_2d_work_size(m, n))];
+
+		cerr << "haar-bench: " << m << " x " << n << "\n";
+
+		auto reset_data = [&]() { memcpy(v, u, count * sizeof(double)); };
+		auto reset_coef = [&]() { memcpy(v, c, count * sizeof(double)); };
+		// Times F and its inverse G on the double array and checks the round trip.
+		auto run = [&](const string &name, int rows, int cols, function<void()> f, function<void()> g) {
+			SuiteResult s = {name, rows, cols, 1, (int)sizeof(double), -1.0, -1.0, -1.0};
+			s.forward_ms = timeMs(reset_data, f, repeats);
+			memcpy(c, v, count * sizeof(double));
+			s.inverse_ms = timeMs(reset_coef, g, repeats);
+			s.round_trip = r8mat_dif_fro(m, n, v, u);
+			results.push_back(s);
+		};
+
+		run("haar_1d", m * n, 1, [&]() { haar_1d(m * n, v); }, [&]() { haar_1d_inverse(m * n, v); });
+		run("haar_2d", m, n, [&]() { haar_2d(m, n, v); }, [&]() { haar_2d_inverse(m, n, v); });
+		run("haar_2d_nonstandard", m, n, [&]() { haar_2d(m, n, v, w, HaarMode::NONSTANDARD); },
+			[&]() { haar_2d_inverse(m, n, v, w, HaarMode::NONSTANDARD); });
+
+		int panel = haar_2d_panel_rows(m, n, sizeof(double));
+		vector<double> wb(haar_2d_blocked_work_size(m, n, panel));
+		run("haar_2d_blocked", m, n, [&]() { haar_2d_blocked(m, n, v, wb.data(), panel); },
+			[&]() { haar_2d_inverse_blocked(m, n, v, wb.data(), panel); });
+
+		SimdLevel levels[3] = {SimdLevel::SCALAR, SimdLevel::AVX2, SimdLevel::AVX512};
+		for (SimdLevel level : levels)
+		{
+			simd_set_level(level);
+			if (simd_level() != level)
+				continue;
+			run(string("haar_2d_simd_") + simd_level_name(level), m, n, [&]() { haar_2d_simd(m, n, v, w); },
+				[&]() { haar_2d_inverse_simd(m, n, v, w); });
+		}
+		simd_set_level(SimdLevel::AVX512);
+
+		run("haar_2d_parallel", m, n, [&]() { haar_2d_parallel(m, n, v, pool); },
+			[&]() { haar_2d_inverse_parallel(m, n, v, pool); });
+		run("wavelet_2d_cdf53", m, n, [&]() { wavelet_2d(m, n, v, w, Wavelet::CDF53, HaarMode::STANDARD); },
+			[&]() { wavelet_2d_inverse(m, n, v, w, Wavelet::CDF53, HaarMode::STANDARD); });
+		run("wavelet_2d_cdf97", m, n, [&]() { wavelet_2d(m, n, v, w, Wavelet::CDF97, HaarMode::STANDARD); },
+			[&]() { wavelet_2d_inverse(m, n, v, w, Wavelet::CDF97, HaarMode::STANDARD); });
+
+		// Low-pass block only: no inverse.
+		{
+			vector<double> block((size_t)cm * cm);
+			vector<double> wl(haar_2d_lowpass_work_size(m, n, cm, cm));
+			SuiteResult s = {"haar_2d_lowpass_" + to_string(cm), m, n, 1, (int)sizeof(double), -1.0, -1.0, -1.0};
+			s.forward_ms = timeMs([]() {}, [&]() { haar_2d_lowpass(m, n, u, cm, cm, block.data(), wl.data()); },
+				repeats);
+			results.push_back(s);
+		}
+
+		// Integer transform of 16 bit samples; the round trip is exact.
+		{
+			vector<int> iu(count);
+			vector<int> iv(count);
+			vector<int> iw(haar_2d_work_size(m, n));
+			for (size_t i = 0; i < count; i++)
+				iu[i] = (int)(u[i] * 65535.0);
+			SuiteResult s = {"haar_2d_integer", m, n, 1, (int)sizeof(int), -1.0, -1.0, -1.0};
+			s.forward_ms = timeMs([&]() { iv = iu; }, [&]() { haar_2d_integer(m, n, iv.data(), iw.data()); },
+				repeats);
+			vector<int> ic = iv;
+			s.inverse_ms = timeMs([&]() { iv = ic; }, [&]() { haar_2d_inverse_integer(m, n, iv.data(), iw.data()); },
+				repeats);
+			for (size_t i = 0; i < count; i++)
+			{
+				v[i] = iv[i];
+				c[i] = iu[i];
+			}
+			s.round_trip = r8mat_dif_fro(m, n, v, c);
+			results.push_back(s);
+		}
+
+		// RGBA float, 4 channels interleaved.
+		if (size <= 4096)
+		{
+			size_t total = 4 * count;
+			vector<float> fu(total);
+			vector<float> fv(total);
+			vector<float> fc(total);
+			vector<float> fw(haar_2d_interleaved_work_size(m, n, 4));
+			double *r = r8mat_uniform_01_new(4 * m, n, seed);
+			for (size_t i = 0; i < total; i++)
+				fu[i] = (float)r[i];
+			delete[] r;
+			SuiteResult s = {"haar_2d_interleaved_float", m, n, 4, (int)sizeof(float), -1.0, -1.0, -1.0};
+			s.forward_ms = timeMs([&]() { fv = fu; }, [&]() { haar_2d_interleaved(m, n, 4, fv.data(), fw.data()); },
+				repeats);
+			fc = fv;
+			s.inverse_ms = timeMs([&]() { fv = fc; },
+				[&]() { haar_2d_inverse_interleaved(m, n, 4, fv.data(), fw.data()); }, repeats);
+			double err = 0.0;
+			for (size_t i = 0; i < total; i++)
+				err += ((double)fv[i] - fu[i]) * ((double)fv[i] - fu[i]);
+			s.round_trip = sqrt(err);
+			results.push_back(s);
+		}
+
+		// Batched low-pass blocks of float kernels, the bake's workload. The
+		// time is per kernel.
+		if (size <= 1024)
+		{
+			int batch = max(16, (1 << 24) / (m * n));
+			vector<float> fu((size_t)batch * count);
+			vector<float> fc((size_t)batch * cm * cm);
+			vector<const float *> images(batch);
+			for (size_t i = 0; i < fu.size(); i++)
+				fu[i] = (float)u[i % count];
+			for (int b = 0; b < batch; b++)
+				images[b] = fu.data() + (size_t)b * count;
+			SuiteResult s = {"haar_2d_lowpass_batch_" + to_string(cm), m, n, 1, (int)sizeof(float), -1.0, -1.0,
+				-1.0};
+			s.forward_ms = timeMs([]() {}, [&]() {
+				haar_2d_lowpass_batch(batch, m, n, images.data(), cm, cm, fc.data(), pool);
+			}, max(1, repeats / batch)) / batch;
+			results.push_back(s);
+		}
+
+		delete[] u;
+		delete[] v;
+		delete[] c;
+		delete[] w;
+	}
+
+	return results;
+}
+
+int main(int argc, char **argv)
+{
+	timestamp();
+	cout << "HAAR_BENCH\n";
+	cout << "  best instruction set: " << simd_level_name(simd_level()) << "\n";
+
+	ThreadPool pool;
+
+	if (argc > 1 && !strcmp(argv[1], "--json"))
+	{
+		if (argc != 3)
+		{
+			cerr << "usage: haar-bench --json file\n";
+			return 1;
+		}
+		vector<SuiteResult> results = benchSuite(pool);
+		ofstream out(argv[2]);
+		writeSuiteJson(out, results, pool);
+		if (!out.good())
+		{
+			cerr << "haar-bench: cannot write " << argv[2] << "\n";
+			return 1;
+		}
+		cout << "  " << results.size() << " results written to " << argv[2] << "\n";
+	}
+	else if (argc > 1)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			if (atoi(argv[i]) < 32)
+			{
+				cerr << "haar-bench: size " << argv[i] << " is below 32\n";
+				return 1;
+			}
+			benchSize(atoi(argv[i]), pool);
+			benchRgba(atoi(argv[i]));
+			benchFile(atoi(argv[i]));
+			benchSelection(atoi(argv[i]));
+			benchInteger(atoi(argv[i]));
+			benchUpdate(atoi(argv[i]));
+			benchBatch(atoi(argv[i]), pool);
+			if (atoi(argv[i]) <= 1024)
+				benchConvolve(atoi(argv[i]), pool);
+			benchRandom(atoi(argv[i]), pool);
+			benchMetrics(atoi(argv[i]), pool);
+		}
+	}
+	else
+	{
+		benchSize(512, pool);
+		benchRgba(512);
+		benchFile(512);
+		benchSelection(512);
+		benchInteger(512);
+		benchUpdate(512);
+		benchBatch(128, pool);
+		benchBatch(512, pool);
+		benchConvolve(512, pool);
+		benchRandom(4096, pool);
+		benchMetrics(4096, pool);
+		benchSize(4096, pool);
+		benchRgba(4096);
+		benchFile(4096);
+		benchUpdate(4096);
+	}
+
+	return 0;
+}
@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "cpu_features.hpp"
+#include "haar.hpp"
+#include "sstx.hpp"
+#include "thread_pool.hpp"
+
+#if TSSSS_X86
+#include <immintrin.h>
+#endif
+
+//
+//  Codebook search kernels.
+//
+//  The entries of the codebook are dense and the vectors sparse, so the
+//  entries are kept transposed, dimension D of entry E at D*ENTRIES+E, and
+//  the dot products of a vector with every entry are built by adding each
+//  of its coefficients times the row of its dimension.  Every lane adds the
+//  same products in the same order, so the vector kernels give the scalar
+//  result, and multiply and add separately to keep it that way.
+//
+#define CODEBOOK_CHUNK 256
+
+static void dotsScalar(int k, const SstxCoef x[], int entries, const float t[], float dots[])
+{
+	fill(dots, dots + entries, 0.0f);
+	for (int i = 0; i < k; i++)
+	{
+		const float *row = t + (size_t)x[i].index * entries;
+		float v = x[i].value;
+		for (int e = 0; e < entries; e++)
+		{
+			dots[e] += v * row[e];
+		}
+	}
+}
+
+#if TSSSS_X86
+// AVX2: 8 entries per register.
+// --------------------------------
+TSSSS_TARGET_AVX2 static void dotsAvx2(int k, const SstxCoef x[], int entries, const float t[], float dots[])
+{
+	int vec = entries - entries % 8;
+	fill(dots, dots + entries, 0.0f);
+	for (int i = 0; i < k; i++)
+	{
+		const float *row = t + (size_t)x[i].index * entries;
+		float v = x[i].value;
+		__m256 vv = _mm256_set1_ps(v);
+		for (int e = 0; e < vec; e += 8)
+		{
+			__m256 d = _mm256_loadu_ps(dots + e);
+			_mm256_storeu_ps(dots + e, _mm256_add_ps(d, _mm256_mul_ps(vv, _mm256_loadu_ps(row + e))));
+		}
+		for (int e = vec; e < entries; e++)
+		{
+			dots[e] += v * row[e];
+		}
+	}
+}
+
+// AVX-512: 16 entries per register.
+// --------------------------------
+TSSSS_TARGET_AVX512 static void dotsAvx512(int k, const SstxCoef x[], int entries, const float t[], float dots[])
+{
+	int vec = entries - entries % 16;
+	fill(dots, dots + entries, 0.0f);
+	for (int i = 0; i < k; i++)
+	{
+		const float *row = t + (size_t)x[i].index * entries;
+		float v = x[i].value;
+		__m512 vv = _mm512_set1_ps(v);
+		for (int e = 0; e < vec; e += 16)
+		{
+			__m512 d = _mm512_loadu_ps(dots + e);
+			_mm512_storeu_ps(dots + e, _mm512_add_ps(d, _mm512_mul_ps(vv, _mm512_loadu_ps(row + e))));
+		}
+		for (int e = vec; e < entries; e++)
+		{
+			dots[e] += v * row[e];
+		}
+	}
+}
+#endif
+
+static void (*dotsKernel())(int k, const SstxCoef x[], int entries, const float t[], float dots[])
+{
+#if TSSSS_X86
+	switch (simd_level())
+	{
+	case SimdLevel::AVX512:
+		return dotsAvx512;
+	case SimdLevel::AVX2:
+		return dotsAvx2;
+	default:
+		break;
+	}
+#endif
+	return dotsScalar;
+}
+
+static double sparseNorm2(int k, const SstxCoef x[])
+{
+	double sum = 0.0;
+	for (int i = 0; i < k; i++)
+	{
+		sum = sum + (double)x[i].value * x[i].value;
+	}
+	return sum;
+}
+
+// Squared distance from the sparse X to the dense C of squared norm C_NORM2.
+static double sparseDistance2(int k, const SstxCoef x[], double x_norm2, const float c[], double c_norm2)
+{
+	double dot = 0.0;
+	for (int i = 0; i < k; i++)
+	{
+		dot = dot + (double)x[i].value * c[x[i].index];
+	}
+	return max(x_norm2 - 2.0 * dot + c_norm2, 0.0);
+}
+//****************************************************************************80
+
+double haar_codebook(int n, int k, const SstxCoef x[], int dim, int entries, int iterations, uint64_t seed,
+	ThreadPool &pool, float codebook[], int assignment[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_CODEBOOK clusters sparse coefficient vectors into a codebook.
+//
+//  Discussion:
+//
+//    Neighboring kernels are nearly the same, so a few thousand entries
+//    stand in for a whole map of them.  The entries are found by k-means:
+//    k-means++ picks the first ENTRIES from the vectors, each new one with
+//    a probability proportional to the squared distance of a vector to the
+//    nearest entry so far, using R8_UNIFORM_01_COUNTER(SEED,E), and then
+//    ITERATIONS rounds of Lloyd's algorithm move every entry to the mean of
+//    the vectors nearest to it.  An entry no vector is nearest to moves to
+//    the vector farthest from its entry.  The rounds stop early once no
+//    vector changes entries.
+//
+//    The vectors are assigned in chunks on the threads of POOL, with the
+//    widest vector kernel the machine has, and the means are summed in
+//    double precision in the order of the vectors, so the codebook depends
+//    on neither.
+//
+//  Parameters:
+//
+//    Input, int N, the number of vectors.
+//
+//    Input, int K, the number of coefficients per vector.
+//
+//    Input, const SstxCoef X[N*K], the vectors, the K entries of vector I
+//    starting at X[I*K], as the kernels of a .sstx file.  Padding entries
+//    with a value of 0 are allowed.
+//
+//    Input, int DIM, the dimension of the vectors.  Every index must be
+//    below it.
+//
+//    Input, int ENTRIES, the number of entries of the codebook, 1 to N.
+//
+//    Input, int ITERATIONS, the largest number of Lloyd rounds.
+//
+//    Input, uint64_t SEED, selects the random stream of the seeding.
+//
+//    Input, ThreadPool &POOL, the threads to use.
+//
+//    Output, float CODEBOOK[ENTRIES*DIM], the entries, entry E starting at
+//    CODEBOOK[E*DIM].
+//
+//    Output, int ASSIGNMENT[N], the entry nearest to each vector.
+//
+//    Output, double HAAR_CODEBOOK, the sum of the squared distances of the
+//    vectors to their entries over the sum of their squared norms.
+//
+{
+	int chunks;
+	int e;
+	int i;
+	int it;
+	double norm2_sum;
+	void (*kernel)(int k, const SstxCoef x[], int entries, const float t[], float dots[]);
+
+	kernel = dotsKernel();
+	chunks = (n + CODEBOOK_CHUNK - 1) / CODEBOOK_CHUNK;
+
+	vector<double> x_norm2(n);
+	vector<double> dist2(n);
+	vector<double> c_norm2(entries);
+	norm2_sum = 0.0;
+	for (i = 0; i < n; i++)
+	{
+		x_norm2[i] = sparseNorm2(k, x + (size_t)i * k);
+		norm2_sum = norm2_sum + x_norm2[i];
+	}
+	//
+	//  Seed with k-means++.
+	//
+	memset(codebook, 0, (size_t)entries * dim * sizeof(float));
+	for (e = 0; e < entries; e++)
+	{
+		int pick = 0;
+		double total = 0.0;
+		for (i = 0; i < n; i++)
+		{
+			total = total + (e == 0 ? 1.0 : dist2[i]);
+		}
+		double target = r8_uniform_01_counter(seed, e) * total;
+		if (0.0 < total)
+		{
+			double sum = 0.0;
+			for (pick = 0; pick < n - 1; pick++)
+			{
+				sum = sum + (e == 0 ? 1.0 : dist2[pick]);
+				if (target < sum)
+				{
+					break;
+				}
+			}
+		}
+		else
+		{
+			//
+			//  Every vector is an entry already.
+			//
+			pick = e % n;
+		}
+		float *c = codebook + (size_t)e * dim;
+		const SstxCoef *p = x + (size_t)pick * k;
+		for (i = 0; i < k; i++)
+		{
+			c[p[i].index] += p[i].value;
+		}
+		c_norm2[e] = 0.0;
+		for (i = 0; i < dim; i++)
+		{
+			c_norm2[e] = c_norm2[e] + (double)c[i] * c[i];
+		}
+		//
+		//  The difference of the norms bounds the distance from below, which
+		//  rules out most vectors once there are a few entries.
+		//
+		double c_norm = sqrt(c_norm2[e]);
+		pool.parallelFor(chunks, [&](int c_lo, int c_hi, int /*thread*/) {
+			for (int j = c_lo * CODEBOOK_CHUNK; j < min(c_hi * CODEBOOK_CHUNK, n); j++)
+			{
+				double lower = sqrt(x_norm2[j]) - c_norm;
+				if (e != 0 && dist2[j] <= lower * lower)
+				{
+					continue;
+				}
+				double d = sparseDistance2(k, x + (size_t)j * k, x_norm2[j], c, c_norm2[e]);
+				if (e == 0 || d < dist2[j])
+				{
+					dist2[j] = d;
+				}
+			}
+		});
+	}
+	//
+	//  Lloyd rounds, an assignment and then an update of the entries.
+	//
+	vector<float> transposed((size_t)dim * entries);
+	vector<float> dots((size_t)pool.size() * entries);
+	vector<double> sums((size_t)entries * dim);
+	vector<int> counts(entries);
+	vector<int> previous(n, -1);
+	double error = 0.0;
+	for (it = 0;; it++)
+	{
+		for (e = 0; e < entries; e++)
+		{
+			for (i = 0; i < dim; i++)
+			{
+				transposed[(size_t)i * entries + e] = codebook[(size_t)e * dim + i];
+			}
+		}
+		pool.parallelFor(chunks, [&](int c_lo, int c_hi, int thread) {
+			float *d = dots.data() + (size_t)thread * entries;
+			for (int j = c_lo * CODEBOOK_CHUNK; j < min(c_hi * CODEBOOK_CHUNK, n); j++)
+			{
+				kernel(k, x + (size_t)j * k, entries, transposed.data(), d);
+				int best = 0;
+				double best_d = c_norm2[0] - 2.0 * d[0];
+				for (int f = 1; f < entries; f++)
+				{
+					double df = c_norm2[f] - 2.0 * d[f];
+					if (df < best_d)
+					{
+						best = f;
+						best_d = df;
+					}
+				}
+				assignment[j] = best;
+				dist2[j] = max(x_norm2[j] + best_d, 0.0);
+			}
+		});
+
+		int changed = 0;
+		error = 0.0;
+		for (i = 0; i < n; i++)
+		{
+			changed = changed + (assignment[i] != previous[i]);
+			previous[i] = assignment[i];
+			error = error + dist2[i];
+		}
+		if (it == iterations || changed == 0)
+		{
+			break;
+		}
+
+		fill(sums.begin(), sums.end(), 0.0);
+		fill(counts.begin(), counts.end(), 0);
+		for (i = 0; i < n; i++)
+		{
+			double *s = sums.data() + (size_t)assignment[i] * dim;
+			const SstxCoef *p = x + (size_t)i * k;
+			for (int j = 0; j < k; j++)
+			{
+				s[p[j].index] = s[p[j].index] + p[j].value;
+			}
+			counts[assignment[i]]++;
+		}
+		for (e = 0; e < entries; e++)
+		{
+			float *c = codebook + (size_t)e * dim;
+			if (counts[e] == 0)
+			{
+				//
+				//  Move an unused entry to the vector farthest from its own.
+				//
+				int farthest = (int)(max_element(dist2.begin(), dist2.end()) - dist2.begin());
+				memset(c, 0, dim * sizeof(float));
+				for (i = 0; i < k; i++)
+				{
+					c[x[(size_t)farthest * k + i].index] += x[(size_t)farthest * k + i].value;
+				}
+				dist2[farthest] = 0.0;
+			}
+			else
+			{
+				for (i = 0; i < dim; i++)
+				{
+					c[i] = (float)(sums[(size_t)e * dim + i] / counts[e]);
+				}
+			}
+			c_norm2[e] = 0.0;
+			for (i = 0; i < dim; i++)
+			{
+				c_norm2[e] = c_norm2[e] + (double)c[i] * c[i];
+			}
+		}
+	}
+
+	return 0.0 < norm2_sum ? error / norm2_sum : 0.0;
+}
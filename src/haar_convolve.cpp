@@ -0,0 +1,319 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "cpu_features.hpp"
+#include "haar.hpp"
+#include "sstx.hpp"
+#include "thread_pool.hpp"
+
+#if TSSSS_X86
+#include <immintrin.h>
+#endif
+
+//
+//  Wavelet-domain convolution kernels.
+//
+//  The color of a texel is the dot product of its kernel's coefficients with
+//  the RGBA radiance coefficients, R[4I+C] for coefficient I and channel C,
+//  as the RadianceCoef buffer holds them.  The dense kernels work on ROWS
+//  texels at once so that every radiance load is shared by ROWS kernels; the
+//  vector ones multiply whole RGBA rows of R by a kernel coefficient
+//  broadcast across the four lanes of its row, so R is used as it is stored.
+//
+//  A kernel gives the same sum whatever ROWS it is called with, so the
+//  result of a texel does not depend on how the texels are split up.
+//
+struct HaarConvolveKernels
+{
+	void (*dense[4])(const float *k, int ldk, int coefs, const float *r, float *color);
+	void (*sparse)(const SstxCoef *k, int count, const float *r, float *color);
+};
+
+template <int ROWS>
+static void denseScalar(const float *k, int ldk, int coefs, const float *r, float *color)
+{
+	for (int t = 0; t < ROWS; t++)
+	{
+		float sum[4] = {0, 0, 0, 0};
+		for (int i = 0; i < coefs; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				sum[c] += k[t * ldk + i] * r[4 * i + c];
+			}
+		}
+		for (int c = 0; c < 4; c++)
+		{
+			color[4 * t + c] = sum[c];
+		}
+	}
+}
+
+static void sparseScalar(const SstxCoef *k, int count, const float *r, float *color)
+{
+	float sum[4] = {0, 0, 0, 0};
+	for (int i = 0; i < count; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			sum[c] += k[i].value * r[4 * k[i].index + c];
+		}
+	}
+	for (int c = 0; c < 4; c++)
+	{
+		color[c] = sum[c];
+	}
+}
+
+#if TSSSS_X86
+// AVX2: 2 coefficients per register.
+// --------------------------------
+template <int ROWS>
+TSSSS_TARGET_AVX2 static void denseAvx2(const float *k, int ldk, int coefs, const float *r, float *color)
+{
+	__m256 acc[ROWS];
+	int i = 0;
+	for (int t = 0; t < ROWS; t++)
+	{
+		acc[t] = _mm256_setzero_ps();
+	}
+	for (; i + 2 <= coefs; i += 2)
+	{
+		__m256 rows = _mm256_loadu_ps(r + 4 * i);
+		for (int t = 0; t < ROWS; t++)
+		{
+			__m256 weight = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_broadcast_ss(k + t * ldk + i)),
+				_mm_broadcast_ss(k + t * ldk + i + 1), 1);
+			acc[t] = _mm256_fmadd_ps(weight, rows, acc[t]);
+		}
+	}
+	for (int t = 0; t < ROWS; t++)
+	{
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc[t]), _mm256_extractf128_ps(acc[t], 1));
+		for (int j = i; j < coefs; j++)
+		{
+			sum = _mm_fmadd_ps(_mm_set1_ps(k[t * ldk + j]), _mm_loadu_ps(r + 4 * j), sum);
+		}
+		_mm_storeu_ps(color + 4 * t, sum);
+	}
+}
+
+TSSSS_TARGET_AVX2 static void sparseAvx2(const SstxCoef *k, int count, const float *r, float *color)
+{
+	// Lanes 1 and 3 of a pair of entries hold their values.
+	const __m256i values = _mm256_setr_epi32(1, 1, 1, 1, 3, 3, 3, 3);
+	__m256 acc = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		__m256 weight = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps((const float *)(k + i))), values);
+		__m256 rows = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(r + 4 * k[i].index)),
+			_mm_loadu_ps(r + 4 * k[i + 1].index), 1);
+		acc = _mm256_fmadd_ps(weight, rows, acc);
+	}
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+	for (; i < count; i++)
+	{
+		sum = _mm_fmadd_ps(_mm_set1_ps(k[i].value), _mm_loadu_ps(r + 4 * k[i].index), sum);
+	}
+	_mm_storeu_ps(color, sum);
+}
+
+// AVX-512: 4 coefficients per register. The level does not imply FMA3, so
+// the 128 bit tails multiply and add.
+// --------------------------------
+TSSSS_TARGET_AVX512 static __m128 reduceAvx512(__m512 acc)
+{
+	alignas(64) float lanes[16];
+	_mm512_store_ps(lanes, acc);
+	return _mm_add_ps(_mm_add_ps(_mm_load_ps(lanes), _mm_load_ps(lanes + 4)),
+		_mm_add_ps(_mm_load_ps(lanes + 8), _mm_load_ps(lanes + 12)));
+}
+
+template <int ROWS>
+TSSSS_TARGET_AVX512 static void denseAvx512(const float *k, int ldk, int coefs, const float *r, float *color)
+{
+	const __m512i spread = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+	__m512 acc[ROWS];
+	int i = 0;
+	for (int t = 0; t < ROWS; t++)
+	{
+		acc[t] = _mm512_setzero_ps();
+	}
+	for (; i + 4 <= coefs; i += 4)
+	{
+		__m512 rows = _mm512_loadu_ps(r + 4 * i);
+		for (int t = 0; t < ROWS; t++)
+		{
+			__m512 weight = _mm512_permutexvar_ps(spread, _mm512_castps128_ps512(_mm_loadu_ps(k + t * ldk + i)));
+			acc[t] = _mm512_fmadd_ps(weight, rows, acc[t]);
+		}
+	}
+	for (int t = 0; t < ROWS; t++)
+	{
+		__m128 sum = reduceAvx512(acc[t]);
+		for (int j = i; j < coefs; j++)
+		{
+			sum = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(k[t * ldk + j]), _mm_loadu_ps(r + 4 * j)), sum);
+		}
+		_mm_storeu_ps(color + 4 * t, sum);
+	}
+}
+
+TSSSS_TARGET_AVX512 static void sparseAvx512(const SstxCoef *k, int count, const float *r, float *color)
+{
+	// Lanes 1, 3, 5 and 7 of four entries hold their values.
+	const __m512i values = _mm512_setr_epi32(1, 1, 1, 1, 3, 3, 3, 3, 5, 5, 5, 5, 7, 7, 7, 7);
+	__m512 acc = _mm512_setzero_ps();
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m512 weight = _mm512_permutexvar_ps(values, _mm512_castps256_ps512(_mm256_loadu_ps((const float *)(k + i))));
+		__m512 rows = _mm512_castps128_ps512(_mm_loadu_ps(r + 4 * k[i].index));
+		rows = _mm512_insertf32x4(rows, _mm_loadu_ps(r + 4 * k[i + 1].index), 1);
+		rows = _mm512_insertf32x4(rows, _mm_loadu_ps(r + 4 * k[i + 2].index), 2);
+		rows = _mm512_insertf32x4(rows, _mm_loadu_ps(r + 4 * k[i + 3].index), 3);
+		acc = _mm512_fmadd_ps(weight, rows, acc);
+	}
+	__m128 sum = reduceAvx512(acc);
+	for (; i < count; i++)
+	{
+		sum = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(k[i].value), _mm_loadu_ps(r + 4 * k[i].index)), sum);
+	}
+	_mm_storeu_ps(color, sum);
+}
+#endif
+
+static HaarConvolveKernels haarConvolveKernels()
+{
+	HaarConvolveKernels kernels = {
+		{denseScalar<1>, denseScalar<2>, denseScalar<3>, denseScalar<4>}, sparseScalar};
+#if TSSSS_X86
+	switch (simd_level())
+	{
+	case SimdLevel::AVX512:
+		kernels = {{denseAvx512<1>, denseAvx512<2>, denseAvx512<3>, denseAvx512<4>}, sparseAvx512};
+		break;
+	case SimdLevel::AVX2:
+		kernels = {{denseAvx2<1>, denseAvx2<2>, denseAvx2<3>, denseAvx2<4>}, sparseAvx2};
+		break;
+	default:
+		break;
+	}
+#endif
+	return kernels;
+}
+//****************************************************************************80
+
+void haar_convolve(int texels, int coefs, const float kernel[], const float radiance[], float color[],
+	ThreadPool &pool)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_CONVOLVE convolves radiance with a dense kernel per texel in the
+//    wavelet domain.
+//
+//  Discussion:
+//
+//    The kernels are transformed by WAVELET_2D_DUAL, the dual of the
+//    transform of the radiance, which is the transform itself for the
+//    orthonormal Haar wavelet.  So for every wavelet the convolution of the
+//    radiance with the kernel of a texel is the dot product of their
+//    coefficients.  Over all texels this is the product of the TEXELS x
+//    COEFS kernel matrix with the COEFS x 4 radiance matrix, which
+//    ConvolveCoef.cs.glsl and RenderPass3.fs.glsl compute on the GPU.
+//
+//    The texels are split over the threads of POOL, and each thread runs a
+//    vectorized kernel on 4 texels at a time, which loads every radiance
+//    row once for 4 kernel rows.  The radiance matrix is small enough to
+//    stay in cache, so the time goes into streaming the kernel matrix.
+//    The result of a texel does not depend on the size of the pool.
+//
+//  Parameters:
+//
+//    Input, int TEXELS, the number of texels.
+//
+//    Input, int COEFS, the number of coefficients per kernel.
+//
+//    Input, const float KERNEL[TEXELS*COEFS], the kernel of each texel,
+//    the COEFS coefficients of texel T starting at KERNEL[T*COEFS].
+//
+//    Input, const float RADIANCE[4*COEFS], the RGBA radiance coefficients.
+//
+//    Output, float COLOR[4*TEXELS], the RGBA color of each texel.
+//
+//    Input, ThreadPool &POOL, the threads to use.
+//
+{
+	HaarConvolveKernels kernels;
+
+	kernels = haarConvolveKernels();
+
+	pool.parallelFor(texels, [&](int t_lo, int t_hi, int /*thread*/) {
+		int t;
+		for (t = t_lo; t + 4 <= t_hi; t = t + 4)
+		{
+			kernels.dense[3](kernel + (size_t)t * coefs, coefs, coefs, radiance, color + 4 * (size_t)t);
+		}
+		if (t < t_hi)
+		{
+			kernels.dense[t_hi - t - 1](kernel + (size_t)t * coefs, coefs, coefs, radiance, color + 4 * (size_t)t);
+		}
+	});
+
+	return;
+}
+//****************************************************************************80
+
+void haar_convolve_sparse(int texels, int k, const SstxCoef kernel[], const float radiance[], float color[],
+	ThreadPool &pool)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_CONVOLVE_SPARSE convolves radiance with a sparse kernel per texel
+//    in the wavelet domain.
+//
+//  Discussion:
+//
+//    As HAAR_CONVOLVE, but each kernel keeps only K coefficients, as baked
+//    into .sstx files and uploaded to the KernelCoef buffer.  The radiance
+//    rows they pick are gathered, 4 at a time with AVX-512, 2 with AVX2.
+//    Padding entries with a value of 0 are allowed.
+//
+//  Parameters:
+//
+//    Input, int TEXELS, the number of texels.
+//
+//    Input, int K, the number of coefficients kept per kernel.
+//
+//    Input, const SstxCoef KERNEL[TEXELS*K], the kernel of each texel, the
+//    K entries of texel T starting at KERNEL[T*K].  Every index must be
+//    below the number of radiance coefficients.
+//
+//    Input, const float RADIANCE[], the RGBA radiance coefficients.
+//
+//    Output, float COLOR[4*TEXELS], the RGBA color of each texel.
+//
+//    Input, ThreadPool &POOL, the threads to use.
+//
+{
+	HaarConvolveKernels kernels;
+
+	kernels = haarConvolveKernels();
+
+	pool.parallelFor(texels, [&](int t_lo, int t_hi, int /*thread*/) {
+		for (int t = t_lo; t < t_hi; t++)
+		{
+			kernels.sparse(kernel + (size_t)t * k, k, radiance, color + 4 * (size_t)t);
+		}
+	});
+
+	return;
+}
@@ -0,0 +1,381 @@
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+#include "cpu_features.hpp"
+#include "haar.hpp"
+
+#if TSSSS_X86
+#include <immintrin.h>
+#endif
+
+//
+//  Integer Haar kernels.
+//
+//  The S-transform replaces the orthonormal butterfly with a lifting step
+//  that maps integers to integers and can be undone exactly:
+//
+//    split:  HI[I] = X[2I] - X[2I+1],  LO[I] = X[2I+1] + (HI[I] >> 1)
+//    merge:  X[2I+1] = LO[I] - (HI[I] >> 1),  X[2I] = HI[I] + X[2I+1]
+//
+//  and vsplit and vmerge do the same between two whole columns A and B.
+//  LO[I] is the floor of the mean of the pair, so the low-pass band keeps
+//  the range of the input, and each level adds one bit to the high-pass
+//  band.  The shift is arithmetic, which is what every compiler this
+//  project builds with does for negative ints.
+//
+//  split may be called with LO == X and merge writes X from the top down, so
+//  both work in place as long as HI points elsewhere.
+//
+struct HaarIntegerKernels
+{
+	void (*split)(const int *x, int *lo, int *hi, int k);
+	void (*merge)(const int *lo, const int *hi, int *x, int k);
+	void (*vsplit)(const int *a, const int *b, int *lo, int *hi, int m);
+	void (*vmerge)(const int *lo, const int *hi, int *a, int *b, int m);
+};
+
+static void splitScalar(const int *x, int *lo, int *hi, int k)
+{
+	for (int i = 0; i < k; i++)
+	{
+		int a = x[2 * i];
+		int b = x[2 * i + 1];
+		int d = a - b;
+		lo[i] = b + (d >> 1);
+		hi[i] = d;
+	}
+}
+
+static void mergeScalar(const int *lo, const int *hi, int *x, int k)
+{
+	for (int i = k - 1; 0 <= i; i--)
+	{
+		int d = hi[i];
+		int b = lo[i] - (d >> 1);
+		x[2 * i] = d + b;
+		x[2 * i + 1] = b;
+	}
+}
+
+static void vsplitScalar(const int *a, const int *b, int *lo, int *hi, int m)
+{
+	for (int i = 0; i < m; i++)
+	{
+		int d = a[i] - b[i];
+		lo[i] = b[i] + (d >> 1);
+		hi[i] = d;
+	}
+}
+
+static void vmergeScalar(const int *lo, const int *hi, int *a, int *b, int m)
+{
+	for (int i = 0; i < m; i++)
+	{
+		int d = hi[i];
+		int y = lo[i] - (d >> 1);
+		a[i] = d + y;
+		b[i] = y;
+	}
+}
+
+#if TSSSS_X86
+// See HAAR_2D_INVERSE_SIMD: short levels of the column pass are kept scalar
+// so that wide loads do not straddle stores still in flight.
+#define MERGE_MIN_VECTOR 256
+
+// AVX2: 8 lanes.
+// --------------------------------
+TSSSS_TARGET_AVX2 static void splitAvx2(const int *x, int *lo, int *hi, int k)
+{
+	int i = 0;
+	for (; i + 8 <= k; i += 8)
+	{
+		__m256 p = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(x + 2 * i)));
+		__m256 q = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(x + 2 * i + 8)));
+		// Same deinterleave as the float kernel, on the raw bits.
+		__m256i a = _mm256_castps_si256(_mm256_shuffle_ps(p, q, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m256i b = _mm256_castps_si256(_mm256_shuffle_ps(p, q, _MM_SHUFFLE(3, 1, 3, 1)));
+		a = _mm256_permute4x64_epi64(a, _MM_SHUFFLE(3, 1, 2, 0));
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(3, 1, 2, 0));
+		__m256i d = _mm256_sub_epi32(a, b);
+		_mm256_storeu_si256((__m256i *)(lo + i), _mm256_add_epi32(b, _mm256_srai_epi32(d, 1)));
+		_mm256_storeu_si256((__m256i *)(hi + i), d);
+	}
+	splitScalar(x + 2 * i, lo + i, hi + i, k - i);
+}
+
+TSSSS_TARGET_AVX2 static void mergeAvx2(const int *lo, const int *hi, int *x, int k)
+{
+	if (k < MERGE_MIN_VECTOR)
+	{
+		mergeScalar(lo, hi, x, k);
+		return;
+	}
+	int tail = k % 8;
+	mergeScalar(lo + k - tail, hi + k - tail, x + 2 * (k - tail), tail);
+	for (int i = k - tail - 8; 0 <= i; i -= 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)(lo + i));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(hi + i));
+		__m256i odd = _mm256_sub_epi32(s, _mm256_srai_epi32(d, 1));
+		__m256i even = _mm256_add_epi32(d, odd);
+		__m256i p = _mm256_unpacklo_epi32(even, odd);
+		__m256i q = _mm256_unpackhi_epi32(even, odd);
+		_mm256_storeu_si256((__m256i *)(x + 2 * i), _mm256_permute2x128_si256(p, q, 0x20));
+		_mm256_storeu_si256((__m256i *)(x + 2 * i + 8), _mm256_permute2x128_si256(p, q, 0x31));
+	}
+}
+
+TSSSS_TARGET_AVX2 static void vsplitAvx2(const int *a, const int *b, int *lo, int *hi, int m)
+{
+	int i = 0;
+	for (; i + 8 <= m; i += 8)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+		__m256i d = _mm256_sub_epi32(x, y);
+		_mm256_storeu_si256((__m256i *)(lo + i), _mm256_add_epi32(y, _mm256_srai_epi32(d, 1)));
+		_mm256_storeu_si256((__m256i *)(hi + i), d);
+	}
+	vsplitScalar(a + i, b + i, lo + i, hi + i, m - i);
+}
+
+TSSSS_TARGET_AVX2 static void vmergeAvx2(const int *lo, const int *hi, int *a, int *b, int m)
+{
+	int i = 0;
+	for (; i + 8 <= m; i += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)(lo + i));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(hi + i));
+		__m256i y = _mm256_sub_epi32(s, _mm256_srai_epi32(d, 1));
+		_mm256_storeu_si256((__m256i *)(a + i), _mm256_add_epi32(d, y));
+		_mm256_storeu_si256((__m256i *)(b + i), y);
+	}
+	vmergeScalar(lo + i, hi + i, a + i, b + i, m - i);
+}
+
+// AVX-512: 16 lanes.
+// --------------------------------
+TSSSS_TARGET_AVX512 static void splitAvx512(const int *x, int *lo, int *hi, int k)
+{
+	__m512i even_idx = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+	__m512i odd_idx = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+	int i = 0;
+	for (; i + 16 <= k; i += 16)
+	{
+		__m512i p = _mm512_loadu_si512(x + 2 * i);
+		__m512i q = _mm512_loadu_si512(x + 2 * i + 16);
+		__m512i a = _mm512_permutex2var_epi32(p, even_idx, q);
+		__m512i b = _mm512_permutex2var_epi32(p, odd_idx, q);
+		__m512i d = _mm512_sub_epi32(a, b);
+		_mm512_storeu_si512(lo + i, _mm512_add_epi32(b, _mm512_srai_epi32(d, 1)));
+		_mm512_storeu_si512(hi + i, d);
+	}
+	splitScalar(x + 2 * i, lo + i, hi + i, k - i);
+}
+
+TSSSS_TARGET_AVX512 static void mergeAvx512(const int *lo, const int *hi, int *x, int k)
+{
+	if (k < MERGE_MIN_VECTOR)
+	{
+		mergeScalar(lo, hi, x, k);
+		return;
+	}
+	__m512i lo_idx = _mm512_set_epi32(23, 7, 22, 6, 21, 5, 20, 4, 19, 3, 18, 2, 17, 1, 16, 0);
+	__m512i hi_idx = _mm512_set_epi32(31, 15, 30, 14, 29, 13, 28, 12, 27, 11, 26, 10, 25, 9, 24, 8);
+	int tail = k % 16;
+	mergeScalar(lo + k - tail, hi + k - tail, x + 2 * (k - tail), tail);
+	for (int i = k - tail - 16; 0 <= i; i -= 16)
+	{
+		__m512i s = _mm512_loadu_si512(lo + i);
+		__m512i d = _mm512_loadu_si512(hi + i);
+		__m512i odd = _mm512_sub_epi32(s, _mm512_srai_epi32(d, 1));
+		__m512i even = _mm512_add_epi32(d, odd);
+		_mm512_storeu_si512(x + 2 * i, _mm512_permutex2var_epi32(even, lo_idx, odd));
+		_mm512_storeu_si512(x + 2 * i + 16, _mm512_permutex2var_epi32(even, hi_idx, odd));
+	}
+}
+
+TSSSS_TARGET_AVX512 static void vsplitAvx512(const int *a, const int *b, int *lo, int *hi, int m)
+{
+	int i = 0;
+	for (; i + 16 <= m; i += 16)
+	{
+		__m512i x = _mm512_loadu_si512(a + i);
+		__m512i y = _mm512_loadu_si512(b + i);
+		__m512i d = _mm512_sub_epi32(x, y);
+		_mm512_storeu_si512(lo + i, _mm512_add_epi32(y, _mm512_srai_epi32(d, 1)));
+		_mm512_storeu_si512(hi + i, d);
+	}
+	vsplitScalar(a + i, b + i, lo + i, hi + i, m - i);
+}
+
+TSSSS_TARGET_AVX512 static void vmergeAvx512(const int *lo, const int *hi, int *a, int *b, int m)
+{
+	int i = 0;
+	for (; i + 16 <= m; i += 16)
+	{
+		__m512i s = _mm512_loadu_si512(lo + i);
+		__m512i d = _mm512_loadu_si512(hi + i);
+		__m512i y = _mm512_sub_epi32(s, _mm512_srai_epi32(d, 1));
+		_mm512_storeu_si512(a + i, _mm512_add_epi32(d, y));
+		_mm512_storeu_si512(b + i, y);
+	}
+	vmergeScalar(lo + i, hi + i, a + i, b + i, m - i);
+}
+#endif
+
+static HaarIntegerKernels haarIntegerKernels()
+{
+	HaarIntegerKernels kernels = {splitScalar, mergeScalar, vsplitScalar, vmergeScalar};
+#if TSSSS_X86
+	switch (simd_level())
+	{
+	case SimdLevel::AVX512:
+		kernels = {splitAvx512, mergeAvx512, vsplitAvx512, vmergeAvx512};
+		break;
+	case SimdLevel::AVX2:
+		kernels = {splitAvx2, mergeAvx2, vsplitAvx2, vmergeAvx2};
+		break;
+	default:
+		break;
+	}
+#endif
+	return kernels;
+}
+//****************************************************************************80
+
+void haar_2d_integer(int m, int n, int u[], int w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INTEGER computes the integer Haar transform (S-transform) of an
+//    array.
+//
+//  Discussion:
+//
+//    The coefficients are laid out as in HAAR_2D: every column is
+//    transformed, then every row, the low-pass half of each level going to
+//    the front.  Unlike HAAR_2D nothing is scaled, so the low-pass band
+//    holds floored means rather than sums over sqrt(2), and
+//    HAAR_2D_INVERSE_INTEGER restores U exactly.
+//
+//    For inputs of B bits the coefficients need at most B + 2 bits: one for
+//    the high-pass band of the columns and one more for that of the rows.
+//    Quantized 16 bit kernels therefore fit easily in an int.
+//
+//    The kernels are picked at run time as in HAAR_2D_SIMD; every choice
+//    gives the same coefficients.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, int U[M*N], the array to be transformed.
+//
+//    Workspace, int W[HAAR_2D_WORK_SIZE(M,N)].
+//
+{
+	int j;
+	int k;
+	int k_max;
+	HaarIntegerKernels kernels;
+
+	kernels = haarIntegerKernels();
+	//
+	//  Transform all columns.
+	//
+	k_max = 1;
+	while (k_max * 2 <= m)
+	{
+		k_max = k_max * 2;
+	}
+	for (j = 0; j < n; j++)
+	{
+		int *x = u + j * m;
+		k = k_max;
+		while (1 < k)
+		{
+			k = k / 2;
+			kernels.split(x, x, w, k);
+			memcpy(x + k, w, k * sizeof(int));
+		}
+	}
+	//
+	//  Transform all rows.
+	//
+	k = 1;
+	while (k * 2 <= n)
+	{
+		k = k * 2;
+	}
+	while (1 < k)
+	{
+		k = k / 2;
+		for (j = 0; j < k; j++)
+		{
+			kernels.vsplit(u + 2 * j * m, u + (2 * j + 1) * m, u + j * m, w + j * m, m);
+		}
+		memcpy(u + k * m, w, (size_t)k * m * sizeof(int));
+	}
+
+	return;
+}
+//****************************************************************************80
+
+void haar_2d_inverse_integer(int m, int n, int u[], int w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INVERSE_INTEGER inverts the integer Haar transform of an array.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, int U[M*N], the array to be transformed.
+//
+//    Workspace, int W[HAAR_2D_WORK_SIZE(M,N)].
+//
+{
+	int j;
+	int k;
+	HaarIntegerKernels kernels;
+
+	kernels = haarIntegerKernels();
+	//
+	//  Inverse transform of all rows.
+	//
+	k = 1;
+	while (k * 2 <= n)
+	{
+		memcpy(w, u + k * m, (size_t)k * m * sizeof(int));
+		for (j = k - 1; 0 <= j; j--)
+		{
+			kernels.vmerge(u + j * m, w + j * m, u + 2 * j * m, u + (2 * j + 1) * m, m);
+		}
+		k = k * 2;
+	}
+	//
+	//  Inverse transform of all columns.
+	//
+	for (j = 0; j < n; j++)
+	{
+		int *x = u + j * m;
+		k = 1;
+		while (k * 2 <= m)
+		{
+			memcpy(w, x + k, k * sizeof(int));
+			kernels.merge(x, w, x, k);
+			k = k * 2;
+		}
+	}
+
+	return;
+}
@@ -0,0 +1,424 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "haar.hpp"
+#include "sstx.hpp"
+#include "thread_pool.hpp"
+
+//
+//  Randomized SVD of a matrix of sparse rows.
+//
+//  The products with the N x DIM matrix A go through its DIM x DIM Gram
+//  matrix A^T A, which is built once from the nonzeros, a row of it per
+//  column of A, on the threads in any order; every sum over the rows of A is
+//  taken in their order, so the result does not depend on the number of
+//  threads.  The sketch keeps LOWRANK_OVERSAMPLE columns beyond the largest
+//  rank.
+//
+#define LOWRANK_CHUNK 1024
+#define LOWRANK_OVERSAMPLE 10
+
+// Eigenvalues LAMBDA[L], largest first, and eigenvectors, the columns of
+// W[L*L], of the symmetric A[L*L] by cyclic Jacobi rotations. A is
+// overwritten.
+static void symmetricEigen(int l, double a[], double lambda[], double w[])
+{
+	vector<double> v((size_t)l * l, 0.0);
+	for (int i = 0; i < l; i++)
+	{
+		v[(size_t)i * l + i] = 1.0;
+	}
+	for (int sweep = 0; sweep < 64; sweep++)
+	{
+		double diag = 0.0;
+		double off = 0.0;
+		for (int p = 0; p < l; p++)
+		{
+			diag = diag + a[(size_t)p * l + p] * a[(size_t)p * l + p];
+			for (int q = p + 1; q < l; q++)
+			{
+				off = off + a[(size_t)p * l + q] * a[(size_t)p * l + q];
+			}
+		}
+		if (off <= 1e-30 * diag)
+		{
+			break;
+		}
+		for (int p = 0; p < l; p++)
+		{
+			for (int q = p + 1; q < l; q++)
+			{
+				double apq = a[(size_t)p * l + q];
+				if (apq == 0.0)
+				{
+					continue;
+				}
+				double theta = (a[(size_t)q * l + q] - a[(size_t)p * l + p]) / (2.0 * apq);
+				double t = (theta < 0.0 ? -1.0 : 1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0);
+				double s = t * c;
+				for (int i = 0; i < l; i++)
+				{
+					double aip = a[(size_t)i * l + p];
+					double aiq = a[(size_t)i * l + q];
+					a[(size_t)i * l + p] = c * aip - s * aiq;
+					a[(size_t)i * l + q] = s * aip + c * aiq;
+				}
+				for (int i = 0; i < l; i++)
+				{
+					double api = a[(size_t)p * l + i];
+					double aqi = a[(size_t)q * l + i];
+					a[(size_t)p * l + i] = c * api - s * aqi;
+					a[(size_t)q * l + i] = s * api + c * aqi;
+				}
+				for (int i = 0; i < l; i++)
+				{
+					double vip = v[(size_t)i * l + p];
+					double viq = v[(size_t)i * l + q];
+					v[(size_t)i * l + p] = c * vip - s * viq;
+					v[(size_t)i * l + q] = s * vip + c * viq;
+				}
+			}
+		}
+	}
+
+	vector<int> order(l);
+	for (int i = 0; i < l; i++)
+	{
+		order[i] = i;
+	}
+	stable_sort(order.begin(), order.end(),
+		[&](int i, int j) { return a[(size_t)i * l + i] > a[(size_t)j * l + j]; });
+	for (int j = 0; j < l; j++)
+	{
+		lambda[j] = a[(size_t)order[j] * l + order[j]];
+		for (int i = 0; i < l; i++)
+		{
+			w[(size_t)i * l + j] = v[(size_t)i * l + order[j]];
+		}
+	}
+}
+
+// T[L*L] such that M T has orthonormal columns, for the Gram matrix G[L*L]
+// of M, which is overwritten. Columns of M that are 0 to within rounding
+// give columns of 0.
+static void whitening(int l, double g[], double t[])
+{
+	vector<double> lambda(l);
+	vector<double> w((size_t)l * l);
+	symmetricEigen(l, g, lambda.data(), w.data());
+	for (int j = 0; j < l; j++)
+	{
+		double scale = 0.0 < lambda[j] && 1e-12 * lambda[0] < lambda[j] ? 1.0 / sqrt(lambda[j]) : 0.0;
+		for (int i = 0; i < l; i++)
+		{
+			t[(size_t)i * l + j] = w[(size_t)i * l + j] * scale;
+		}
+	}
+}
+
+// Orthonormalizes the columns of the dense M[ROWS*L], twice for accuracy.
+static void orthonormalize(int rows, int l, double m[])
+{
+	vector<double> g((size_t)l * l);
+	vector<double> t((size_t)l * l);
+	vector<double> row(l);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		fill(g.begin(), g.end(), 0.0);
+		for (int r = 0; r < rows; r++)
+		{
+			const double *mr = m + (size_t)r * l;
+			for (int i = 0; i < l; i++)
+			{
+				for (int j = 0; j < l; j++)
+				{
+					g[(size_t)i * l + j] = g[(size_t)i * l + j] + mr[i] * mr[j];
+				}
+			}
+		}
+		whitening(l, g.data(), t.data());
+		for (int r = 0; r < rows; r++)
+		{
+			double *mr = m + (size_t)r * l;
+			fill(row.begin(), row.end(), 0.0);
+			for (int i = 0; i < l; i++)
+			{
+				for (int j = 0; j < l; j++)
+				{
+					row[j] = row[j] + mr[i] * t[(size_t)i * l + j];
+				}
+			}
+			copy(row.begin(), row.end(), mr);
+		}
+	}
+}
+//****************************************************************************80
+
+int haar_lowrank(int n, int k, const SstxCoef x[], int dim, double error, int max_rank, int power_iterations,
+	uint64_t seed, ThreadPool &pool, float basis[], float weights[], double *rank_error)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_LOWRANK factors sparse coefficient vectors through a low-rank basis.
+//
+//  Discussion:
+//
+//    The kernels of neighboring texels are much alike, so the N x DIM matrix
+//    A of the vectors is close to one of low rank.  A randomized SVD finds
+//    it: the range of A^T is sketched by the product of A^T A with
+//    MAX_RANK + 10 random vectors, from R8_UNIFORM_01_COUNTER(SEED,I),
+//    refined by POWER_ITERATIONS more products, and the right singular
+//    vectors of A projected on the sketch are the basis.  The rank is the
+//    smallest that leaves at most ERROR of the squared norm of A, or
+//    MAX_RANK if none up to it does, and the weights of a vector are its
+//    dot products with the basis vectors.
+//
+//    A has N rows but only DIM columns, so the sketch works on A^T A
+//    instead of A, which squares the singular values and needs no N x L
+//    storage: the products with it and the Rayleigh-Ritz step are DIM x DIM
+//    work in double precision, on the threads of POOL where it matters.
+//    The result does not depend on the number of threads.
+//
+//    A dot product with a vector is then RANK dot products of its weights
+//    with the dot products of the basis, so HAAR_CONVOLVE of the basis with
+//    a radiance block gives the radiance block of HAAR_CONVOLVE of the
+//    weights.
+//
+//  Parameters:
+//
+//    Input, int N, the number of vectors.
+//
+//    Input, int K, the number of coefficients per vector.
+//
+//    Input, const SstxCoef X[N*K], the vectors, the K entries of vector I
+//    starting at X[I*K], as the kernels of a .sstx file.  Padding entries
+//    with a value of 0 are allowed.
+//
+//    Input, int DIM, the dimension of the vectors.  Every index must be
+//    below it.
+//
+//    Input, double ERROR, the largest share of the squared norm of the
+//    vectors the factorization may lose.
+//
+//    Input, int MAX_RANK, the largest rank, at least 1.
+//
+//    Input, int POWER_ITERATIONS, the number of products with A^T A that
+//    refine the sketch, 1 or 2 for a slowly decaying spectrum.
+//
+//    Input, uint64_t SEED, selects the random sketch.
+//
+//    Input, ThreadPool &POOL, the threads to use.
+//
+//    Output, float BASIS[MAX_RANK*DIM], the orthonormal basis vectors,
+//    vector J starting at BASIS[J*DIM].  Only the first RANK are set.
+//
+//    Output, float WEIGHTS[N*MAX_RANK], the weights, RANK per vector, those
+//    of vector I starting at WEIGHTS[I*RANK].
+//
+//    Output, double *RANK_ERROR, the squared norm of the vectors the
+//    factorization loses over their squared norm.
+//
+//    Output, int HAAR_LOWRANK, the rank RANK.
+//
+{
+	int chunks;
+	int i;
+	int j;
+	int l;
+	int rank;
+	double norm2_sum;
+
+	l = min(max_rank + LOWRANK_OVERSAMPLE, min(dim, n));
+	max_rank = min(max_rank, l);
+	chunks = (n + LOWRANK_CHUNK - 1) / LOWRANK_CHUNK;
+	//
+	//  A^T by columns, the rows of each in order.
+	//
+	vector<size_t> col_start(dim + 1, 0);
+	for (i = 0; i < n * k; i++)
+	{
+		if (x[i].value != 0.0f)
+		{
+			col_start[x[i].index + 1]++;
+		}
+	}
+	for (j = 0; j < dim; j++)
+	{
+		col_start[j + 1] = col_start[j + 1] + col_start[j];
+	}
+	vector<int> col_row(col_start[dim]);
+	vector<float> col_value(col_start[dim]);
+	{
+		vector<size_t> next(col_start.begin(), col_start.end() - 1);
+		for (i = 0; i < n * k; i++)
+		{
+			if (x[i].value != 0.0f)
+			{
+				col_row[next[x[i].index]] = i / k;
+				col_value[next[x[i].index]++] = x[i].value;
+			}
+		}
+	}
+	norm2_sum = 0.0;
+	for (i = 0; i < n * k; i++)
+	{
+		norm2_sum = norm2_sum + (double)x[i].value * x[i].value;
+	}
+
+	//
+	//  C = A^T A, row D of it from the rows of A with a nonzero in column D.
+	//
+	vector<double> gram((size_t)dim * dim);
+	pool.parallelFor(dim, [&](int d_lo, int d_hi, int /*thread*/) {
+		for (int d = d_lo; d < d_hi; d++)
+		{
+			double *cd = gram.data() + (size_t)d * dim;
+			fill(cd, cd + dim, 0.0);
+			for (size_t e = col_start[d]; e < col_start[d + 1]; e++)
+			{
+				const SstxCoef *xr = x + (size_t)col_row[e] * k;
+				double value = col_value[e];
+				for (int q = 0; q < k; q++)
+				{
+					cd[xr[q].index] = cd[xr[q].index] + value * xr[q].value;
+				}
+			}
+		}
+	});
+	//
+	//  Subspace iteration from a random sketch, Z = C Z.
+	//
+	vector<double> z((size_t)dim * l);
+	vector<double> cz((size_t)dim * l);
+	for (i = 0; i < dim * l; i++)
+	{
+		z[i] = 2.0 * r8_uniform_01_counter(seed, i) - 1.0;
+	}
+	auto gramTimes = [&]() {
+		pool.parallelFor(dim, [&](int d_lo, int d_hi, int /*thread*/) {
+			for (int d = d_lo; d < d_hi; d++)
+			{
+				const double *cd = gram.data() + (size_t)d * dim;
+				double *out = cz.data() + (size_t)d * l;
+				fill(out, out + l, 0.0);
+				for (int e = 0; e < dim; e++)
+				{
+					const double *ze = z.data() + (size_t)e * l;
+					for (int q = 0; q < l; q++)
+					{
+						out[q] = out[q] + cd[e] * ze[q];
+					}
+				}
+			}
+		});
+	};
+	for (int pass = 0; pass <= power_iterations; pass++)
+	{
+		orthonormalize(dim, l, z.data());
+		gramTimes();
+		z.swap(cz);
+	}
+	//
+	//  Rayleigh-Ritz: the eigenvectors U of H = Z^T C Z, for Z orthonormal,
+	//  give the right singular vectors Z U of A and its eigenvalues the
+	//  squared singular values.
+	//
+	orthonormalize(dim, l, z.data());
+	gramTimes();
+	vector<double> g((size_t)l * l, 0.0);
+	for (int d = 0; d < dim; d++)
+	{
+		const double *zr = z.data() + (size_t)d * l;
+		const double *czr = cz.data() + (size_t)d * l;
+		for (int p = 0; p < l; p++)
+		{
+			for (int q = 0; q < l; q++)
+			{
+				g[(size_t)p * l + q] = g[(size_t)p * l + q] + zr[p] * czr[q];
+			}
+		}
+	}
+	vector<double> sigma2(l);
+	vector<double> u((size_t)l * l);
+	symmetricEigen(l, g.data(), sigma2.data(), u.data());
+
+	double kept = 0.0;
+	for (rank = 0; rank < max_rank; rank++)
+	{
+		if (norm2_sum - kept <= error * norm2_sum || !(1e-12 * sigma2[0] < sigma2[rank]))
+		{
+			break;
+		}
+		kept = kept + sigma2[rank];
+	}
+
+	vector<double> v((size_t)dim * max(rank, 1));
+	for (int d = 0; d < dim; d++)
+	{
+		for (j = 0; j < rank; j++)
+		{
+			double sum = 0.0;
+			for (int p = 0; p < l; p++)
+			{
+				sum = sum + z[(size_t)d * l + p] * u[(size_t)p * l + j];
+			}
+			v[(size_t)d * rank + j] = sum;
+		}
+	}
+	if (0 < rank)
+	{
+		orthonormalize(dim, rank, v.data());
+	}
+	for (j = 0; j < rank; j++)
+	{
+		for (int d = 0; d < dim; d++)
+		{
+			basis[(size_t)j * dim + d] = (float)v[(size_t)d * rank + j];
+		}
+	}
+	//
+	//  The weights, and what the orthonormal basis keeps of each vector.
+	//
+	vector<double> acc((size_t)pool.size() * max(rank, 1));
+	vector<double> kept_chunk(chunks, 0.0);
+	pool.parallelFor(chunks, [&](int c_lo, int c_hi, int thread) {
+		double *wr = acc.data() + (size_t)thread * max(rank, 1);
+		for (int c = c_lo; c < c_hi; c++)
+		{
+			for (int r = c * LOWRANK_CHUNK; r < min((c + 1) * LOWRANK_CHUNK, n); r++)
+			{
+				fill(wr, wr + rank, 0.0);
+				for (int e = 0; e < k; e++)
+				{
+					const SstxCoef &xe = x[(size_t)r * k + e];
+					const double *vr = v.data() + (size_t)xe.index * rank;
+					for (int q = 0; q < rank; q++)
+					{
+						wr[q] = wr[q] + xe.value * vr[q];
+					}
+				}
+				for (int q = 0; q < rank; q++)
+				{
+					weights[(size_t)r * rank + q] = (float)wr[q];
+					kept_chunk[c] = kept_chunk[c] + wr[q] * wr[q];
+				}
+			}
+		}
+	});
+	kept = 0.0;
+	for (int c = 0; c < chunks; c++)
+	{
+		kept = kept + kept_chunk[c];
+	}
+	*rank_error = 0.0 < norm2_sum ? max(norm2_sum - kept, 0.0) / norm2_sum : 0.0;
+
+	return rank;
+}
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "cpu_features.hpp"
+#include "haar.hpp"
+#include "thread_pool.hpp"
+
+#if TSSSS_X86
+#include <immintrin.h>
+#endif
+
+//
+//  Error metric kernels.
+//
+//  A kernel accumulates, over whole groups of 8 pixels of C channels, the
+//  squared difference, the squared reference and the largest absolute
+//  difference into 8C partial sums each.  Partial K only sees entries K,
+//  K + 8C, K + 16C, ... of the range, which are all in channel K mod C, so
+//  the sums can be split by channel afterwards, and the vector kernels keep
+//  them in C registers of 8 doubles (2C of 4 for AVX2), adding in the same
+//  order as the scalar loop.
+//
+#define METRIC_MAX_CHANNELS 8
+#define METRIC_GROUP 8
+// Pixels per block. Blocks are summed on their own and then added pairwise,
+// so the result does not depend on how the blocks are spread over threads.
+#define METRIC_BLOCK_PIXELS 4096
+
+struct MetricSums
+{
+	double ssd[METRIC_GROUP * METRIC_MAX_CHANNELS];
+	double ssr[METRIC_GROUP * METRIC_MAX_CHANNELS];
+	double max_abs[METRIC_GROUP * METRIC_MAX_CHANNELS];
+};
+
+template <typename T>
+static void metricScalar(const T *a, const T *b, size_t n, int c, MetricSums &s)
+{
+	size_t group = (size_t)METRIC_GROUP * c;
+	for (size_t g = 0; g < n; g += group)
+	{
+		size_t count = min(group, n - g);
+		for (size_t k = 0; k < count; k++)
+		{
+			double r = (double)b[g + k];
+			double d = (double)a[g + k] - r;
+			double e = fabs(d);
+			s.ssd[k] += d * d;
+			s.ssr[k] += r * r;
+			s.max_abs[k] = s.max_abs[k] < e ? e : s.max_abs[k];
+		}
+	}
+}
+
+#if TSSSS_X86
+// AVX2: 4 doubles per register.
+// --------------------------------
+TSSSS_TARGET_AVX2 static __m256d loadAvx2(const double *x)
+{
+	return _mm256_loadu_pd(x);
+}
+
+TSSSS_TARGET_AVX2 static __m256d loadAvx2(const float *x)
+{
+	return _mm256_cvtps_pd(_mm_loadu_ps(x));
+}
+
+template <typename T>
+TSSSS_TARGET_AVX2 static void metricAvx2(const T *a, const T *b, size_t n, int c, MetricSums &s)
+{
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	int regs = 2 * c;
+	size_t group = (size_t)METRIC_GROUP * c;
+	size_t groups = n / group;
+	for (int q = 0; q < regs; q++)
+	{
+		__m256d ssd = _mm256_loadu_pd(s.ssd + 4 * q);
+		__m256d ssr = _mm256_loadu_pd(s.ssr + 4 * q);
+		__m256d mx = _mm256_loadu_pd(s.max_abs + 4 * q);
+		for (size_t g = 0; g < groups; g++)
+		{
+			__m256d r = loadAvx2(b + g * group + 4 * q);
+			__m256d d = _mm256_sub_pd(loadAvx2(a + g * group + 4 * q), r);
+			ssd = _mm256_add_pd(ssd, _mm256_mul_pd(d, d));
+			ssr = _mm256_add_pd(ssr, _mm256_mul_pd(r, r));
+			mx = _mm256_max_pd(mx, _mm256_andnot_pd(sign, d));
+		}
+		_mm256_storeu_pd(s.ssd + 4 * q, ssd);
+		_mm256_storeu_pd(s.ssr + 4 * q, ssr);
+		_mm256_storeu_pd(s.max_abs + 4 * q, mx);
+	}
+	metricScalar(a + groups * group, b + groups * group, n - groups * group, c, s);
+}
+
+// AVX-512: 8 doubles per register.
+// --------------------------------
+TSSSS_TARGET_AVX512 static __m512d loadAvx512(const double *x)
+{
+	return _mm512_loadu_pd(x);
+}
+
+TSSSS_TARGET_AVX512 static __m512d loadAvx512(const float *x)
+{
+	return _mm512_cvtps_pd(_mm256_loadu_ps(x));
+}
+
+template <typename T>
+TSSSS_TARGET_AVX512 static void metricAvx512(const T *a, const T *b, size_t n, int c, MetricSums &s)
+{
+	size_t group = (size_t)METRIC_GROUP * c;
+	size_t groups = n / group;
+	for (int q = 0; q < c; q++)
+	{
+		__m512d ssd = _mm512_loadu_pd(s.ssd + 8 * q);
+		__m512d ssr = _mm512_loadu_pd(s.ssr + 8 * q);
+		__m512d mx = _mm512_loadu_pd(s.max_abs + 8 * q);
+		for (size_t g = 0; g < groups; g++)
+		{
+			__m512d r = loadAvx512(b + g * group + 8 * q);
+			__m512d d = _mm512_sub_pd(loadAvx512(a + g * group + 8 * q), r);
+			ssd = _mm512_add_pd(ssd, _mm512_mul_pd(d, d));
+			ssr = _mm512_add_pd(ssr, _mm512_mul_pd(r, r));
+			mx = _mm512_max_pd(mx, _mm512_abs_pd(d));
+		}
+		_mm512_storeu_pd(s.ssd + 8 * q, ssd);
+		_mm512_storeu_pd(s.ssr + 8 * q, ssr);
+		_mm512_storeu_pd(s.max_abs + 8 * q, mx);
+	}
+	metricScalar(a + groups * group, b + groups * group, n - groups * group, c, s);
+}
+#endif
+
+template <typename T>
+static void (*metricKernel())(const T *a, const T *b, size_t n, int c, MetricSums &s)
+{
+#if TSSSS_X86
+	switch (simd_level())
+	{
+	case SimdLevel::AVX512:
+		return metricAvx512<T>;
+	case SimdLevel::AVX2:
+		return metricAvx2<T>;
+	default:
+		break;
+	}
+#endif
+	return metricScalar<T>;
+}
+
+// Squared difference, squared reference and largest difference of a block
+// or a channel.
+struct MetricTotal
+{
+	double ssd;
+	double ssr;
+	double max_abs;
+};
+
+// Adds TOTAL[LO, HI) pairwise.
+static MetricTotal metricPairwise(const MetricTotal total[], size_t lo, size_t hi)
+{
+	if (hi - lo == 1)
+	{
+		return total[lo];
+	}
+	size_t mid = lo + (hi - lo) / 2;
+	MetricTotal x = metricPairwise(total, lo, mid);
+	MetricTotal y = metricPairwise(total, mid, hi);
+	return {x.ssd + y.ssd, x.ssr + y.ssr, fmax(x.max_abs, y.max_abs)};
+}
+
+static ImageError metricError(MetricTotal total, double count, double peak)
+{
+	ImageError error;
+	double inf = numeric_limits<double>::infinity();
+
+	error.fro = sqrt(total.ssd);
+	error.max_abs = total.max_abs;
+	error.rel_l2 = 0.0 < total.ssr ? sqrt(total.ssd / total.ssr) : (total.ssd == 0.0 ? 0.0 : inf);
+	error.psnr = 0.0 < total.ssd ? 10.0 * log10(peak * peak * count / total.ssd) : inf;
+
+	return error;
+}
+//****************************************************************************80
+
+template <typename T>
+ImageError image_error(int m, int n, int channels, const T a[], const T b[], double peak, ThreadPool &pool,
+	ImageError channel_error[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    IMAGE_ERROR measures the difference between an image and a reference.
+//
+//  Discussion:
+//
+//    In one pass over the images, returns the Frobenius norm of A - B (as
+//    R8MAT_DIF_FRO), the PSNR for values of range PEAK, the largest
+//    absolute difference and the L2 norm of A - B relative to that of B.
+//
+//    The M*N pixels of CHANNELS interleaved channels are cut into blocks
+//    of a fixed size, each summed by a vector kernel on a thread of POOL
+//    in double precision, and the block sums are added pairwise.  The
+//    blocks and the order of every addition are the same for any pool, so
+//    the result is too.
+//
+//    The PSNR of identical images is infinite, and so is the relative
+//    error against a zero reference unless A is zero too.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the images.
+//
+//    Input, int CHANNELS, the number of interleaved channels, 1 to 8.
+//
+//    Input, const T A[M*N*CHANNELS], the image.
+//
+//    Input, const T B[M*N*CHANNELS], the reference.
+//
+//    Input, double PEAK, the range of the values, for the PSNR.
+//
+//    Input, ThreadPool &POOL, the threads to use.
+//
+//    Output, ImageError CHANNEL_ERROR[CHANNELS], the error of each channel,
+//    if not null.
+//
+//    Output, ImageError IMAGE_ERROR, the error over all channels.
+//
+{
+	int blocks;
+	int ch;
+	int k;
+	size_t block_size;
+	size_t count;
+	void (*kernel)(const T *a, const T *b, size_t n, int c, MetricSums &s);
+
+	count = (size_t)m * n * channels;
+	block_size = (size_t)METRIC_BLOCK_PIXELS * channels;
+	blocks = (int)max((count + block_size - 1) / block_size, (size_t)1);
+	kernel = metricKernel<T>();
+	//
+	//  TOTAL[CH + B * CHANNELS] holds channel CH of block B.
+	//
+	vector<MetricTotal> total((size_t)blocks * channels);
+
+	pool.parallelFor(blocks, [&](int b_lo, int b_hi, int /*thread*/) {
+		for (int blk = b_lo; blk < b_hi; blk++)
+		{
+			MetricSums s;
+			memset(&s, 0, sizeof(s));
+			size_t lo = (size_t)blk * block_size;
+			size_t hi = min(lo + block_size, count);
+			if (lo < hi)
+			{
+				kernel(a + lo, b + lo, hi - lo, channels, s);
+			}
+			for (int c = 0; c < channels; c++)
+			{
+				MetricTotal t = {0.0, 0.0, 0.0};
+				for (int j = c; j < METRIC_GROUP * channels; j = j + channels)
+				{
+					t.ssd = t.ssd + s.ssd[j];
+					t.ssr = t.ssr + s.ssr[j];
+					t.max_abs = fmax(t.max_abs, s.max_abs[j]);
+				}
+				total[c + (size_t)blk * channels] = t;
+			}
+		}
+	});
+	//
+	//  Add up the blocks of each channel, then the channels.
+	//
+	vector<MetricTotal> column(blocks);
+	vector<MetricTotal> channel(channels);
+	for (ch = 0; ch < channels; ch++)
+	{
+		for (k = 0; k < blocks; k++)
+		{
+			column[k] = total[ch + (size_t)k * channels];
+		}
+		channel[ch] = metricPairwise(column.data(), 0, blocks);
+		if (channel_error)
+		{
+			channel_error[ch] = metricError(channel[ch], (double)m * n, peak);
+		}
+	}
+
+	return metricError(metricPairwise(channel.data(), 0, channels), (double)count, peak);
+}
+template ImageError image_error<float>(int m, int n, int channels, const float a[], const float b[], double peak,
+	ThreadPool &pool, ImageError channel_error[]);
+template ImageError image_error<double>(int m, int n, int channels, const double a[], const double b[], double peak,
+	ThreadPool &pool, ImageError channel_error[]);
@@ -0,0 +1,973 @@
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "cpu_features.hpp"
+#include "haar.hpp"
+#include "thread_pool.hpp"
+
+#if TSSSS_X86
+#include <immintrin.h>
+#endif
+
+// Panel height for the row pass on THREADS threads: that of the blocked
+// transform, lowered if need be so that every thread gets a panel.  It is
+// kept a multiple of 8 rows where M allows, as in HAAR_2D_PANEL_ROWS.
+static int parallelPanelRows(int m, int n, int elem_size, int threads)
+{
+	int share;
+
+	share = m / i4_max(threads, 1);
+	if (8 <= share)
+	{
+		share = (share / 8) * 8;
+	}
+	return i4_max(i4_min(haar_2d_panel_rows(m, n, elem_size), share), 1);
+}
+
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_parallel(int m, int n, T u[], ThreadPool &pool)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_PARALLEL computes the Haar transform of an array on a thread pool.
+//
+//  Discussion:
+//
+//    The columns are split across the threads of POOL, then the rows are
+//    split into panels (see HAAR_2D_BLOCKED), at least one per thread, and
+//    the panels are split across the threads.  Every column and every
+//    panel is transformed exactly as in HAAR_2D, so the coefficients are
+//    bit-identical to it for any number of threads.
+//
+//    Each thread gets its own workspace, allocated once per call.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Input, ThreadPool &POOL, the threads to run on.
+//
+{
+	int panel;
+	int panels;
+	int work_size;
+	vector<T> work;
+
+	panel = parallelPanelRows(m, n, sizeof(T), pool.size());
+	panels = (m + panel - 1) / panel;
+	work_size = haar_2d_blocked_work_size(m, n, panel);
+	work.resize((size_t)work_size * pool.size());
+	//
+	//  Transform all columns.
+	//
+	pool.parallelFor(n, [&](int j_lo, int j_hi, int t) {
+		T *w = work.data() + (size_t)work_size * t;
+		for (int j = j_lo; j < j_hi; j++)
+		{
+			haar_1d(m, u + (size_t)j * m, w);
+		}
+	});
+	//
+	//  Transform all rows, one panel at a time.
+	//
+	pool.parallelFor(panels, [&](int p_lo, int p_hi, int t) {
+		T *w = work.data() + (size_t)work_size * t;
+		for (int p = p_lo; p < p_hi; p++)
+		{
+			int i0 = p * panel;
+			haar_2d_rows(i4_min(panel, m - i0), n, u + i0, m, w);
+		}
+	});
+
+	return;
+}
+template void haar_2d_parallel<float>(int m, int n, float u[], ThreadPool &pool);
+template void haar_2d_parallel<double>(int m, int n, double u[], ThreadPool &pool);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_inverse_parallel(int m, int n, T u[], ThreadPool &pool)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INVERSE_PARALLEL inverts the Haar transform of an array on a
+//    thread pool.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Input, ThreadPool &POOL, the threads to run on.
+//
+{
+	int panel;
+	int panels;
+	int work_size;
+	vector<T> work;
+
+	panel = parallelPanelRows(m, n, sizeof(T), pool.size());
+	panels = (m + panel - 1) / panel;
+	work_size = haar_2d_blocked_work_size(m, n, panel);
+	work.resize((size_t)work_size * pool.size());
+	//
+	//  Inverse transform of all rows, one panel at a time.
+	//
+	pool.parallelFor(panels, [&](int p_lo, int p_hi, int t) {
+		T *w = work.data() + (size_t)work_size * t;
+		for (int p = p_lo; p < p_hi; p++)
+		{
+			int i0 = p * panel;
+			haar_2d_rows_inverse(i4_min(panel, m - i0), n, u + i0, m, w);
+		}
+	});
+	//
+	//  Inverse transform of all columns.
+	//
+	pool.parallelFor(n, [&](int j_lo, int j_hi, int t) {
+		T *w = work.data() + (size_t)work_size * t;
+		for (int j = j_lo; j < j_hi; j++)
+		{
+			haar_1d_inverse(m, u + (size_t)j * m, w);
+		}
+	});
+
+	return;
+}
+template void haar_2d_inverse_parallel<float>(int m, int n, float u[], ThreadPool &pool);
+template void haar_2d_inverse_parallel<double>(int m, int n, double u[], ThreadPool &pool);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_parallel(int m, int n, T u[], int num_threads)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_PARALLEL computes the Haar transform of an array on NUM_THREADS
+//    threads.
+//
+//  Discussion:
+//
+//    This starts a thread pool for the one call.  Callers transforming many
+//    arrays should keep a ThreadPool and pass it instead.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Input, int NUM_THREADS, the number of threads, or 0 for one per
+//    hardware thread.
+//
+{
+	ThreadPool pool(num_threads);
+
+	haar_2d_parallel(m, n, u, pool);
+
+	return;
+}
+template void haar_2d_parallel<float>(int m, int n, float u[], int num_threads);
+template void haar_2d_parallel<double>(int m, int n, double u[], int num_threads);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_inverse_parallel(int m, int n, T u[], int num_threads)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INVERSE_PARALLEL inverts the Haar transform of an array on
+//    NUM_THREADS threads.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Input, int NUM_THREADS, the number of threads, or 0 for one per
+//    hardware thread.
+//
+{
+	ThreadPool pool(num_threads);
+
+	haar_2d_inverse_parallel(m, n, u, pool);
+
+	return;
+}
+template void haar_2d_inverse_parallel<float>(int m, int n, float u[], int num_threads);
+template void haar_2d_inverse_parallel<double>(int m, int n, double u[], int num_threads);
+//
+//  Lane kernels of HAAR_2D_LOWPASS_BATCH.
+//
+//  A group of L arrays is reduced with entry I of array B at V[B+I*L], so
+//  that the same entry of every array in the group fills one vector and
+//  each step of the transform is a purely vertical operation:
+//
+//    gather: V[B+I*L] = (X[B][2I] + X[B][2I+1]) / S, for I < K
+//    pairs:  V[B+I*L] = (V[B+2I*L] + V[B+(2I+1)*L]) / S, for I < K
+//    vadd:   V[I] = (A[I] + B[I]) / S, for I < K
+//    rows:   HAAR_2D_ROWS of a M by N array, M a multiple of L
+//
+//  gather reads column segments of the L arrays, each where it is stored,
+//  and takes the first level of the column pass on the way in: each array's
+//  segment is split into even and odd entries in registers and summed, and
+//  the sums of a block of arrays are then transposed into lanes.  The
+//  transposes are done in ymm registers at both levels; AVX-512 then takes
+//  two blocks at once.  pairs works in place.
+//
+//  L is the vector width in T at the current instruction set, 8 entries
+//  without one.  Every kernel adds then divides as HAAR_2D_LOWPASS does,
+//  so the results are bit-identical to it.
+//
+#define LOWPASS_BATCH_MAX_LANES 16
+
+template <typename T>
+struct LowpassBatchKernels
+{
+	int lanes;
+	void (*gather)(const T *const x[], int k, T *v, T s);
+	void (*pairs)(T *v, int k, T s);
+	void (*vadd)(const T *a, const T *b, T *v, int k, T s);
+	void (*rows)(int m, int n, T *u, T *w);
+};
+
+template <typename T, int L>
+static void gatherScalar(const T *const x[], int k, T *v, T s)
+{
+	for (int i = 0; i < k; i++)
+	{
+		for (int b = 0; b < L; b++)
+		{
+			v[b + i * L] = (x[b][2 * i] + x[b][2 * i + 1]) / s;
+		}
+	}
+}
+
+template <typename T, int L>
+static void pairsScalar(T *v, int k, T s)
+{
+	for (int i = 0; i < k; i++)
+	{
+		for (int b = 0; b < L; b++)
+		{
+			v[b + i * L] = (v[b + 2 * i * L] + v[b + (2 * i + 1) * L]) / s;
+		}
+	}
+}
+
+template <typename T>
+static void vaddScalar(const T *a, const T *b, T *v, int k, T s)
+{
+	for (int i = 0; i < k; i++)
+	{
+		v[i] = (a[i] + b[i]) / s;
+	}
+}
+
+template <typename T>
+static void rowsScalar(int m, int n, T *u, T *w)
+{
+	haar_2d_rows(m, n, u, m, w);
+}
+
+// The levels of HAAR_2D_ROWS with the pairs of columns done by BUTTERFLY,
+// which sets LO[I] = (A[I] + B[I]) / S and HI[I] = (A[I] - B[I]) / S for
+// I < M.
+template <typename T, void (*BUTTERFLY)(const T *, const T *, T *, T *, int, T)>
+static void rowsLevels(int m, int n, T *u, T *w)
+{
+	T s = sqrt(T(2));
+	int k = 1;
+	while (k * 2 <= n)
+	{
+		k = k * 2;
+	}
+	while (1 < k)
+	{
+		k = k / 2;
+		for (int j = 0; j < k; j++)
+		{
+			BUTTERFLY(u + 2 * j * m, u + (2 * j + 1) * m, u + j * m, w + j * m, m, s);
+		}
+		memcpy(u + k * m, w, (size_t)k * m * sizeof(T));
+	}
+}
+
+#if TSSSS_X86
+// AVX2, float: 8 arrays per block, 8 sums of each.
+// --------------------------------
+TSSSS_TARGET_AVX2 static void transpose8Avx2(__m256 r[8])
+{
+	__m256 t[8];
+	__m256 u[8];
+	for (int i = 0; i < 8; i += 2)
+	{
+		t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+		t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+	}
+	for (int i = 0; i < 8; i += 4)
+	{
+		u[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+		u[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+		u[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+		u[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		r[i] = _mm256_permute2f128_ps(u[i], u[i + 4], 0x20);
+		r[i + 4] = _mm256_permute2f128_ps(u[i], u[i + 4], 0x31);
+	}
+}
+
+template <int L>
+TSSSS_TARGET_AVX2 static void gatherAvx2(const float *const x[], int k, float *v, float s)
+{
+	__m256 vs = _mm256_set1_ps(s);
+	__m256 r[8];
+	int i = 0;
+	for (; i + 8 <= k; i += 8)
+	{
+		for (int h = 0; h < L; h += 8)
+		{
+			for (int b = 0; b < 8; b++)
+			{
+				__m256 p = _mm256_loadu_ps(x[h + b] + 2 * i);
+				__m256 q = _mm256_loadu_ps(x[h + b] + 2 * i + 8);
+				// [p0 p2 q0 q2 p4 p6 q4 q6], then fix the order of the pairs.
+				__m256 even = _mm256_castpd_ps(_mm256_permute4x64_pd(
+					_mm256_castps_pd(_mm256_shuffle_ps(p, q, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+				__m256 odd = _mm256_castpd_ps(_mm256_permute4x64_pd(
+					_mm256_castps_pd(_mm256_shuffle_ps(p, q, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+				r[b] = _mm256_div_ps(_mm256_add_ps(even, odd), vs);
+			}
+			transpose8Avx2(r);
+			for (int j = 0; j < 8; j++)
+			{
+				_mm256_storeu_ps(v + h + (i + j) * L, r[j]);
+			}
+		}
+	}
+	for (; i < k; i++)
+	{
+		for (int b = 0; b < L; b++)
+		{
+			v[b + i * L] = (x[b][2 * i] + x[b][2 * i + 1]) / s;
+		}
+	}
+}
+
+TSSSS_TARGET_AVX2 static void pairsAvx2(float *v, int k, float s)
+{
+	__m256 vs = _mm256_set1_ps(s);
+	for (int i = 0; i < k; i++)
+	{
+		__m256 a = _mm256_loadu_ps(v + 2 * i * 8);
+		__m256 b = _mm256_loadu_ps(v + (2 * i + 1) * 8);
+		_mm256_storeu_ps(v + i * 8, _mm256_div_ps(_mm256_add_ps(a, b), vs));
+	}
+}
+
+TSSSS_TARGET_AVX2 static void butterflyAvx2(const float *a, const float *b, float *lo, float *hi, int m, float s)
+{
+	__m256 vs = _mm256_set1_ps(s);
+	for (int i = 0; i < m; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(a + i);
+		__m256 y = _mm256_loadu_ps(b + i);
+		_mm256_storeu_ps(lo + i, _mm256_div_ps(_mm256_add_ps(x, y), vs));
+		_mm256_storeu_ps(hi + i, _mm256_div_ps(_mm256_sub_ps(x, y), vs));
+	}
+}
+
+TSSSS_TARGET_AVX2 static void vaddAvx2(const float *a, const float *b, float *v, int k, float s)
+{
+	__m256 vs = _mm256_set1_ps(s);
+	int i = 0;
+	for (; i + 8 <= k; i += 8)
+	{
+		_mm256_storeu_ps(v + i, _mm256_div_ps(_mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), vs));
+	}
+	vaddScalar(a + i, b + i, v + i, k - i, s);
+}
+
+// AVX2, double: 4 arrays per block, 4 sums of each.
+// --------------------------------
+TSSSS_TARGET_AVX2 static void transpose4Avx2(__m256d r[4])
+{
+	__m256d t0 = _mm256_unpacklo_pd(r[0], r[1]);
+	__m256d t1 = _mm256_unpackhi_pd(r[0], r[1]);
+	__m256d t2 = _mm256_unpacklo_pd(r[2], r[3]);
+	__m256d t3 = _mm256_unpackhi_pd(r[2], r[3]);
+	r[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+	r[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+	r[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+	r[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+template <int L>
+TSSSS_TARGET_AVX2 static void gatherAvx2(const double *const x[], int k, double *v, double s)
+{
+	__m256d vs = _mm256_set1_pd(s);
+	__m256d r[4];
+	int i = 0;
+	for (; i + 4 <= k; i += 4)
+	{
+		for (int h = 0; h < L; h += 4)
+		{
+			for (int b = 0; b < 4; b++)
+			{
+				__m256d p = _mm256_loadu_pd(x[h + b] + 2 * i);
+				__m256d q = _mm256_loadu_pd(x[h + b] + 2 * i + 4);
+				// [p0 q0 p2 q2] and [p1 q1 p3 q3], then fix the lane order.
+				__m256d even = _mm256_permute4x64_pd(_mm256_unpacklo_pd(p, q), _MM_SHUFFLE(3, 1, 2, 0));
+				__m256d odd = _mm256_permute4x64_pd(_mm256_unpackhi_pd(p, q), _MM_SHUFFLE(3, 1, 2, 0));
+				r[b] = _mm256_div_pd(_mm256_add_pd(even, odd), vs);
+			}
+			transpose4Avx2(r);
+			for (int j = 0; j < 4; j++)
+			{
+				_mm256_storeu_pd(v + h + (i + j) * L, r[j]);
+			}
+		}
+	}
+	for (; i < k; i++)
+	{
+		for (int b = 0; b < L; b++)
+		{
+			v[b + i * L] = (x[b][2 * i] + x[b][2 * i + 1]) / s;
+		}
+	}
+}
+
+TSSSS_TARGET_AVX2 static void pairsAvx2(double *v, int k, double s)
+{
+	__m256d vs = _mm256_set1_pd(s);
+	for (int i = 0; i < k; i++)
+	{
+		__m256d a = _mm256_loadu_pd(v + 2 * i * 4);
+		__m256d b = _mm256_loadu_pd(v + (2 * i + 1) * 4);
+		_mm256_storeu_pd(v + i * 4, _mm256_div_pd(_mm256_add_pd(a, b), vs));
+	}
+}
+
+TSSSS_TARGET_AVX2 static void butterflyAvx2(const double *a, const double *b, double *lo, double *hi, int m,
+	double s)
+{
+	__m256d vs = _mm256_set1_pd(s);
+	for (int i = 0; i < m; i += 4)
+	{
+		__m256d x = _mm256_loadu_pd(a + i);
+		__m256d y = _mm256_loadu_pd(b + i);
+		_mm256_storeu_pd(lo + i, _mm256_div_pd(_mm256_add_pd(x, y), vs));
+		_mm256_storeu_pd(hi + i, _mm256_div_pd(_mm256_sub_pd(x, y), vs));
+	}
+}
+
+TSSSS_TARGET_AVX2 static void vaddAvx2(const double *a, const double *b, double *v, int k, double s)
+{
+	__m256d vs = _mm256_set1_pd(s);
+	int i = 0;
+	for (; i + 4 <= k; i += 4)
+	{
+		_mm256_storeu_pd(v + i, _mm256_div_pd(_mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)), vs));
+	}
+	vaddScalar(a + i, b + i, v + i, k - i, s);
+}
+
+// AVX-512: 16 floats or 8 doubles per vector, gathered by gatherAvx2.
+// --------------------------------
+TSSSS_TARGET_AVX512 static void pairsAvx512(float *v, int k, float s)
+{
+	__m512 vs = _mm512_set1_ps(s);
+	for (int i = 0; i < k; i++)
+	{
+		__m512 a = _mm512_loadu_ps(v + 2 * i * 16);
+		__m512 b = _mm512_loadu_ps(v + (2 * i + 1) * 16);
+		_mm512_storeu_ps(v + i * 16, _mm512_div_ps(_mm512_add_ps(a, b), vs));
+	}
+}
+
+TSSSS_TARGET_AVX512 static void butterflyAvx512(const float *a, const float *b, float *lo, float *hi, int m,
+	float s)
+{
+	__m512 vs = _mm512_set1_ps(s);
+	for (int i = 0; i < m; i += 16)
+	{
+		__m512 x = _mm512_loadu_ps(a + i);
+		__m512 y = _mm512_loadu_ps(b + i);
+		_mm512_storeu_ps(lo + i, _mm512_div_ps(_mm512_add_ps(x, y), vs));
+		_mm512_storeu_ps(hi + i, _mm512_div_ps(_mm512_sub_ps(x, y), vs));
+	}
+}
+
+TSSSS_TARGET_AVX512 static void vaddAvx512(const float *a, const float *b, float *v, int k, float s)
+{
+	__m512 vs = _mm512_set1_ps(s);
+	int i = 0;
+	for (; i + 16 <= k; i += 16)
+	{
+		_mm512_storeu_ps(v + i, _mm512_div_ps(_mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)), vs));
+	}
+	vaddScalar(a + i, b + i, v + i, k - i, s);
+}
+
+TSSSS_TARGET_AVX512 static void pairsAvx512(double *v, int k, double s)
+{
+	__m512d vs = _mm512_set1_pd(s);
+	for (int i = 0; i < k; i++)
+	{
+		__m512d a = _mm512_loadu_pd(v + 2 * i * 8);
+		__m512d b = _mm512_loadu_pd(v + (2 * i + 1) * 8);
+		_mm512_storeu_pd(v + i * 8, _mm512_div_pd(_mm512_add_pd(a, b), vs));
+	}
+}
+
+TSSSS_TARGET_AVX512 static void butterflyAvx512(const double *a, const double *b, double *lo, double *hi, int m,
+	double s)
+{
+	__m512d vs = _mm512_set1_pd(s);
+	for (int i = 0; i < m; i += 8)
+	{
+		__m512d x = _mm512_loadu_pd(a + i);
+		__m512d y = _mm512_loadu_pd(b + i);
+		_mm512_storeu_pd(lo + i, _mm512_div_pd(_mm512_add_pd(x, y), vs));
+		_mm512_storeu_pd(hi + i, _mm512_div_pd(_mm512_sub_pd(x, y), vs));
+	}
+}
+
+TSSSS_TARGET_AVX512 static void vaddAvx512(const double *a, const double *b, double *v, int k, double s)
+{
+	__m512d vs = _mm512_set1_pd(s);
+	int i = 0;
+	for (; i + 8 <= k; i += 8)
+	{
+		_mm512_storeu_pd(v + i, _mm512_div_pd(_mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)), vs));
+	}
+	vaddScalar(a + i, b + i, v + i, k - i, s);
+}
+#endif
+
+static LowpassBatchKernels<float> lowpassBatchKernels(float)
+{
+	LowpassBatchKernels<float> kernels = {
+		8, gatherScalar<float, 8>, pairsScalar<float, 8>, vaddScalar<float>, rowsScalar<float>};
+#if TSSSS_X86
+	switch (simd_level())
+	{
+	case SimdLevel::AVX512:
+		kernels = {16, gatherAvx2<16>, pairsAvx512, vaddAvx512, rowsLevels<float, butterflyAvx512>};
+		break;
+	case SimdLevel::AVX2:
+		kernels = {8, gatherAvx2<8>, pairsAvx2, vaddAvx2, rowsLevels<float, butterflyAvx2>};
+		break;
+	default:
+		break;
+	}
+#endif
+	return kernels;
+}
+
+static LowpassBatchKernels<double> lowpassBatchKernels(double)
+{
+	LowpassBatchKernels<double> kernels = {
+		8, gatherScalar<double, 8>, pairsScalar<double, 8>, vaddScalar<double>, rowsScalar<double>};
+#if TSSSS_X86
+	switch (simd_level())
+	{
+	case SimdLevel::AVX512:
+		kernels = {8, gatherAvx2<8>, pairsAvx512, vaddAvx512, rowsLevels<double, butterflyAvx512>};
+		break;
+	case SimdLevel::AVX2:
+		kernels = {4, gatherAvx2<4>, pairsAvx2, vaddAvx2, rowsLevels<double, butterflyAvx2>};
+		break;
+	default:
+		break;
+	}
+#endif
+	return kernels;
+}
+//****************************************************************************80
+
+template <typename T>
+static void haar_2d_lowpass_group(const LowpassBatchKernels<T> &kernels, int nb, int m, int km, int kn,
+	int levels, const T *const u[], int cm, int cn, T c[], T w[], HaarMode mode)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_LOWPASS_GROUP does the work of HAAR_2D_LOWPASS_BATCH for one
+//    group of NB arrays.
+//
+//  Discussion:
+//
+//    The group always fills the L = KERNELS.LANES lanes: a partial group
+//    repeats its last array in the lanes past NB, whose blocks are not
+//    written.
+//
+//  Parameters:
+//
+//    Input, LowpassBatchKernels<T> KERNELS, the lane kernels.
+//
+//    Input, int NB, the number of arrays in the group, 1 to L.
+//
+//    Input, int M, KM, KN, LEVELS, the first dimension of the arrays, the
+//    largest powers of 2 in M and N, and the number of levels from KN
+//    columns down to CN.
+//
+//    Input, const T *const U[NB], the arrays of the group.
+//
+//    Input, int CM, CN, the dimensions of the block of coefficients.
+//
+//    Output, T C[NB*CM*CN], the blocks of the group.
+//
+//    Workspace, T W[HAAR_2D_LOWPASS_BATCH_WORK_SIZE(M,N,CM,CN)], which
+//    holds the reduced band T[L*CM*CN], one pending column per level
+//    PENDING[L*LEVELS*CM], the current column Y[L*CM] and scratch
+//    V[L*max(KM/2,CM*(CN/2),1)].
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+{
+	int b;
+	int i;
+	int j;
+	int k;
+	int l;
+	int lanes;
+	T s;
+	T *t;
+	T *pending;
+	T *y;
+	T *v;
+	const T *x[LOWPASS_BATCH_MAX_LANES];
+
+	lanes = kernels.lanes;
+	s = sqrt(T(2));
+	t = w;
+	pending = t + lanes * cm * cn;
+	y = pending + lanes * levels * cm;
+	v = y + lanes * cm;
+
+	for (j = 0; j < kn; j++)
+	{
+		for (b = 0; b < lanes; b++)
+		{
+			x[b] = u[i4_min(b, nb - 1)] + (size_t)j * m;
+		}
+		//
+		//  Reduce column J to its low-pass band of CM entries, lane B
+		//  of entry I going to Y[B+I*L], then finish its transform
+		//  in the standard decomposition.
+		//
+		k = km;
+		if (cm < k)
+		{
+			k = k / 2;
+			kernels.gather(x, k, v, s);
+			while (cm < k)
+			{
+				k = k / 2;
+				kernels.pairs(v, k, s);
+			}
+			for (i = 0; i < cm * lanes; i++)
+			{
+				y[i] = v[i];
+			}
+		}
+		else
+		{
+			for (i = 0; i < cm; i++)
+			{
+				for (b = 0; b < lanes; b++)
+				{
+					y[b + i * lanes] = x[b][i];
+				}
+			}
+		}
+		if (mode == HaarMode::STANDARD)
+		{
+			kernels.rows(lanes, cm, y, v);
+		}
+		//
+		//  Column J is the right half of a pair at level L if bit L of
+		//  J is set; combine it with the pending left half and carry on
+		//  one level up.  Otherwise it waits for its partner.
+		//
+		for (l = 0; l < levels && ((j >> l) & 1); l++)
+		{
+			kernels.vadd(pending + l * cm * lanes, y, y, cm * lanes, s);
+		}
+		T *dst = (l < levels) ? pending + l * cm * lanes : t + (j >> levels) * cm * lanes;
+		for (i = 0; i < cm * lanes; i++)
+		{
+			dst[i] = y[i];
+		}
+	}
+	if (mode == HaarMode::STANDARD)
+	{
+		kernels.rows(cm * lanes, cn, t, v);
+	}
+	//
+	//  Write each array's block out by itself.
+	//
+	for (b = 0; b < nb; b++)
+	{
+		T *block = c + (size_t)b * cm * cn;
+		for (i = 0; i < cm * cn; i++)
+		{
+			block[i] = t[b + i * lanes];
+		}
+		if (mode == HaarMode::NONSTANDARD)
+		{
+			haar_2d_nonstandard(cm, cn, block, v);
+		}
+	}
+
+	return;
+}
+//****************************************************************************80
+
+static void haar_2d_lowpass_batch_dims(int m, int n, int cn, int *km, int *kn, int *levels)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_LOWPASS_BATCH_DIMS returns the largest powers of 2 KM and KN
+//    in M and N, and the number of LEVELS from KN columns down to CN.
+//
+{
+	*km = 1;
+	while (*km * 2 <= m)
+	{
+		*km = *km * 2;
+	}
+	*kn = 1;
+	while (*kn * 2 <= n)
+	{
+		*kn = *kn * 2;
+	}
+	*levels = 0;
+	while ((cn << *levels) < *kn)
+	{
+		*levels = *levels + 1;
+	}
+
+	return;
+}
+//****************************************************************************80
+
+template <typename T>
+int haar_2d_lowpass_batch_lanes()
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_LOWPASS_BATCH_LANES returns the number of arrays
+//    HAAR_2D_LOWPASS_BATCH transforms together.
+//
+//  Discussion:
+//
+//    It is the vector width in T of the instruction set SIMD_LEVEL
+//    selects, and 8 without one.  Callers that build the arrays on the fly
+//    can pass this many at a time to keep every lane busy.
+//
+//  Parameters:
+//
+//    Output, int HAAR_2D_LOWPASS_BATCH_LANES, the number of lanes.
+//
+{
+	return lowpassBatchKernels(T()).lanes;
+}
+template int haar_2d_lowpass_batch_lanes<float>();
+template int haar_2d_lowpass_batch_lanes<double>();
+//****************************************************************************80
+
+template <typename T>
+int haar_2d_lowpass_batch_work_size(int m, int n, int cm, int cn)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_LOWPASS_BATCH_WORK_SIZE returns the workspace size needed by
+//    HAAR_2D_LOWPASS_BATCH.
+//
+//  Discussion:
+//
+//    The size is that of one group of HAAR_2D_LOWPASS_BATCH_LANES arrays,
+//    at the instruction set SIMD_LEVEL selects when it is called.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of each array.
+//
+//    Input, int CM, CN, the dimensions of the block of coefficients.
+//
+//    Output, int HAAR_2D_LOWPASS_BATCH_WORK_SIZE, the number of entries
+//    the workspace W passed to HAAR_2D_LOWPASS_BATCH must hold.
+//
+{
+	int km;
+	int kn;
+	int levels;
+
+	haar_2d_lowpass_batch_dims(m, n, cn, &km, &kn, &levels);
+
+	return haar_2d_lowpass_batch_lanes<T>() *
+		(cm * cn + levels * cm + cm + i4_max(i4_max(km / 2, cm * (cn / 2)), 1));
+}
+template int haar_2d_lowpass_batch_work_size<float>(int m, int n, int cm, int cn);
+template int haar_2d_lowpass_batch_work_size<double>(int m, int n, int cm, int cn);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_lowpass_batch(int count, int m, int n, const T *const u[], int cm, int cn, T c[], T w[],
+	HaarMode mode)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_LOWPASS_BATCH computes the leading CM by CN block of the Haar
+//    transform of COUNT arrays of the same shape.
+//
+//  Discussion:
+//
+//    The arrays are taken in groups of HAAR_2D_LOWPASS_BATCH_LANES, one
+//    array per vector lane, and every step of HAAR_2D_LOWPASS is done for
+//    the whole group at once.  Each array is read where it is stored: the
+//    same column segment of the arrays of a group is loaded, reduced by
+//    one level and transposed into lanes in registers, after which every
+//    level is a vertical operation on whole vectors, with no shuffles.
+//
+//    The columns of a group are reduced one at a time, and pairs of reduced
+//    columns are combined as soon as both are ready, keeping one pending
+//    column per level.  This makes the same additions in the same order as
+//    reducing the rows level by level, but the workspace of a group stays
+//    small enough for the cache.
+//
+//    In the standard decomposition the whole transform runs on the group.
+//    In the nonstandard one the low-pass band is built on the group and
+//    each CM by CN block is then transformed on its own.  Either way each
+//    block is bit-identical to HAAR_2D_LOWPASS on that array.
+//
+//  Parameters:
+//
+//    Input, int COUNT, the number of arrays.
+//
+//    Input, int M, N, the dimensions of each array.
+//
+//    Input, const T *const U[COUNT], the arrays, each M by N and stored
+//    by columns.
+//
+//    Input, int CM, CN, the dimensions of the block of coefficients, powers
+//    of 2 no larger than M and N.
+//
+//    Output, T C[COUNT*CM*CN], the blocks, one after the other, each stored
+//    by columns.
+//
+//    Workspace, T W[HAAR_2D_LOWPASS_BATCH_WORK_SIZE(M,N,CM,CN)].
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+{
+	int b0;
+	int km;
+	int kn;
+	int levels;
+	LowpassBatchKernels<T> kernels;
+
+	kernels = lowpassBatchKernels(T());
+	haar_2d_lowpass_batch_dims(m, n, cn, &km, &kn, &levels);
+
+	for (b0 = 0; b0 < count; b0 += kernels.lanes)
+	{
+		haar_2d_lowpass_group(kernels, i4_min(kernels.lanes, count - b0), m, km, kn, levels, u + b0, cm, cn,
+			c + (size_t)b0 * cm * cn, w, mode);
+	}
+
+	return;
+}
+template void haar_2d_lowpass_batch<float>(int count, int m, int n, const float *const u[], int cm, int cn,
+	float c[], float w[], HaarMode mode);
+template void haar_2d_lowpass_batch<double>(int count, int m, int n, const double *const u[], int cm, int cn,
+	double c[], double w[], HaarMode mode);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_lowpass_batch(int count, int m, int n, const T *const u[], int cm, int cn, T c[], ThreadPool &pool,
+	HaarMode mode)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_LOWPASS_BATCH computes the leading CM by CN block of the Haar
+//    transform of COUNT arrays of the same shape on a thread pool.
+//
+//  Discussion:
+//
+//    The groups of arrays are split across the threads of POOL, each with
+//    its own workspace, allocated once per call.
+//
+//  Parameters:
+//
+//    Input, int COUNT, the number of arrays.
+//
+//    Input, int M, N, the dimensions of each array.
+//
+//    Input, const T *const U[COUNT], the arrays.
+//
+//    Input, int CM, CN, the dimensions of the block of coefficients.
+//
+//    Output, T C[COUNT*CM*CN], the blocks, one after the other.
+//
+//    Input, ThreadPool &POOL, the threads to run on.
+//
+//    Input, HaarMode MODE, the standard or the nonstandard decomposition.
+//
+{
+	int lanes;
+	int groups;
+	int work_size;
+	vector<T> work;
+
+	lanes = haar_2d_lowpass_batch_lanes<T>();
+	groups = (count + lanes - 1) / lanes;
+	work_size = haar_2d_lowpass_batch_work_size<T>(m, n, cm, cn);
+	work.resize((size_t)work_size * pool.size());
+
+	pool.parallelFor(groups, [&](int g_lo, int g_hi, int thread) {
+		int b_lo = g_lo * lanes;
+		int b_hi = i4_min(g_hi * lanes, count);
+		haar_2d_lowpass_batch(b_hi - b_lo, m, n, u + b_lo, cm, cn, c + (size_t)b_lo * cm * cn,
+			work.data() + (size_t)work_size * thread, mode);
+	});
+
+	return;
+}
+template void haar_2d_lowpass_batch<float>(int count, int m, int n, const float *const u[], int cm, int cn,
+	float c[], ThreadPool &pool, HaarMode mode);
+template void haar_2d_lowpass_batch<double>(int count, int m, int n, const double *const u[], int cm, int cn,
+	double c[], ThreadPool &pool, HaarMode mode);
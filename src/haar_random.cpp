@@ -0,0 +1,249 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+#include "cpu_features.hpp"
+#include "haar.hpp"
+#include "thread_pool.hpp"
+
+#if TSSSS_X86
+#include <immintrin.h>
+#endif
+
+//
+//  Counter-based uniform generator.
+//
+//  Entry I of the stream of SEED is the SplitMix64 output function applied
+//  to KEY + (I + 1) * GAMMA, where KEY is SEED passed through the same
+//  function and GAMMA is the odd constant SplitMix64 steps by.  No state
+//  is carried from one entry to the next, so any range of the stream can
+//  be filled on its own, by any thread, several entries per register.
+//
+//  The top 52 bits of the output become the mantissa of a double in [1,2),
+//  and subtracting 1 - 2^-53 from it is exact, which gives (2K+1) / 2^53
+//  for K in [0, 2^52): strictly inside (0,1), like R8_UNIFORM_01, and the
+//  same bits whichever kernel computes it.
+//
+#define SPLITMIX_GAMMA 0x9e3779b97f4a7c15ull
+#define SPLITMIX_MUL1 0xbf58476d1ce4e5b9ull
+#define SPLITMIX_MUL2 0x94d049bb133111ebull
+#define UNIFORM_OFFSET (1.0 - 1.0 / 9007199254740992.0)
+
+// Entries filled per task of the pool.
+#define UNIFORM_CHUNK 16384
+
+static uint64_t splitmixMix(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * SPLITMIX_MUL1;
+	z = (z ^ (z >> 27)) * SPLITMIX_MUL2;
+	return z ^ (z >> 31);
+}
+
+static double uniformFromBits(uint64_t z)
+{
+	double d;
+	z = 0x3ff0000000000000ull | (z >> 12);
+	memcpy(&d, &z, sizeof(double));
+	return d - UNIFORM_OFFSET;
+}
+
+// Fills r[0, n) with entries first, first + 1, ... of the stream of key.
+static void uniformScalar(uint64_t key, uint64_t first, size_t n, double *r)
+{
+	uint64_t x = key + (first + 1) * SPLITMIX_GAMMA;
+	for (size_t i = 0; i < n; i++)
+	{
+		r[i] = uniformFromBits(splitmixMix(x));
+		x = x + SPLITMIX_GAMMA;
+	}
+}
+
+#if TSSSS_X86
+// AVX2: 4 entries per register. There is no 64 bit multiply, so the
+// products are put together from 32 bit halves.
+// --------------------------------
+TSSSS_TARGET_AVX2 static __m256i mul64Avx2(__m256i a, __m256i b)
+{
+	__m256i lo = _mm256_mul_epu32(a, b);
+	__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+		_mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+	return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+TSSSS_TARGET_AVX2 static void uniformAvx2(uint64_t key, uint64_t first, size_t n, double *r)
+{
+	const __m256i mul1 = _mm256_set1_epi64x((long long)SPLITMIX_MUL1);
+	const __m256i mul2 = _mm256_set1_epi64x((long long)SPLITMIX_MUL2);
+	const __m256i step = _mm256_set1_epi64x((long long)(4 * SPLITMIX_GAMMA));
+	const __m256i one = _mm256_set1_epi64x(0x3ff0000000000000ll);
+	const __m256d offset = _mm256_set1_pd(UNIFORM_OFFSET);
+	uint64_t x0 = key + (first + 1) * SPLITMIX_GAMMA;
+	__m256i x = _mm256_setr_epi64x((long long)x0, (long long)(x0 + SPLITMIX_GAMMA),
+		(long long)(x0 + 2 * SPLITMIX_GAMMA), (long long)(x0 + 3 * SPLITMIX_GAMMA));
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m256i z = x;
+		z = mul64Avx2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 30)), mul1);
+		z = mul64Avx2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 27)), mul2);
+		z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 31));
+		z = _mm256_or_si256(one, _mm256_srli_epi64(z, 12));
+		_mm256_storeu_pd(r + i, _mm256_sub_pd(_mm256_castsi256_pd(z), offset));
+		x = _mm256_add_epi64(x, step);
+	}
+	uniformScalar(key, first + i, n - i, r + i);
+}
+
+// AVX-512: 8 entries per register.
+// --------------------------------
+TSSSS_TARGET_AVX512 static void uniformAvx512(uint64_t key, uint64_t first, size_t n, double *r)
+{
+	const __m512i mul1 = _mm512_set1_epi64((long long)SPLITMIX_MUL1);
+	const __m512i mul2 = _mm512_set1_epi64((long long)SPLITMIX_MUL2);
+	const __m512i step = _mm512_set1_epi64((long long)(8 * SPLITMIX_GAMMA));
+	const __m512i one = _mm512_set1_epi64(0x3ff0000000000000ll);
+	const __m512d offset = _mm512_set1_pd(UNIFORM_OFFSET);
+	uint64_t x0 = key + (first + 1) * SPLITMIX_GAMMA;
+	__m512i x = _mm512_add_epi64(_mm512_set1_epi64((long long)x0),
+		_mm512_mullo_epi64(_mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7), _mm512_set1_epi64((long long)SPLITMIX_GAMMA)));
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m512i z = x;
+		z = _mm512_mullo_epi64(_mm512_xor_si512(z, _mm512_srli_epi64(z, 30)), mul1);
+		z = _mm512_mullo_epi64(_mm512_xor_si512(z, _mm512_srli_epi64(z, 27)), mul2);
+		z = _mm512_xor_si512(z, _mm512_srli_epi64(z, 31));
+		z = _mm512_or_si512(one, _mm512_srli_epi64(z, 12));
+		_mm512_storeu_pd(r + i, _mm512_sub_pd(_mm512_castsi512_pd(z), offset));
+		x = _mm512_add_epi64(x, step);
+	}
+	uniformScalar(key, first + i, n - i, r + i);
+}
+#endif
+
+static void (*uniformKernel())(uint64_t key, uint64_t first, size_t n, double *r)
+{
+#if TSSSS_X86
+	switch (simd_level())
+	{
+	case SimdLevel::AVX512:
+		return uniformAvx512;
+	case SimdLevel::AVX2:
+		return uniformAvx2;
+	default:
+		break;
+	}
+#endif
+	return uniformScalar;
+}
+//****************************************************************************80
+
+double r8_uniform_01_counter(uint64_t seed, uint64_t index)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    R8_UNIFORM_01_COUNTER returns one entry of a counter-based unit
+//    pseudorandom stream.
+//
+//  Discussion:
+//
+//    Unlike R8MAT_UNIFORM_01_NEW, which threads a Lehmer recurrence through
+//    every entry, the entry is a function of SEED and INDEX alone, computed
+//    with the SplitMix64 output function.  R8VEC_UNIFORM_01_COUNTER_NEW
+//    and R8MAT_UNIFORM_01_COUNTER_NEW give the same values.
+//
+//  Parameters:
+//
+//    Input, uint64_t SEED, selects the stream.  Any value, 0 included.
+//
+//    Input, uint64_t INDEX, the position in the stream.
+//
+//    Output, double R8_UNIFORM_01_COUNTER, a value strictly between 0 and 1.
+//
+{
+	double r;
+
+	uniformScalar(splitmixMix(seed), index, 1, &r);
+
+	return r;
+}
+//****************************************************************************80
+
+double *r8vec_uniform_01_counter_new(int n, uint64_t seed, ThreadPool &pool)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    R8VEC_UNIFORM_01_COUNTER_NEW returns a unit pseudorandom R8VEC from a
+//    counter-based stream.
+//
+//  Discussion:
+//
+//    Entry I is R8_UNIFORM_01_COUNTER(SEED,I).  Chunks of the vector are
+//    filled on the threads of POOL with the widest vector kernel the
+//    machine has; the values do not depend on either.
+//
+//  Parameters:
+//
+//    Input, int N, the number of entries.
+//
+//    Input, uint64_t SEED, selects the stream.
+//
+//    Input, ThreadPool &POOL, the threads to use.
+//
+//    Output, double R8VEC_UNIFORM_01_COUNTER_NEW[N], the vector.
+//
+{
+	int chunks;
+	uint64_t key;
+	double *r;
+	void (*kernel)(uint64_t key, uint64_t first, size_t n, double *r);
+
+	r = new double[n];
+	key = splitmixMix(seed);
+	kernel = uniformKernel();
+	chunks = (n + UNIFORM_CHUNK - 1) / UNIFORM_CHUNK;
+
+	pool.parallelFor(chunks, [&](int c_lo, int c_hi, int /*thread*/) {
+		size_t lo = (size_t)c_lo * UNIFORM_CHUNK;
+		size_t hi = min((size_t)c_hi * UNIFORM_CHUNK, (size_t)n);
+		kernel(key, lo, hi - lo, r + lo);
+	});
+
+	return r;
+}
+//****************************************************************************80
+
+double *r8mat_uniform_01_counter_new(int m, int n, uint64_t seed, ThreadPool &pool)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    R8MAT_UNIFORM_01_COUNTER_NEW returns a unit pseudorandom R8MAT from a
+//    counter-based stream.
+//
+//  Discussion:
+//
+//    Entry (I,J) is R8_UNIFORM_01_COUNTER(SEED,I+J*M), so the matrix holds
+//    the same values as R8VEC_UNIFORM_01_COUNTER_NEW(M*N,SEED,POOL).  The
+//    sequence of R8MAT_UNIFORM_01_NEW is unrelated and is unchanged.
+//
+//  Parameters:
+//
+//    Input, int M, N, the number of rows and columns.
+//
+//    Input, uint64_t SEED, selects the stream.
+//
+//    Input, ThreadPool &POOL, the threads to use.
+//
+//    Output, double R8MAT_UNIFORM_01_COUNTER_NEW[M*N], the matrix.
+//
+{
+	return r8vec_uniform_01_counter_new(m * n, seed, pool);
+}
@@ -0,0 +1,537 @@
+#include <cmath>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+#include "cpu_features.hpp"
+#include "haar.hpp"
+
+#if TSSSS_X86
+#include <immintrin.h>
+#endif
+
+//
+//  Vectorized Haar kernels.
+//
+//  A 2D transform is built from four primitives, one per kind of butterfly:
+//
+//    split:  LO[I] = (X[2I] + X[2I+1]) * R,  HI[I] = (X[2I] - X[2I+1]) * R
+//    merge:  X[2I] = (LO[I] + HI[I]) * R,    X[2I+1] = (LO[I] - HI[I]) * R
+//    vsplit: LO[I] = (A[I] + B[I]) * R,      HI[I] = (A[I] - B[I]) * R
+//    vmerge: A[I] = (LO[I] + HI[I]) * R,     B[I] = (LO[I] - HI[I]) * R
+//
+//  split and merge work along a column and deinterleave or interleave the
+//  even and odd samples in registers; vsplit and vmerge combine two whole
+//  columns and are purely vertical.  R is 1/sqrt(2), so the results differ
+//  from the scalar Burkardt routines by rounding only.
+//
+//  split may be called with LO == X and merge writes X from the top down, so
+//  both work in place as long as HI points elsewhere.
+//
+template <typename T>
+struct HaarKernels
+{
+	void (*split)(const T *x, T *lo, T *hi, int k, T r);
+	void (*merge)(const T *lo, const T *hi, T *x, int k, T r);
+	void (*vsplit)(const T *a, const T *b, T *lo, T *hi, int m, T r);
+	void (*vmerge)(const T *lo, const T *hi, T *a, T *b, int m, T r);
+};
+
+template <typename T>
+static void splitScalar(const T *x, T *lo, T *hi, int k, T r)
+{
+	for (int i = 0; i < k; i++)
+	{
+		T a = x[2 * i];
+		T b = x[2 * i + 1];
+		lo[i] = (a + b) * r;
+		hi[i] = (a - b) * r;
+	}
+}
+
+template <typename T>
+static void mergeScalar(const T *lo, const T *hi, T *x, int k, T r)
+{
+	for (int i = k - 1; 0 <= i; i--)
+	{
+		T a = lo[i];
+		T b = hi[i];
+		x[2 * i] = (a + b) * r;
+		x[2 * i + 1] = (a - b) * r;
+	}
+}
+
+template <typename T>
+static void vsplitScalar(const T *a, const T *b, T *lo, T *hi, int m, T r)
+{
+	for (int i = 0; i < m; i++)
+	{
+		T x = a[i];
+		T y = b[i];
+		lo[i] = (x + y) * r;
+		hi[i] = (x - y) * r;
+	}
+}
+
+template <typename T>
+static void vmergeScalar(const T *lo, const T *hi, T *a, T *b, int m, T r)
+{
+	for (int i = 0; i < m; i++)
+	{
+		T x = lo[i];
+		T y = hi[i];
+		a[i] = (x + y) * r;
+		b[i] = (x - y) * r;
+	}
+}
+
+#if TSSSS_X86
+// In the column pass of the inverse, level K reads back what level K/2 has
+// just stored.  For short levels those stores are still in flight, and
+// wide loads straddling two of them cannot be forwarded, so short levels
+// go through the scalar loop.
+#define MERGE_MIN_VECTOR 256
+
+// AVX2, double: 4 lanes.
+// --------------------------------
+TSSSS_TARGET_AVX2 static void splitAvx2(const double *x, double *lo, double *hi, int k, double r)
+{
+	__m256d vr = _mm256_set1_pd(r);
+	int i = 0;
+	for (; i + 4 <= k; i += 4)
+	{
+		__m256d p = _mm256_loadu_pd(x + 2 * i);
+		__m256d q = _mm256_loadu_pd(x + 2 * i + 4);
+		// [x0 x4 x2 x6] and [x1 x5 x3 x7], then fix the lane order.
+		__m256d even = _mm256_permute4x64_pd(_mm256_unpacklo_pd(p, q), _MM_SHUFFLE(3, 1, 2, 0));
+		__m256d odd = _mm256_permute4x64_pd(_mm256_unpackhi_pd(p, q), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_pd(lo + i, _mm256_mul_pd(_mm256_add_pd(even, odd), vr));
+		_mm256_storeu_pd(hi + i, _mm256_mul_pd(_mm256_sub_pd(even, odd), vr));
+	}
+	splitScalar(x + 2 * i, lo + i, hi + i, k - i, r);
+}
+
+TSSSS_TARGET_AVX2 static void mergeAvx2(const double *lo, const double *hi, double *x, int k, double r)
+{
+	if (k < MERGE_MIN_VECTOR)
+	{
+		mergeScalar(lo, hi, x, k, r);
+		return;
+	}
+	__m256d vr = _mm256_set1_pd(r);
+	int tail = k % 4;
+	mergeScalar(lo + k - tail, hi + k - tail, x + 2 * (k - tail), tail, r);
+	for (int i = k - tail - 4; 0 <= i; i -= 4)
+	{
+		__m256d a = _mm256_loadu_pd(lo + i);
+		__m256d b = _mm256_loadu_pd(hi + i);
+		__m256d even = _mm256_mul_pd(_mm256_add_pd(a, b), vr);
+		__m256d odd = _mm256_mul_pd(_mm256_sub_pd(a, b), vr);
+		// [e0 o0 e2 o2] and [e1 o1 e3 o3], then swap the middle halves.
+		__m256d p = _mm256_unpacklo_pd(even, odd);
+		__m256d q = _mm256_unpackhi_pd(even, odd);
+		_mm256_storeu_pd(x + 2 * i, _mm256_permute2f128_pd(p, q, 0x20));
+		_mm256_storeu_pd(x + 2 * i + 4, _mm256_permute2f128_pd(p, q, 0x31));
+	}
+}
+
+TSSSS_TARGET_AVX2 static void vsplitAvx2(const double *a, const double *b, double *lo, double *hi, int m, double r)
+{
+	__m256d vr = _mm256_set1_pd(r);
+	int i = 0;
+	for (; i + 4 <= m; i += 4)
+	{
+		__m256d x = _mm256_loadu_pd(a + i);
+		__m256d y = _mm256_loadu_pd(b + i);
+		_mm256_storeu_pd(lo + i, _mm256_mul_pd(_mm256_add_pd(x, y), vr));
+		_mm256_storeu_pd(hi + i, _mm256_mul_pd(_mm256_sub_pd(x, y), vr));
+	}
+	vsplitScalar(a + i, b + i, lo + i, hi + i, m - i, r);
+}
+
+TSSSS_TARGET_AVX2 static void vmergeAvx2(const double *lo, const double *hi, double *a, double *b, int m, double r)
+{
+	__m256d vr = _mm256_set1_pd(r);
+	int i = 0;
+	for (; i + 4 <= m; i += 4)
+	{
+		__m256d x = _mm256_loadu_pd(lo + i);
+		__m256d y = _mm256_loadu_pd(hi + i);
+		_mm256_storeu_pd(a + i, _mm256_mul_pd(_mm256_add_pd(x, y), vr));
+		_mm256_storeu_pd(b + i, _mm256_mul_pd(_mm256_sub_pd(x, y), vr));
+	}
+	vmergeScalar(lo + i, hi + i, a + i, b + i, m - i, r);
+}
+
+// AVX2, float: 8 lanes.
+// --------------------------------
+TSSSS_TARGET_AVX2 static void splitAvx2(const float *x, float *lo, float *hi, int k, float r)
+{
+	__m256 vr = _mm256_set1_ps(r);
+	int i = 0;
+	for (; i + 8 <= k; i += 8)
+	{
+		__m256 p = _mm256_loadu_ps(x + 2 * i);
+		__m256 q = _mm256_loadu_ps(x + 2 * i + 8);
+		// [p0 p2 q0 q2 | p4 p6 q4 q6], then gather the 64-bit pairs in order.
+		__m256 even = _mm256_shuffle_ps(p, q, _MM_SHUFFLE(2, 0, 2, 0));
+		__m256 odd = _mm256_shuffle_ps(p, q, _MM_SHUFFLE(3, 1, 3, 1));
+		even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even), _MM_SHUFFLE(3, 1, 2, 0)));
+		odd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(odd), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(lo + i, _mm256_mul_ps(_mm256_add_ps(even, odd), vr));
+		_mm256_storeu_ps(hi + i, _mm256_mul_ps(_mm256_sub_ps(even, odd), vr));
+	}
+	splitScalar(x + 2 * i, lo + i, hi + i, k - i, r);
+}
+
+TSSSS_TARGET_AVX2 static void mergeAvx2(const float *lo, const float *hi, float *x, int k, float r)
+{
+	if (k < MERGE_MIN_VECTOR)
+	{
+		mergeScalar(lo, hi, x, k, r);
+		return;
+	}
+	__m256 vr = _mm256_set1_ps(r);
+	int tail = k % 8;
+	mergeScalar(lo + k - tail, hi + k - tail, x + 2 * (k - tail), tail, r);
+	for (int i = k - tail - 8; 0 <= i; i -= 8)
+	{
+		__m256 a = _mm256_loadu_ps(lo + i);
+		__m256 b = _mm256_loadu_ps(hi + i);
+		__m256 even = _mm256_mul_ps(_mm256_add_ps(a, b), vr);
+		__m256 odd = _mm256_mul_ps(_mm256_sub_ps(a, b), vr);
+		// [e0 o0 e1 o1 | e4 o4 e5 o5] and [e2 o2 e3 o3 | e6 o6 e7 o7].
+		__m256 p = _mm256_unpacklo_ps(even, odd);
+		__m256 q = _mm256_unpackhi_ps(even, odd);
+		_mm256_storeu_ps(x + 2 * i, _mm256_permute2f128_ps(p, q, 0x20));
+		_mm256_storeu_ps(x + 2 * i + 8, _mm256_permute2f128_ps(p, q, 0x31));
+	}
+}
+
+TSSSS_TARGET_AVX2 static void vsplitAvx2(const float *a, const float *b, float *lo, float *hi, int m, float r)
+{
+	__m256 vr = _mm256_set1_ps(r);
+	int i = 0;
+	for (; i + 8 <= m; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(a + i);
+		__m256 y = _mm256_loadu_ps(b + i);
+		_mm256_storeu_ps(lo + i, _mm256_mul_ps(_mm256_add_ps(x, y), vr));
+		_mm256_storeu_ps(hi + i, _mm256_mul_ps(_mm256_sub_ps(x, y), vr));
+	}
+	vsplitScalar(a + i, b + i, lo + i, hi + i, m - i, r);
+}
+
+TSSSS_TARGET_AVX2 static void vmergeAvx2(const float *lo, const float *hi, float *a, float *b, int m, float r)
+{
+	__m256 vr = _mm256_set1_ps(r);
+	int i = 0;
+	for (; i + 8 <= m; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(lo + i);
+		__m256 y = _mm256_loadu_ps(hi + i);
+		_mm256_storeu_ps(a + i, _mm256_mul_ps(_mm256_add_ps(x, y), vr));
+		_mm256_storeu_ps(b + i, _mm256_mul_ps(_mm256_sub_ps(x, y), vr));
+	}
+	vmergeScalar(lo + i, hi + i, a + i, b + i, m - i, r);
+}
+
+// AVX-512, double: 8 lanes.
+// --------------------------------
+TSSSS_TARGET_AVX512 static void splitAvx512(const double *x, double *lo, double *hi, int k, double r)
+{
+	__m512d vr = _mm512_set1_pd(r);
+	__m512i even_idx = _mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0);
+	__m512i odd_idx = _mm512_set_epi64(15, 13, 11, 9, 7, 5, 3, 1);
+	int i = 0;
+	for (; i + 8 <= k; i += 8)
+	{
+		__m512d p = _mm512_loadu_pd(x + 2 * i);
+		__m512d q = _mm512_loadu_pd(x + 2 * i + 8);
+		__m512d even = _mm512_permutex2var_pd(p, even_idx, q);
+		__m512d odd = _mm512_permutex2var_pd(p, odd_idx, q);
+		_mm512_storeu_pd(lo + i, _mm512_mul_pd(_mm512_add_pd(even, odd), vr));
+		_mm512_storeu_pd(hi + i, _mm512_mul_pd(_mm512_sub_pd(even, odd), vr));
+	}
+	splitScalar(x + 2 * i, lo + i, hi + i, k - i, r);
+}
+
+TSSSS_TARGET_AVX512 static void mergeAvx512(const double *lo, const double *hi, double *x, int k, double r)
+{
+	if (k < MERGE_MIN_VECTOR)
+	{
+		mergeScalar(lo, hi, x, k, r);
+		return;
+	}
+	__m512d vr = _mm512_set1_pd(r);
+	__m512i lo_idx = _mm512_set_epi64(11, 3, 10, 2, 9, 1, 8, 0);
+	__m512i hi_idx = _mm512_set_epi64(15, 7, 14, 6, 13, 5, 12, 4);
+	int tail = k % 8;
+	mergeScalar(lo + k - tail, hi + k - tail, x + 2 * (k - tail), tail, r);
+	for (int i = k - tail - 8; 0 <= i; i -= 8)
+	{
+		__m512d a = _mm512_loadu_pd(lo + i);
+		__m512d b = _mm512_loadu_pd(hi + i);
+		__m512d even = _mm512_mul_pd(_mm512_add_pd(a, b), vr);
+		__m512d odd = _mm512_mul_pd(_mm512_sub_pd(a, b), vr);
+		_mm512_storeu_pd(x + 2 * i, _mm512_permutex2var_pd(even, lo_idx, odd));
+		_mm512_storeu_pd(x + 2 * i + 8, _mm512_permutex2var_pd(even, hi_idx, odd));
+	}
+}
+
+TSSSS_TARGET_AVX512 static void vsplitAvx512(const double *a, const double *b, double *lo, double *hi, int m, double r)
+{
+	__m512d vr = _mm512_set1_pd(r);
+	int i = 0;
+	for (; i + 8 <= m; i += 8)
+	{
+		__m512d x = _mm512_loadu_pd(a + i);
+		__m512d y = _mm512_loadu_pd(b + i);
+		_mm512_storeu_pd(lo + i, _mm512_mul_pd(_mm512_add_pd(x, y), vr));
+		_mm512_storeu_pd(hi + i, _mm512_mul_pd(_mm512_sub_pd(x, y), vr));
+	}
+	vsplitScalar(a + i, b + i, lo + i, hi + i, m - i, r);
+}
+
+TSSSS_TARGET_AVX512 static void vmergeAvx512(const double *lo, const double *hi, double *a, double *b, int m, double r)
+{
+	__m512d vr = _mm512_set1_pd(r);
+	int i = 0;
+	for (; i + 8 <= m; i += 8)
+	{
+		__m512d x = _mm512_loadu_pd(lo + i);
+		__m512d y = _mm512_loadu_pd(hi + i);
+		_mm512_storeu_pd(a + i, _mm512_mul_pd(_mm512_add_pd(x, y), vr));
+		_mm512_storeu_pd(b + i, _mm512_mul_pd(_mm512_sub_pd(x, y), vr));
+	}
+	vmergeScalar(lo + i, hi + i, a + i, b + i, m - i, r);
+}
+
+// AVX-512, float: 16 lanes.
+// --------------------------------
+TSSSS_TARGET_AVX512 static void splitAvx512(const float *x, float *lo, float *hi, int k, float r)
+{
+	__m512 vr = _mm512_set1_ps(r);
+	__m512i even_idx = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+	__m512i odd_idx = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+	int i = 0;
+	for (; i + 16 <= k; i += 16)
+	{
+		__m512 p = _mm512_loadu_ps(x + 2 * i);
+		__m512 q = _mm512_loadu_ps(x + 2 * i + 16);
+		__m512 even = _mm512_permutex2var_ps(p, even_idx, q);
+		__m512 odd = _mm512_permutex2var_ps(p, odd_idx, q);
+		_mm512_storeu_ps(lo + i, _mm512_mul_ps(_mm512_add_ps(even, odd), vr));
+		_mm512_storeu_ps(hi + i, _mm512_mul_ps(_mm512_sub_ps(even, odd), vr));
+	}
+	splitScalar(x + 2 * i, lo + i, hi + i, k - i, r);
+}
+
+TSSSS_TARGET_AVX512 static void mergeAvx512(const float *lo, const float *hi, float *x, int k, float r)
+{
+	if (k < MERGE_MIN_VECTOR)
+	{
+		mergeScalar(lo, hi, x, k, r);
+		return;
+	}
+	__m512 vr = _mm512_set1_ps(r);
+	__m512i lo_idx = _mm512_set_epi32(23, 7, 22, 6, 21, 5, 20, 4, 19, 3, 18, 2, 17, 1, 16, 0);
+	__m512i hi_idx = _mm512_set_epi32(31, 15, 30, 14, 29, 13, 28, 12, 27, 11, 26, 10, 25, 9, 24, 8);
+	int tail = k % 16;
+	mergeScalar(lo + k - tail, hi + k - tail, x + 2 * (k - tail), tail, r);
+	for (int i = k - tail - 16; 0 <= i; i -= 16)
+	{
+		__m512 a = _mm512_loadu_ps(lo + i);
+		__m512 b = _mm512_loadu_ps(hi + i);
+		__m512 even = _mm512_mul_ps(_mm512_add_ps(a, b), vr);
+		__m512 odd = _mm512_mul_ps(_mm512_sub_ps(a, b), vr);
+		_mm512_storeu_ps(x + 2 * i, _mm512_permutex2var_ps(even, lo_idx, odd));
+		_mm512_storeu_ps(x + 2 * i + 16, _mm512_permutex2var_ps(even, hi_idx, odd));
+	}
+}
+
+TSSSS_TARGET_AVX512 static void vsplitAvx512(const float *a, const float *b, float *lo, float *hi, int m, float r)
+{
+	__m512 vr = _mm512_set1_ps(r);
+	int i = 0;
+	for (; i + 16 <= m; i += 16)
+	{
+		__m512 x = _mm512_loadu_ps(a + i);
+		__m512 y = _mm512_loadu_ps(b + i);
+		_mm512_storeu_ps(lo + i, _mm512_mul_ps(_mm512_add_ps(x, y), vr));
+		_mm512_storeu_ps(hi + i, _mm512_mul_ps(_mm512_sub_ps(x, y), vr));
+	}
+	vsplitScalar(a + i, b + i, lo + i, hi + i, m - i, r);
+}
+
+TSSSS_TARGET_AVX512 static void vmergeAvx512(const float *lo, const float *hi, float *a, float *b, int m, float r)
+{
+	__m512 vr = _mm512_set1_ps(r);
+	int i = 0;
+	for (; i + 16 <= m; i += 16)
+	{
+		__m512 x = _mm512_loadu_ps(lo + i);
+		__m512 y = _mm512_loadu_ps(hi + i);
+		_mm512_storeu_ps(a + i, _mm512_mul_ps(_mm512_add_ps(x, y), vr));
+		_mm512_storeu_ps(b + i, _mm512_mul_ps(_mm512_sub_ps(x, y), vr));
+	}
+	vmergeScalar(lo + i, hi + i, a + i, b + i, m - i, r);
+}
+#endif
+
+template <typename T>
+static HaarKernels<T> haarKernels()
+{
+	HaarKernels<T> kernels = {splitScalar<T>, mergeScalar<T>, vsplitScalar<T>, vmergeScalar<T>};
+#if TSSSS_X86
+	switch (simd_level())
+	{
+	case SimdLevel::AVX512:
+		kernels = {splitAvx512, mergeAvx512, vsplitAvx512, vmergeAvx512};
+		break;
+	case SimdLevel::AVX2:
+		kernels = {splitAvx2, mergeAvx2, vsplitAvx2, vmergeAvx2};
+		break;
+	default:
+		break;
+	}
+#endif
+	return kernels;
+}
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_simd(int m, int n, T u[], T w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_SIMD computes the Haar transform of an array with vector kernels.
+//
+//  Discussion:
+//
+//    The kernels are picked at run time from the best instruction set the
+//    CPU supports (AVX-512, AVX2, or a scalar fallback).  Instead of dividing
+//    by sqrt(2) every butterfly multiplies by a precomputed 1/sqrt(2), so
+//    the coefficients match HAAR_2D up to rounding.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_WORK_SIZE(M,N)].
+//
+{
+	int j;
+	int k;
+	int k_max;
+	T r;
+	HaarKernels<T> kernels;
+
+	r = T(1) / sqrt(T(2));
+	kernels = haarKernels<T>();
+	//
+	//  Transform all columns.
+	//
+	k_max = 1;
+	while (k_max * 2 <= m)
+	{
+		k_max = k_max * 2;
+	}
+	for (j = 0; j < n; j++)
+	{
+		T *x = u + j * m;
+		k = k_max;
+		while (1 < k)
+		{
+			k = k / 2;
+			kernels.split(x, x, w, k, r);
+			memcpy(x + k, w, k * sizeof(T));
+		}
+	}
+	//
+	//  Transform all rows.
+	//
+	k = 1;
+	while (k * 2 <= n)
+	{
+		k = k * 2;
+	}
+	while (1 < k)
+	{
+		k = k / 2;
+		for (j = 0; j < k; j++)
+		{
+			kernels.vsplit(u + 2 * j * m, u + (2 * j + 1) * m, u + j * m, w + j * m, m, r);
+		}
+		memcpy(u + k * m, w, (size_t)k * m * sizeof(T));
+	}
+
+	return;
+}
+template void haar_2d_simd<float>(int m, int n, float u[], float w[]);
+template void haar_2d_simd<double>(int m, int n, double u[], double w[]);
+//****************************************************************************80
+
+template <typename T>
+void haar_2d_inverse_simd(int m, int n, T u[], T w[])
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INVERSE_SIMD inverts the Haar transform of an array with vector
+//    kernels.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input/output, T U[M*N], the array to be transformed.
+//
+//    Workspace, T W[HAAR_2D_WORK_SIZE(M,N)].
+//
+{
+	int j;
+	int k;
+	T r;
+	HaarKernels<T> kernels;
+
+	r = T(1) / sqrt(T(2));
+	kernels = haarKernels<T>();
+	//
+	//  Inverse transform of all rows.
+	//
+	k = 1;
+	while (k * 2 <= n)
+	{
+		memcpy(w, u + k * m, (size_t)k * m * sizeof(T));
+		for (j = k - 1; 0 <= j; j--)
+		{
+			kernels.vmerge(u + j * m, w + j * m, u + 2 * j * m, u + (2 * j + 1) * m, m, r);
+		}
+		k = k * 2;
+	}
+	//
+	//  Inverse transform of all columns.
+	//
+	for (j = 0; j < n; j++)
+	{
+		T *x = u + j * m;
+		k = 1;
+		while (k * 2 <= m)
+		{
+			memcpy(w, x + k, k * sizeof(T));
+			kernels.merge(x, w, x, k, r);
+			k = k * 2;
+		}
+	}
+
+	return;
+}
+template void haar_2d_inverse_simd<float>(int m, int n, float u[], float w[]);
+template void haar_2d_inverse_simd<double>(int m, int n, double u[], double w[]);
@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "haar.hpp"
+#include "mapped_file.hpp"
+
+//****************************************************************************80
+
+static bool haar_2d_file_panels(int m, int n, int elem_size, size_t budget, int &cols, int &rows,
+	int &view_cols)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_FILE_PANELS splits a file transform into panels that fit a
+//    memory budget.
+//
+//  Discussion:
+//
+//    The column pass maps COLS whole columns at a time and needs workspace
+//    for one column.  The row pass gathers ROWS whole rows into a buffer,
+//    which with its workspace takes half the budget, and reads and writes
+//    them through views of VIEW_COLS columns, which take the other half.
+//    A view of the row pass only touches the pages holding its ROWS entries
+//    of each column, so it is the pages touched, not the length of the
+//    view, that count against the budget.  Each panel faults in those pages
+//    anew, so the row pass is much faster once the budget allows panels of
+//    a page of rows or more.
+//
+//  Parameters:
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input, int ELEM_SIZE, the size of an entry in bytes.
+//
+//    Input, size_t BUDGET, the memory budget in bytes.
+//
+//    Output, int &COLS, &ROWS, &VIEW_COLS, the panel sizes.
+//
+//    Output, bool HAAR_2D_FILE_PANELS, false if the budget cannot hold a
+//    single column or a single row.
+//
+{
+	size_t column;
+	size_t page;
+	size_t row;
+	size_t touched;
+
+	column = (size_t)m * elem_size;
+	row = ((size_t)n + n / 2) * elem_size;
+	page = MappedFile::pageSize();
+
+	if (budget < column + (size_t)haar_1d_work_size(m) * elem_size || budget / 2 < row)
+	{
+		return false;
+	}
+	cols = (int)min((budget - (size_t)haar_1d_work_size(m) * elem_size) / column, (size_t)n);
+	rows = (int)min(budget / 2 / row, (size_t)m);
+	//
+	//  A page shared by two panels is faulted in by both, so panels of more
+	//  than a page of rows start on page boundaries.
+	//
+	if (page / elem_size <= (size_t)rows && rows < m)
+	{
+		rows = rows - rows % (int)(page / elem_size);
+	}
+	//
+	//  ROWS entries of a column straddle at most this many pages.
+	//
+	touched = ((size_t)rows * elem_size + page - 1) / page * page + page;
+	view_cols = (int)min(max(budget / 2 / touched, (size_t)1), (size_t)n);
+
+	return true;
+}
+//****************************************************************************80
+
+template <typename T>
+static bool haar_2d_file_columns(MappedFile &file, uint64_t offset, int m, int n, int cols, bool inverse)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_FILE_COLUMNS transforms every column of an array in a file.
+//
+//  Parameters:
+//
+//    Input, MappedFile &FILE, the file.
+//
+//    Input, uint64_t OFFSET, the position of the array in the file, in bytes.
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input, int COLS, the number of columns to map at a time.
+//
+//    Input, bool INVERSE, true to invert the transform.
+//
+//    Output, bool HAAR_2D_FILE_COLUMNS, false if a view could not be mapped.
+//
+{
+	int j;
+	int j0;
+	int nc;
+	T *u;
+	vector<T> w(haar_1d_work_size(m));
+
+	for (j0 = 0; j0 < n; j0 = j0 + cols)
+	{
+		nc = i4_min(cols, n - j0);
+		u = (T *)file.map(offset + (uint64_t)j0 * m * sizeof(T), (size_t)nc * m * sizeof(T));
+		if (!u)
+		{
+			return false;
+		}
+		for (j = 0; j < nc; j++)
+		{
+			if (inverse)
+			{
+				haar_1d_inverse(m, u + (size_t)j * m, w.data());
+			}
+			else
+			{
+				haar_1d(m, u + (size_t)j * m, w.data());
+			}
+		}
+		file.unmap();
+	}
+
+	return true;
+}
+//****************************************************************************80
+
+template <typename T>
+static bool haar_2d_file_rows(MappedFile &file, uint64_t offset, int m, int n, int rows, int view_cols,
+	bool inverse)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_FILE_ROWS transforms every row of an array in a file.
+//
+//  Discussion:
+//
+//    The rows are strided across the whole file, so a panel of ROWS rows is
+//    gathered into a buffer through views of VIEW_COLS columns, transformed
+//    there by HAAR_2D_ROWS, and scattered back the same way.  Each view
+//    only touches the pages holding the panel.
+//
+//  Parameters:
+//
+//    Input, MappedFile &FILE, the file.
+//
+//    Input, uint64_t OFFSET, the position of the array in the file, in bytes.
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input, int ROWS, the number of rows per panel.
+//
+//    Input, int VIEW_COLS, the number of columns to map at a time.
+//
+//    Input, bool INVERSE, true to invert the transform.
+//
+//    Output, bool HAAR_2D_FILE_ROWS, false if a view could not be mapped.
+//
+{
+	int i0;
+	int j;
+	int j0;
+	int nc;
+	int nr;
+	int pass;
+	T *u;
+	vector<T> panel((size_t)rows * n);
+	vector<T> w(max((size_t)rows * (n / 2), (size_t)1));
+
+	for (i0 = 0; i0 < m; i0 = i0 + rows)
+	{
+		nr = i4_min(rows, m - i0);
+		//
+		//  Pass 0 gathers the panel, pass 1 scatters it back.
+		//
+		for (pass = 0; pass < 2; pass++)
+		{
+			if (pass == 1)
+			{
+				if (inverse)
+				{
+					haar_2d_rows_inverse(nr, n, panel.data(), nr, w.data());
+				}
+				else
+				{
+					haar_2d_rows(nr, n, panel.data(), nr, w.data());
+				}
+			}
+			for (j0 = 0; j0 < n; j0 = j0 + view_cols)
+			{
+				nc = i4_min(view_cols, n - j0);
+				u = (T *)file.map(offset + ((uint64_t)j0 * m + i0) * sizeof(T),
+					((size_t)(nc - 1) * m + nr) * sizeof(T));
+				if (!u)
+				{
+					return false;
+				}
+				for (j = 0; j < nc; j++)
+				{
+					if (pass == 0)
+					{
+						memcpy(panel.data() + (size_t)(j0 + j) * nr, u + (size_t)j * m, nr * sizeof(T));
+					}
+					else
+					{
+						memcpy(u + (size_t)j * m, panel.data() + (size_t)(j0 + j) * nr, nr * sizeof(T));
+					}
+				}
+				file.unmap();
+			}
+		}
+	}
+
+	return true;
+}
+//****************************************************************************80
+
+template <typename T>
+bool haar_2d_file(MappedFile &file, uint64_t offset, int m, int n, size_t budget)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_FILE computes the Haar transform of an array stored in a file.
+//
+//  Discussion:
+//
+//    The array is stored by columns at OFFSET in FILE, which must be open
+//    for writing, and is transformed in place.  It is never loaded as a
+//    whole: the column pass works on panels of whole columns and the row
+//    pass on panels of whole rows, mapped or buffered so that the memory
+//    in use stays within BUDGET bytes.  This lets arrays far larger than
+//    the memory of the machine be transformed.  The coefficients are
+//    bit-identical to HAAR_2D.
+//
+//    A panel needs at least one column and one row, so BUDGET must be at
+//    least about twice the larger of M and 1.5 * N entries.
+//
+//  Parameters:
+//
+//    Input, MappedFile &FILE, the file.
+//
+//    Input, uint64_t OFFSET, the position of the array in the file, in bytes.
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input, size_t BUDGET, the memory budget in bytes.
+//
+//    Output, bool HAAR_2D_FILE, false if the budget is too small, the file
+//    too short, or a view could not be mapped.  The array is left partly
+//    transformed if mapping fails midway.
+//
+{
+	int cols;
+	int rows;
+	int view_cols;
+
+	if (offset + (uint64_t)m * n * sizeof(T) > file.size())
+	{
+		return false;
+	}
+	if (!haar_2d_file_panels(m, n, sizeof(T), budget, cols, rows, view_cols))
+	{
+		return false;
+	}
+	//
+	//  Transform all columns, then all rows.
+	//
+	if (!haar_2d_file_columns<T>(file, offset, m, n, cols, false))
+	{
+		return false;
+	}
+
+	return haar_2d_file_rows<T>(file, offset, m, n, rows, view_cols, false);
+}
+template bool haar_2d_file<float>(MappedFile &file, uint64_t offset, int m, int n, size_t budget);
+template bool haar_2d_file<double>(MappedFile &file, uint64_t offset, int m, int n, size_t budget);
+//****************************************************************************80
+
+template <typename T>
+bool haar_2d_inverse_file(MappedFile &file, uint64_t offset, int m, int n, size_t budget)
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HAAR_2D_INVERSE_FILE inverts the Haar transform of an array stored in
+//    a file.
+//
+//  Parameters:
+//
+//    Input, MappedFile &FILE, the file.
+//
+//    Input, uint64_t OFFSET, the position of the array in the file, in bytes.
+//
+//    Input, int M, N, the dimensions of the array.
+//
+//    Input, size_t BUDGET, the memory budget in bytes.
+//
+//    Output, bool HAAR_2D_INVERSE_FILE, false if the budget is too small,
+//    the file too short, or a view could not be mapped.
+//
+{
+	int cols;
+	int rows;
+	int view_cols;
+
+	if (offset + (uint64_t)m * n * sizeof(T) > file.size())
+	{
+		return false;
+	}
+	if (!haar_2d_file_panels(m, n, sizeof(T), budget, cols, rows, view_cols))
+	{
+		return false;
+	}
+	//
+	//  Inverse transform of all rows, then all columns.
+	//
+	if (!haar_2d_file_rows<T>(file, offset, m, n, rows, view_cols, true))
+	{
+		return false;
+	}
+
+	return haar_2d_file_columns<T>(file, offset, m, n, cols, true);
+}
+template bool haar_2d_inverse_file<float>(MappedFile &file, uint64_t offset, int m, int n, size_t budget);
+template bool haar_2d_inverse_file<double>(MappedFile &file, uint64_t offset, int m, int n, size_t budget);
@@ -9,11 +9,18 @@
 #include <fstream>
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <algorithm>
+#include <vector>
 
 #include "camera.hpp"
+#include "haar.hpp"
 #include "model.hpp"
+#include "readback_ring.hpp"
 #include "shader.hpp"
+#include "sstx.hpp"
+#include "sstx_file.hpp"
 #include "texture.hpp"
+#include "tssss.hpp"
 
 class GLTimer
 {
@@ -65,6 +72,7 @@ void processInput(GLFWwindow *window);
 unsigned int loadTexture(const char *path, bool gammaCorrection);
 void renderQuad();
 void renderCube();
+bool lightDirtyRects(const std::vector<float> &bounds, glm::vec3 from, glm::vec3 to, std::vector<glm::ivec4> &rects);
 GLenum glCheckError_(const char *file, int line);
 #define glCheckError() glCheckError_(__FILE__, __LINE__)
 
@@ -81,14 +89,6 @@ float lastY = (float)SCR_HEIGHT / 2.0;
 bool firstMouse = true;
 const float move_speed = 0.01;
 
-namespace tssss
-{
-	const unsigned int tex_w = 512;
-	const unsigned int tex_h = 512;
-	const unsigned int coef_w = 16;
-	const unsigned int coef_h = 16;
-}
-
 enum class RenderingMode
 {
 	DEFERRED,
@@ -98,6 +98,25 @@ enum class RenderingMode
 };
 
 RenderingMode mode = RenderingMode::SSS;
+HaarMode haar_mode = HaarMode::STANDARD;
+Wavelet wavelet = Wavelet::HAAR;
+// In the HAAR mode, only save the world position map for tssss-bake.
+bool world_pos_only = false;
+// In the HAAR mode, bake one kernel per dispatch and show each in the window
+// until it is closed, instead of baking tiles of kernels.
+bool inspect_kernels = false;
+// Share of the profile's energy the baked kernels drop, see
+// tssss::profile_cutoff_energy; 0 keeps all of it.
+double cutoff_energy = tssss::profile_cutoff_energy;
+// Rectangles (row, col, rows, cols) of the radiance map that changed since the
+// last frame, so that pass 2 only redoes the boxes they reach. Empty means the
+// whole map changed.
+std::vector<glm::ivec4> radiance_dirty_rects;
+// With -point-light, pass 1 adds a point light moved with the arrow keys,
+// PAGE UP and PAGE DOWN. It reaches tssss::light_range, so moving it only
+// changes the radiance around where it was and where it is.
+bool point_light = false;
+glm::vec3 light_pos(0.0f, 0.0f, 0.5f);
 
 int main(int argc, char **argv)
 {
@@ -113,6 +132,40 @@ int main(int argc, char **argv)
 		{
 			mode = RenderingMode::FORWARD;
 		}
+		else if (!strcmp(argv[i], "-haar"))
+		{
+			mode = RenderingMode::HAAR;
+		}
+		else if (!strcmp(argv[i], "-world-pos"))
+		{
+			mode = RenderingMode::HAAR;
+			world_pos_only = true;
+		}
+		else if (!strcmp(argv[i], "-inspect"))
+		{
+			mode = RenderingMode::HAAR;
+			inspect_kernels = true;
+		}
+		else if (!strcmp(argv[i], "-nonstandard"))
+		{
+			haar_mode = HaarMode::NONSTANDARD;
+		}
+		else if (!strcmp(argv[i], "-cdf53"))
+		{
+			wavelet = Wavelet::CDF53;
+		}
+		else if (!strcmp(argv[i], "-cdf97"))
+		{
+			wavelet = Wavelet::CDF97;
+		}
+		else if (!strcmp(argv[i], "-cutoff") && i + 1 < argc)
+		{
+			cutoff_energy = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-point-light"))
+		{
+			point_light = true;
+		}
 	}
 	// glfw: initialize and configure
 	// --------------------------------
@@ -182,12 +235,14 @@ int main(int argc, char **argv)
 	// - main passes
 	Shader sHaarPass1("shader/HaarPass1.vs.glsl", "shader/HaarPass1.fs.glsl");
 	Shader sHaarPass2("shader/HaarPass2.cs.glsl");
+	Shader sHaarBake("shader/HaarBake.cs.glsl");
 	Shader sRenderPass1("shader/RenderPass1.vs.glsl", "shader/RenderPass1.fs.glsl");
 	Shader sRenderPass2("shader/RenderPass2.cs.glsl");
 	Shader sRenderPass3("shader/RenderPass3.vs.glsl", "shader/RenderPass3.fs.glsl");
 	// - verification tools
 	Shader sCheckImage("shader/CheckImage.vs.glsl", "shader/CheckImage.fs.glsl");
 	Shader sConvolveCoef("shader/ConvolveCoef.cs.glsl");
+	Shader sLowRankProject("shader/LowRankProject.cs.glsl");
 	Shader sInverseHaar("shader/InverseHaar.cs.glsl");
 
 	// load models
@@ -203,7 +258,8 @@ int main(int argc, char **argv)
 	// Framebuffer and texture generation.
 	// --------------------------------
 	GLuint fBuffer;
-	GLuint tssss_radiance_map, tssss_radiance_map_after_sss, tssss_world_pos_map, tssss_kernel, haar_wavelet_temp_image;
+	GLuint tssss_radiance_map, tssss_radiance_map_after_sss, tssss_radiance_map_blurred, tssss_world_pos_map, tssss_kernel,
+		haar_wavelet_temp_image;
 	if (mode == RenderingMode::HAAR)
 	{
 		// Framebuffer for pass 1
@@ -275,11 +331,30 @@ int main(int argc, char **argv)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		// blurred radiance map, which pass 2 keeps outside the dirty rects
+		glGenTextures(1, &tssss_radiance_map_blurred);
+		glBindTexture(GL_TEXTURE_2D, tssss_radiance_map_blurred);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, tssss::tex_w, tssss::tex_h, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		// world position map, only to find the boxes the light reaches
+		glGenTextures(1, &tssss_world_pos_map);
+		glBindTexture(GL_TEXTURE_2D, tssss_world_pos_map);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, tssss::tex_w, tssss::tex_h, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	}
 
 	// Create SSBOs
 	// --------------------------------
-	GLuint ssbo_radiance_coef, ssbo_kernel_coef, ssbo_haar_mat1, ssbo_haar_mat2;
+	GLuint ssbo_radiance_coef, ssbo_kernel_coef, ssbo_kernel_index, ssbo_box_sums, ssbo_bake_scratch, ssbo_box_bounds,
+		ssbo_haar_mat1, ssbo_haar_mat2, ssbo_lowrank_basis, ssbo_lowrank_weights, ssbo_lowrank_projection;
+	// Rank of the low-rank kernels the SSS mode samples, 0 without them.
+	int lowrank_rank = 0;
 	if (mode == RenderingMode::HAAR)
 	{
 		glGenBuffers(1, &ssbo_radiance_coef);
@@ -289,9 +364,24 @@ int main(int argc, char **argv)
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 		glGenBuffers(1, &ssbo_kernel_coef);
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_kernel_coef);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, tssss::coef_w * tssss::coef_h * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, tssss::coef_k * sizeof(SstxCoef), nullptr, GL_DYNAMIC_DRAW);
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssbo_kernel_coef);
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		// For the CDF wavelets, a kernel sized slice of scratch per kernel of a
+		// bake tile.
+		glGenBuffers(1, &ssbo_bake_scratch);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_bake_scratch);
+		size_t scratch_size = wavelet == Wavelet::HAAR ? 1 : (size_t)tssss::bake_tile * tssss::tex_w * tssss::tex_h;
+		glBufferData(GL_SHADER_STORAGE_BUFFER, scratch_size * sizeof(float), nullptr, GL_DYNAMIC_COPY);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, ssbo_bake_scratch);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		// World-space bounds of the boxes of the low-pass band, which the bake
+		// culls kernels by, filled once the world position map is rendered.
+		glGenBuffers(1, &ssbo_box_bounds);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_box_bounds);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, tssss::coef_w * tssss::coef_h * 2 * sizeof(glm::vec4), nullptr, GL_STATIC_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, ssbo_box_bounds);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 	}
 	else if (mode == RenderingMode::SSS)
 	{
@@ -300,11 +390,120 @@ int main(int argc, char **argv)
 		glBufferData(GL_SHADER_STORAGE_BUFFER, tssss::coef_w * tssss::coef_h * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo_radiance_coef);
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		// Kernels are sampled through the codebook tssss-bake -codebook makes:
+		// KernelCoef holds its entries and KernelIndex the entry of each texel.
+		// Without a codebook the kernels of coef_file are uploaded from where
+		// they are mapped, each texel its own entry. Files baked for another
+		// size, decomposition or wavelet are not used, nor a codebook made
+		// from another coef_file than the one there is.
+		auto matches = [](const SstxHeader &header) {
+			return header.tex_w == tssss::tex_w && header.tex_h == tssss::tex_h && header.coef_w == tssss::coef_w &&
+				header.coef_h == tssss::coef_h && header.coef_k == tssss::coef_k &&
+				header.haar_mode == (uint32_t)haar_mode && header.wavelet == (uint32_t)wavelet;
+		};
+		SstxFile coef_file;
+		bool coef_open = coef_file.open(tssss::coef_file, false);
+		bool coef_read = coef_open && matches(coef_file.header());
+		SstxCodebookHeader codebook_header;
+		SstxHeader sstx_header;
+		std::vector<SstxCoef> codebook_entries(tssss::coef_k);
+		std::vector<uint32_t> kernel_index(tssss::tex_w * tssss::tex_h);
+		ifstream codebook_file(tssss::codebook_file, ios::binary);
+		bool codebook_read = codebook_header.read(codebook_file) && sstx_header.read(codebook_file) &&
+			matches(sstx_header) && 0 < codebook_header.entries;
+		if (codebook_read && coef_open && sstx_header.checksum != coef_file.header().checksum)
+		{
+			std::cout << tssss::codebook_file << " was not made from " << tssss::coef_file << ", ignoring it" << std::endl;
+			codebook_read = false;
+		}
+		if (codebook_read)
+		{
+			codebook_entries.resize((size_t)codebook_header.entries * tssss::coef_k);
+			codebook_file.read((char *)codebook_entries.data(), codebook_entries.size() * sizeof(SstxCoef));
+			codebook_file.read((char *)kernel_index.data(), kernel_index.size() * sizeof(uint32_t));
+			codebook_read = codebook_file.good() &&
+				std::all_of(kernel_index.begin(), kernel_index.end(),
+					[&](uint32_t entry) { return entry < codebook_header.entries; });
+		}
+		const SstxCoef *entries = codebook_entries.data();
+		size_t entries_size = codebook_entries.size() * sizeof(SstxCoef);
+		if (!codebook_read && coef_read)
+		{
+			entries = coef_file.kernels();
+			entries_size = kernel_index.size() * coef_file.header().kernelBytes();
+			for (uint32_t t = 0; t < kernel_index.size(); t++)
+				kernel_index[t] = t;
+		}
+		else if (!codebook_read)
+		{
+			std::cout << "Failed to read " << tssss::codebook_file << " or " << tssss::coef_file << ", the kernels are 0"
+					  << std::endl;
+			codebook_entries.assign(tssss::coef_k, SstxCoef{0, 0.0f});
+			entries = codebook_entries.data();
+			entries_size = codebook_entries.size() * sizeof(SstxCoef);
+			std::fill(kernel_index.begin(), kernel_index.end(), 0);
+		}
 		glGenBuffers(1, &ssbo_kernel_coef);
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_kernel_coef);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, tssss::tex_w * tssss::tex_h * tssss::coef_w * tssss::coef_h * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, entries_size, entries, GL_STATIC_DRAW);
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssbo_kernel_coef);
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		// The factorization tssss-bake -lowrank makes takes the place of the
+		// sparse kernels when there is one for coef_file: a texel then reads
+		// lowrank_rank weights, and LowRankProject the basis once a frame.
+		SstxLowRankHeader lowrank_header;
+		std::vector<float> lowrank_basis, lowrank_weights;
+		ifstream lowrank_file(tssss::lowrank_file, ios::binary);
+		bool lowrank_read = lowrank_header.read(lowrank_file) && sstx_header.read(lowrank_file) &&
+			matches(sstx_header) && 0 < lowrank_header.rank && lowrank_header.rank <= tssss::coef_w * tssss::coef_h;
+		if (lowrank_read && coef_open && sstx_header.checksum != coef_file.header().checksum)
+		{
+			std::cout << tssss::lowrank_file << " was not made from " << tssss::coef_file << ", ignoring it" << std::endl;
+			lowrank_read = false;
+		}
+		if (lowrank_read)
+		{
+			lowrank_basis.resize((size_t)lowrank_header.rank * tssss::coef_w * tssss::coef_h);
+			lowrank_weights.resize((size_t)lowrank_header.rank * tssss::tex_w * tssss::tex_h);
+			lowrank_file.read((char *)lowrank_basis.data(), lowrank_basis.size() * sizeof(float));
+			lowrank_file.read((char *)lowrank_weights.data(), lowrank_weights.size() * sizeof(float));
+			lowrank_read = lowrank_file.good();
+		}
+		if (lowrank_read)
+		{
+			lowrank_rank = (int)lowrank_header.rank;
+			std::cout << "Sampling the kernels at rank " << lowrank_rank << " from " << tssss::lowrank_file
+					  << ", squared error " << lowrank_header.error << std::endl;
+		}
+		else
+		{
+			lowrank_basis.assign(1, 0.0f);
+			lowrank_weights.assign(1, 0.0f);
+		}
+		glGenBuffers(1, &ssbo_lowrank_basis);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_lowrank_basis);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, lowrank_basis.size() * sizeof(float), lowrank_basis.data(), GL_STATIC_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, ssbo_lowrank_basis);
+		glGenBuffers(1, &ssbo_lowrank_weights);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_lowrank_weights);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, lowrank_weights.size() * sizeof(float), lowrank_weights.data(), GL_STATIC_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, ssbo_lowrank_weights);
+		glGenBuffers(1, &ssbo_lowrank_projection);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_lowrank_projection);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(lowrank_rank, 1) * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, ssbo_lowrank_projection);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		coef_file.close();
+		glGenBuffers(1, &ssbo_kernel_index);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_kernel_index);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, kernel_index.size() * sizeof(uint32_t), kernel_index.data(), GL_STATIC_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, ssbo_kernel_index);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glGenBuffers(1, &ssbo_box_sums);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_box_sums);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, tssss::coef_w * tssss::coef_h * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, ssbo_box_sums);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 	}
 
 	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
@@ -331,6 +530,22 @@ int main(int argc, char **argv)
 		glBindTexture(GL_TEXTURE_2D, smith_diffuse);
 		smith.Draw(sHaarPass1);
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		// Save the map, so that tssss-bake can bake the kernels on the CPU.
+		std::vector<float> world_pos(tssss::tex_w * tssss::tex_h * 4);
+		glBindTexture(GL_TEXTURE_2D, tssss_world_pos_map);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, world_pos.data());
+		ofstream world_pos_file(tssss::world_pos_file, ios::binary);
+		world_pos_file.write((char *)world_pos.data(), world_pos.size() * sizeof(float));
+		world_pos_file.close();
+		if (world_pos_only)
+		{
+			glfwTerminate();
+			return 0;
+		}
+		std::vector<float> box_bounds = tssss::boxBounds(world_pos.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_box_bounds);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, box_bounds.size() * sizeof(float), box_bounds.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
 		// Pass 2 Kernel
 		// --------------------------------
@@ -339,100 +554,148 @@ int main(int argc, char **argv)
 		// unsigned int row = 0;
 		// unsigned int col = 0;
 		GLTimer timer_haar;
-		ofstream coef_file("test.sstx", ios::binary);
-		for (int row = 0; row < tssss::tex_h; row++)
+		ofstream coef_file(tssss::coef_file, ios::binary);
+		SstxHeader sstx_header;
+		sstx_header.tex_w = tssss::tex_w;
+		sstx_header.tex_h = tssss::tex_h;
+		sstx_header.coef_w = tssss::coef_w;
+		sstx_header.coef_h = tssss::coef_h;
+		sstx_header.haar_mode = (uint32_t)haar_mode;
+		sstx_header.coef_k = tssss::coef_k;
+		sstx_header.wavelet = (uint32_t)wavelet;
+		// HaarPass2 evaluates the whole profile.
+		sstx_header.cutoff_radius = inspect_kernels ? INFINITY : tssss::profileCutoffRadius(cutoff_energy);
+		sstx_header.profile_a = tssss::profile_a;
+		sstx_header.profile_s = tssss::profile_s;
+		SstxFile::begin(coef_file, sstx_header);
+		if (inspect_kernels)
 		{
-			timer_haar.setStart();
-			for (int col = 0; col < tssss::tex_w; col++)
+			for (int row = 0; row < tssss::tex_h; row++)
 			{
-				sHaarPass2.use();
-				sHaarPass2.setInt("coef_w", tssss::coef_w);
-				sHaarPass2.setInt("coef_h", tssss::coef_h);
-				sHaarPass2.setInt("tex_w", tssss::tex_w);
-				sHaarPass2.setInt("tex_h", tssss::tex_h);
-				glBindImageTexture(0, tssss_world_pos_map, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-				glBindImageTexture(1, tssss_kernel, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-				glBindImageTexture(2, haar_wavelet_temp_image, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-				sHaarPass2.setVec2i("index_kernel_iv", glm::ivec2(row, col));
-				glDispatchCompute(1, 1, 1);
-				glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
-
-				glfwSetWindowShouldClose(window, false);
-				while (!glfwWindowShouldClose(window))
+				timer_haar.setStart();
+				for (int col = 0; col < tssss::tex_w; col++)
 				{
-					// process input
-					// --------------------------------
-					processInput(window);
+					sHaarPass2.use();
+					sHaarPass2.setInt("coef_w", tssss::coef_w);
+					sHaarPass2.setInt("coef_h", tssss::coef_h);
+					sHaarPass2.setInt("coef_k", tssss::coef_k);
+					sHaarPass2.setInt("tex_w", tssss::tex_w);
+					sHaarPass2.setInt("tex_h", tssss::tex_h);
+					sHaarPass2.setInt("haar_mode", (int)haar_mode);
+					sHaarPass2.setInt("wavelet", (int)wavelet);
+					glBindImageTexture(0, tssss_world_pos_map, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+					glBindImageTexture(1, tssss_kernel, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+					glBindImageTexture(2, haar_wavelet_temp_image, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+					sHaarPass2.setVec2i("index_kernel_iv", glm::ivec2(row, col));
+					glDispatchCompute(1, 1, 1);
+					glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
 
-					// Pass
-					// --------------------------------
-					// Check image.
+					glfwSetWindowShouldClose(window, false);
+					while (!glfwWindowShouldClose(window))
+					{
+						// process input
+						// --------------------------------
+						processInput(window);
+
+						// Pass
+						// --------------------------------
+						// Check image.
+						// --------------------------------
+						glBindFramebuffer(GL_FRAMEBUFFER, 0);
+						glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+						glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+						glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+						sCheckImage.use();
+						// glBindImageTexture(0, tssss_radiance_map, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+						glBindImageTexture(1, tssss_world_pos_map, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+						glBindImageTexture(2, tssss_kernel, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+						renderQuad();
+
+						glfwSwapBuffers(window);
+						glfwPollEvents();
+					}
+
+					// Write to file.
 					// --------------------------------
-					glBindFramebuffer(GL_FRAMEBUFFER, 0);
-					glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-					glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-					sCheckImage.use();
-					// glBindImageTexture(0, tssss_radiance_map, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-					glBindImageTexture(1, tssss_world_pos_map, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-					glBindImageTexture(2, tssss_kernel, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-					renderQuad();
-
-					glfwSwapBuffers(window);
-					glfwPollEvents();
+					SstxCoef *kernel_coef_ptr = nullptr;
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_kernel_coef);
+					kernel_coef_ptr = (SstxCoef *)glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_READ_ONLY);
+					coef_file.write((char *)kernel_coef_ptr, tssss::coef_k * sizeof(SstxCoef));
+					glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 				}
-
-				// Write to file.
-				// --------------------------------
-				glm::vec4 *kernel_coef_ptr = nullptr;
-				glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_kernel_coef);
-				kernel_coef_ptr = (glm::vec4 *)glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_READ_WRITE);
-				float *kernel_coef_float_ptr = new float[tssss::coef_h * tssss::coef_w];
-				for (int i = 0; i < tssss::coef_h * tssss::coef_w; i++)
+				timer_haar.setEnd();
+				timer_haar.wait();
+				printf("Time spent on row %d: %f ms\n", row, timer_haar.getTime_ms());
+			}
+		}
+		else
+		{
+			// A tile of kernels per dispatch, one workgroup each, read back
+			// through a ring so that the GPU runs ahead of the file writes.
+			ReadbackRing readback(tssss::bake_ring, tssss::bake_tile * tssss::coef_k * sizeof(SstxCoef), coef_file);
+			if (!readback.persistent())
+			{
+				std::cout << "Failed to map the readback buffer, copying the kernels out instead" << std::endl;
+			}
+			unsigned int kernels = tssss::tex_w * tssss::tex_h;
+			double bake_start = glfwGetTime();
+			sHaarBake.use();
+			sHaarBake.setInt("coef_w", tssss::coef_w);
+			sHaarBake.setInt("coef_h", tssss::coef_h);
+			sHaarBake.setInt("coef_k", tssss::coef_k);
+			sHaarBake.setInt("tex_w", tssss::tex_w);
+			sHaarBake.setInt("tex_h", tssss::tex_h);
+			sHaarBake.setInt("haar_mode", (int)haar_mode);
+			sHaarBake.setInt("wavelet", (int)wavelet);
+			sHaarBake.setFloat("cutoff_radius", sstx_header.cutoff_radius);
+			glBindImageTexture(0, tssss_world_pos_map, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, ssbo_bake_scratch);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, ssbo_box_bounds);
+			for (unsigned int first = 0; first < kernels; first += tssss::bake_tile)
+			{
+				unsigned int count = std::min(tssss::bake_tile, kernels - first);
+				readback.acquire(1);
+				sHaarBake.setInt("kernel_first", first);
+				glDispatchCompute(count, 1, 1);
+				readback.submit(count * tssss::coef_k * sizeof(SstxCoef));
+				if ((first + count) % (16 * tssss::tex_w) == 0 || first + count == kernels)
 				{
-					kernel_coef_float_ptr[i] = kernel_coef_ptr[i].r;
+					printf("Dispatched %u / %u kernels in %.1f s\n", first + count, kernels, glfwGetTime() - bake_start);
 				}
-				coef_file.write((char *)kernel_coef_float_ptr, tssss::coef_h * tssss::coef_w * sizeof(float));
-				delete[] kernel_coef_float_ptr;
-				glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-				glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 			}
-			timer_haar.setEnd();
-			timer_haar.wait();
-			printf("Time spent on row %d: %f ms\n", row, timer_haar.getTime_ms());
+			if (!readback.finish())
+			{
+				std::cout << "Failed to write " << tssss::coef_file << std::endl;
+			}
 		}
 		coef_file.close();
+		if (!SstxFile::seal(tssss::coef_file))
+		{
+			std::cout << "Failed to write " << tssss::coef_file << std::endl;
+		}
 	}
 	// Render loop
 	// --------------------------------
 	else if (mode == RenderingMode::SSS)
 	{
-		// // Read kernel haar coefficients from file and save to SSBO.
-		// // --------------------------------
-		// ifstream coef_file;
-		// coef_file.open("test.sstx", ios::binary);
-		// float *kernel_coef_buffer = new float[32 * 32];
-		// glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_kernel_coef);
-		// glm::vec4 *kernel_coef_ptr = (glm::vec4 *)glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_READ_WRITE);
-		// for (int kernel_i = 0; kernel_i < tssss::tex_h * tssss::tex_w; kernel_i++)
-		// {
-		// 	coef_file.read((char *)kernel_coef_buffer, 32 * 32 * sizeof(float));
-		// 	for (int row = 0; row < tssss::coef_h; row++)
-		// 	{
-		// 		for (int col = 0; col < tssss::coef_w; col++)
-		// 		{
-		// 			kernel_coef_ptr[kernel_i * tssss::coef_w * tssss::coef_h + row * tssss::coef_w + col].r = kernel_coef_buffer[row * 32 + col];
-		// 			kernel_coef_ptr[kernel_i * tssss::coef_w * tssss::coef_h + row * tssss::coef_w + col].g = 0;
-		// 			kernel_coef_ptr[kernel_i * tssss::coef_w * tssss::coef_h + row * tssss::coef_w + col].b = 0;
-		// 			kernel_coef_ptr[kernel_i * tssss::coef_w * tssss::coef_h + row * tssss::coef_w + col].a = 0;
-		// 		}
-		// 	}
-		// }
-		// glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-		// glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-		// delete[] kernel_coef_buffer;
-		// coef_file.close();
-
+		// World-space bounds of the boxes of the band, from the world position
+		// map of the mesh as pass 1 draws it, to find those the light reaches.
+		glBindFramebuffer(GL_FRAMEBUFFER, fBuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tssss_world_pos_map, 0);
+		glViewport(0, 0, tssss::tex_w, tssss::tex_h);
+		glClear(GL_COLOR_BUFFER_BIT);
+		sHaarPass1.use();
+		sHaarPass1.setMat4("model", model);
+		smith.Draw(sHaarPass1);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tssss_radiance_map, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		std::vector<float> world_pos(tssss::tex_w * tssss::tex_h * 4);
+		glBindTexture(GL_TEXTURE_2D, tssss_world_pos_map);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, world_pos.data());
+		std::vector<float> box_bounds = tssss::boxBounds(world_pos.data());
+		bool radiance_valid = false;
+		glm::vec3 lit_pos = light_pos;
 		while (!glfwWindowShouldClose(window))
 		{
 			// process input
@@ -445,40 +708,81 @@ int main(int argc, char **argv)
 			view = camera.GetViewMatrix();
 
 			GLTimer timer;
-			// Pass 1
-			// --------------------------------
-			// Render radiance map into **tssss_radiance_map**.
-			// --------------------------------
-			// timer.setStart();
-			glBindFramebuffer(GL_FRAMEBUFFER, fBuffer);
-			glViewport(0, 0, tssss::tex_w, tssss::tex_h);
-			sRenderPass1.use();
-			sRenderPass1.setMat4("model", model);
-			sRenderPass1.setMat4("view", view);
-			sRenderPass1.setMat4("projection", projection);
-			smith.Draw(sRenderPass1);
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
-			// timer.setEnd();
-			// timer.wait();
-			// printf("Pass 1 Radiance map: %fms. ", timer.getTime_ms());
+			// The radiance map only changes where the light reaches, before or
+			// after it moves, so passes 1 and 2 are skipped while it stays put.
+			bool radiance_changed = !radiance_valid;
+			if (radiance_valid && light_pos != lit_pos)
+			{
+				radiance_changed = lightDirtyRects(box_bounds, lit_pos, light_pos, radiance_dirty_rects);
+			}
+			radiance_valid = true;
+			lit_pos = light_pos;
+			if (radiance_changed)
+			{
+				// Pass 1
+				// --------------------------------
+				// Render radiance map into **tssss_radiance_map**.
+				// --------------------------------
+				// timer.setStart();
+				glBindFramebuffer(GL_FRAMEBUFFER, fBuffer);
+				glViewport(0, 0, tssss::tex_w, tssss::tex_h);
+				sRenderPass1.use();
+				sRenderPass1.setMat4("model", model);
+				sRenderPass1.setMat4("view", view);
+				sRenderPass1.setMat4("projection", projection);
+				sRenderPass1.setBool("point_light", point_light);
+				sRenderPass1.setVec3("light_pos", light_pos);
+				sRenderPass1.setFloat("light_range", tssss::light_range);
+				smith.Draw(sRenderPass1);
+				glBindFramebuffer(GL_FRAMEBUFFER, 0);
+				// timer.setEnd();
+				// timer.wait();
+				// printf("Pass 1 Radiance map: %fms. ", timer.getTime_ms());
 
-			// Pass 2
-			// --------------------------------
-			// Compute haar transformation of radiance map.
-			// --------------------------------
-			// timer.setStart();
-			sRenderPass2.use();
-			sRenderPass2.setInt("coef_w", tssss::coef_w);
-			sRenderPass2.setInt("coef_h", tssss::coef_h);
-			sRenderPass2.setInt("tex_w", tssss::tex_w);
-			sRenderPass2.setInt("tex_h", tssss::tex_h);
-			glBindImageTexture(0, tssss_radiance_map, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-			glBindImageTexture(1, haar_wavelet_temp_image, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-			glDispatchCompute(1, 1, 1);
-			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
-			// timer.setEnd();
-			// timer.wait();
-			// printf("Pass 2 Haar transform: %fms.\n", timer.getTime_ms());
+				// Pass 2
+				// --------------------------------
+				// Compute haar transformation of radiance map.
+				// --------------------------------
+				// timer.setStart();
+				sRenderPass2.use();
+				sRenderPass2.setInt("coef_w", tssss::coef_w);
+				sRenderPass2.setInt("coef_h", tssss::coef_h);
+				sRenderPass2.setInt("tex_w", tssss::tex_w);
+				sRenderPass2.setInt("tex_h", tssss::tex_h);
+				sRenderPass2.setInt("haar_mode", (int)haar_mode);
+				sRenderPass2.setInt("wavelet", (int)wavelet);
+				if (radiance_dirty_rects.size() <= tssss::max_dirty_rects)
+				{
+					sRenderPass2.setInt("dirty_count", (int)radiance_dirty_rects.size());
+					if (!radiance_dirty_rects.empty())
+						sRenderPass2.setVec4iArray("dirty_rects", (int)radiance_dirty_rects.size(), radiance_dirty_rects.data());
+				}
+				else
+				{
+					sRenderPass2.setInt("dirty_count", 0);
+				}
+				radiance_dirty_rects.clear();
+				glBindImageTexture(0, tssss_radiance_map, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+				glBindImageTexture(1, haar_wavelet_temp_image, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+				glBindImageTexture(2, tssss_radiance_map_blurred, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+				glDispatchCompute(1, 1, 1);
+				glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+				// timer.setEnd();
+				// timer.wait();
+				// printf("Pass 2 Haar transform: %fms.\n", timer.getTime_ms());
+
+				// Dot products of the low-rank basis with the new radiance
+				// coefficients, which every texel's weights then combine.
+				if (lowrank_rank > 0)
+				{
+					sLowRankProject.use();
+					sLowRankProject.setInt("coef_w", tssss::coef_w);
+					sLowRankProject.setInt("coef_h", tssss::coef_h);
+					sLowRankProject.setInt("lowrank_rank", lowrank_rank);
+					glDispatchCompute((lowrank_rank + 63) / 64, 1, 1);
+					glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+				}
+			}
 
 			// Test
 			// --------------------------------
@@ -489,7 +793,11 @@ int main(int argc, char **argv)
 			sInverseHaar.setInt("coef_h", tssss::coef_h);
 			sInverseHaar.setInt("tex_w", tssss::tex_w);
 			sInverseHaar.setInt("tex_h", tssss::tex_h);
-			glBindImageTexture(0, tssss_radiance_map, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+			sInverseHaar.setInt("haar_mode", (int)haar_mode);
+			sInverseHaar.setInt("wavelet", (int)wavelet);
+			// Into tssss_radiance_map_after_sss: pass 2 needs the radiance map
+			// as pass 1 left it.
+			glBindImageTexture(0, tssss_radiance_map_after_sss, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
 			glBindImageTexture(1, haar_wavelet_temp_image, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
 			glDispatchCompute(1, 1, 1);
 			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
@@ -515,8 +823,10 @@ int main(int argc, char **argv)
 			// sConvolveCoef.use();
 			// sConvolveCoef.setInt("coef_w", tssss::coef_w);
 			// sConvolveCoef.setInt("coef_h", tssss::coef_h);
+			// sConvolveCoef.setInt("coef_k", tssss::coef_k);
 			// sConvolveCoef.setInt("tex_w", tssss::tex_w);
 			// sConvolveCoef.setInt("tex_h", tssss::tex_h);
+			// sConvolveCoef.setInt("lowrank_rank", lowrank_rank);
 			// glBindImageTexture(0, tssss_radiance_map_after_sss, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
 			// glDispatchCompute(1, 1, 1);
 			// glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
@@ -536,6 +846,7 @@ int main(int argc, char **argv)
 			// sRenderPass3.setMat4("view", view);
 			// sRenderPass3.setMat4("projection", projection);
 			// sRenderPass3.setVec3("view_pos", camera.Position);
+			// sRenderPass3.setInt("lowrank_rank", lowrank_rank);
 			// glActiveTexture(GL_TEXTURE0);
 			// glBindTexture(GL_TEXTURE_2D, smith_diffuse);
 			// smith.Draw(sRenderPass3);
@@ -789,6 +1100,79 @@ void processInput(GLFWwindow *window)
 		camera.ProcessKeyboard(UP, move_speed);
 	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
 		camera.ProcessKeyboard(DOWN, move_speed);
+
+	if (point_light)
+	{
+		if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+			light_pos.x -= move_speed;
+		if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+			light_pos.x += move_speed;
+		if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
+			light_pos.y += move_speed;
+		if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
+			light_pos.y -= move_speed;
+		if (glfwGetKey(window, GLFW_KEY_PAGE_UP) == GLFW_PRESS)
+			light_pos.z -= move_speed;
+		if (glfwGetKey(window, GLFW_KEY_PAGE_DOWN) == GLFW_PRESS)
+			light_pos.z += move_speed;
+	}
+}
+
+// Sets RECTS to the dirty rects of the radiance map when the light moves from
+// FROM to TO: the boxes of the band whose world-space BOUNDS it reaches from
+// either. Boxes next to each other in a row of the band make one rect, as do
+// the same cols of rows next to each other. Returns false if no box changes;
+// past tssss::max_dirty_rects, RECTS is left empty to redo the whole map.
+bool lightDirtyRects(const std::vector<float> &bounds, glm::vec3 from, glm::vec3 to, std::vector<glm::ivec4> &rects)
+{
+	int box_h = 1;
+	while (box_h * 2 <= (int)tssss::tex_h)
+		box_h *= 2;
+	box_h /= tssss::coef_h;
+	int box_w = 1;
+	while (box_w * 2 <= (int)tssss::tex_w)
+		box_w *= 2;
+	box_w /= tssss::coef_w;
+	float range2 = tssss::light_range * tssss::light_range;
+	// Rects that reach the last row of boxes, which the next row may extend.
+	std::vector<size_t> last_row, row;
+	rects.clear();
+	for (unsigned int r = 0; r < tssss::coef_h; r++)
+	{
+		row.clear();
+		unsigned int c = 0;
+		while (c < tssss::coef_w)
+		{
+			unsigned int c0 = c;
+			while (c < tssss::coef_w && (tssss::boxDistance2(bounds, r * tssss::coef_w + c, &from[0]) <= range2 ||
+											tssss::boxDistance2(bounds, r * tssss::coef_w + c, &to[0]) <= range2))
+				c++;
+			if (c0 < c)
+			{
+				glm::ivec4 rect((int)r * box_h, (int)c0 * box_w, box_h, (int)(c - c0) * box_w);
+				auto above = std::find_if(last_row.begin(), last_row.end(),
+					[&](size_t i) { return rects[i].y == rect.y && rects[i].w == rect.w; });
+				if (above != last_row.end())
+				{
+					rects[*above].z += box_h;
+					row.push_back(*above);
+				}
+				else
+				{
+					row.push_back(rects.size());
+					rects.push_back(rect);
+				}
+			}
+			c++;
+		}
+		std::swap(last_row, row);
+		if (tssss::max_dirty_rects < rects.size())
+		{
+			rects.clear();
+			return true;
+		}
+	}
+	return !rects.empty();
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback
@@ -0,0 +1,143 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Offsets of views must be multiples of this.
+static uint64_t mapGranularity()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwAllocationGranularity;
+#else
+	return (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+size_t MappedFile::pageSize()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char *path, bool writable)
+{
+	close();
+	this->writable = writable;
+#ifdef _WIN32
+	file = CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		return false;
+	}
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	file_size = (uint64_t)length.QuadPart;
+	mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		mapping = nullptr;
+		close();
+		return false;
+	}
+#else
+	fd = ::open(path, writable ? O_RDWR : O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close();
+		return false;
+	}
+	file_size = (uint64_t)st.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+	unmap();
+#ifdef _WIN32
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+	mapping = nullptr;
+	file = nullptr;
+#else
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+	file_size = 0;
+}
+
+bool MappedFile::isOpen() const
+{
+#ifdef _WIN32
+	return mapping != nullptr;
+#else
+	return fd >= 0;
+#endif
+}
+
+void *MappedFile::map(uint64_t offset, size_t length)
+{
+	unmap();
+	if (!isOpen() || length == 0 || offset + length > file_size)
+		return nullptr;
+	uint64_t base = offset - offset % mapGranularity();
+	size_t shift = (size_t)(offset - base);
+#ifdef _WIN32
+	void *p = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, (DWORD)(base >> 32),
+		(DWORD)(base & 0xffffffff), shift + length);
+	if (p == NULL)
+		return nullptr;
+#else
+	void *p = mmap(nullptr, shift + length, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, (off_t)base);
+	if (p == MAP_FAILED)
+		return nullptr;
+#endif
+	view = p;
+	view_length = shift + length;
+	return (char *)p + shift;
+}
+
+void MappedFile::unmap()
+{
+	if (!view)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(view);
+#else
+	munmap(view, view_length);
+#endif
+	view = nullptr;
+	view_length = 0;
+}
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+#include "sstx_file.hpp"
+
+// Checks that the header at BASE describes a .sstx file of SIZE bytes, and
+// that its chunks tile the rows of kernel centers in order.
+static bool layoutFits(const char *base, uint64_t size)
+{
+	SstxHeader header;
+	if (size < sizeof(SstxHeader))
+		return false;
+	memcpy(&header, base, sizeof(SstxHeader));
+	if (memcmp(header.magic, "SSTX", 4) != 0 || header.version != SstxHeader::VERSION || header.chunk_rows == 0 ||
+		header.chunk_count != header.chunkCount() || header.channels != 1 || header.data_type != 0 ||
+		size != header.dataOffset() + (uint64_t)header.tex_w * header.tex_h * header.kernelBytes())
+		return false;
+	const SstxChunk *chunks = (const SstxChunk *)(base + sizeof(SstxHeader));
+	uint32_t next_row = 0;
+	for (uint32_t i = 0; i < header.chunk_count; i++)
+	{
+		if (chunks[i].first_row != next_row || chunks[i].rows == 0 || chunks[i].rows > header.tex_h - next_row ||
+			chunks[i].offset != header.dataOffset() + (uint64_t)next_row * header.tex_w * header.kernelBytes())
+			return false;
+		next_row += chunks[i].rows;
+	}
+	return next_row == header.tex_h;
+}
+
+// Checksum of the header and index at BASE, with the checksum field 0.
+static uint64_t headerChecksum(const char *base)
+{
+	SstxHeader header;
+	memcpy(&header, base, sizeof(SstxHeader));
+	header.checksum = 0;
+	uint64_t hash = sstxChecksum(&header, sizeof(SstxHeader));
+	return sstxChecksum(base + sizeof(SstxHeader), (size_t)header.chunk_count * sizeof(SstxChunk), hash);
+}
+
+bool SstxFile::open(const char *path, bool verify)
+{
+	close();
+	if (!file.open(path, false))
+		return false;
+	base = (const char *)file.map(0, (size_t)file.size());
+	if (!base || !layoutFits(base, file.size()) || headerChecksum(base) != header().checksum)
+	{
+		close();
+		return false;
+	}
+	if (verify)
+	{
+		uint64_t row_bytes = (uint64_t)header().tex_w * header().kernelBytes();
+		for (uint32_t i = 0; i < header().chunk_count; i++)
+		{
+			if (sstxChecksum(base + chunks()[i].offset, (size_t)(chunks()[i].rows * row_bytes)) !=
+				chunks()[i].checksum)
+			{
+				close();
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void SstxFile::close()
+{
+	file.close();
+	base = nullptr;
+}
+
+bool SstxFile::begin(std::ostream &out, const SstxHeader &header)
+{
+	SstxHeader h = header;
+	h.chunk_count = h.chunkCount();
+	h.checksum = 0;
+	h.write(out);
+	vector<char> zeros((size_t)(h.dataOffset() - sizeof(SstxHeader)), 0);
+	out.write(zeros.data(), zeros.size());
+	return out.good();
+}
+
+bool SstxFile::seal(const char *path)
+{
+	MappedFile file;
+	if (!file.open(path, true))
+		return false;
+	char *base = (char *)file.map(0, (size_t)file.size());
+	if (!base)
+		return false;
+	SstxHeader header;
+	memcpy(&header, base, sizeof(SstxHeader));
+	if (memcmp(header.magic, "SSTX", 4) != 0 || header.version != SstxHeader::VERSION || header.chunk_rows == 0 ||
+		file.size() != header.dataOffset() + (uint64_t)header.tex_w * header.tex_h * header.kernelBytes())
+		return false;
+	header.chunk_count = header.chunkCount();
+	header.checksum = 0;
+	memcpy(base, &header, sizeof(SstxHeader));
+	uint64_t row_bytes = (uint64_t)header.tex_w * header.kernelBytes();
+	SstxChunk *chunks = (SstxChunk *)(base + sizeof(SstxHeader));
+	for (uint32_t i = 0; i < header.chunk_count; i++)
+	{
+		SstxChunk &chunk = chunks[i];
+		chunk.first_row = i * header.chunk_rows;
+		chunk.rows = min(header.chunk_rows, header.tex_h - chunk.first_row);
+		chunk.offset = header.dataOffset() + chunk.first_row * row_bytes;
+		chunk.checksum = sstxChecksum(base + chunk.offset, (size_t)(chunk.rows * row_bytes));
+	}
+	header.checksum = headerChecksum(base);
+	memcpy(base, &header, sizeof(SstxHeader));
+	return true;
+}
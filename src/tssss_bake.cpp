@@ -0,0 +1,813 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "haar.hpp"
+#include "sstx.hpp"
+#include "sstx_file.hpp"
+#include "thread_pool.hpp"
+#include "tssss.hpp"
+
+// Kernel baker.
+// --------------------------------
+// Bakes the kernel coefficient file of the HAAR mode on the CPU, from the
+// world position map that mode saves, without a window or an OpenGL
+// context. The kernels are split across all hardware threads, and progress
+// is printed as they are written.
+//
+// usage: tssss-bake [-nonstandard] [-cdf53 | -cdf97] [-threads n] [-cutoff energy]
+//                   [-shard i n | -rows first count] [world_pos_file [coef_file]]
+//        tssss-bake -merge coef_file shard_file...
+//        tssss-bake -codebook [-entries n] [-iterations n] [-threads n] [coef_file [codebook_file]]
+//        tssss-bake -lowrank [-error e] [-rank n] [-threads n] [coef_file [lowrank_file]]
+//
+// The files default to tssss::world_pos_file and tssss::coef_file. The map
+// is saved by haar-test -world-pos, which renders it and exits.
+//
+// The profile is cut off where it holds the given share of its energy,
+// tssss::profile_cutoff_energy by default and none at 0. Only the boxes of
+// the low-pass band that come within the cutoff are evaluated, and only the
+// texels evaluated are zeroed again for the next kernel.
+//
+// Kernels are baked into a shard file, coef_file.FIRST-END for rows FIRST
+// to END - 1 of kernel centers, which records the rows it holds and the
+// bake they belong to (see SstxShardHeader) and is checkpointed after every
+// band of rows. Running the same bake again resumes it after the last
+// checkpoint. Without -shard or -rows all rows go into one shard, which is
+// turned into coef_file and removed once it is complete. -shard i n bakes
+// the i-th of n even ranges of rows and -rows a given one, and leaves the
+// shard; -merge checks that complete shards of one bake cover every row
+// once and assembles them into coef_file. The processes of a bake only
+// share files, so they can run on any machines that see the same ones.
+//
+// -codebook clusters the kernels of a baked coef_file into a codebook of
+// tssss::codebook_entries entries by default (see haar_codebook), each cut
+// down to the tssss::coef_k largest coefficients, and writes it with the
+// entry of every kernel to codebook_file, tssss::codebook_file by default.
+//
+// -lowrank factors the kernels of a baked coef_file through the fewest
+// basis vectors, up to tssss::lowrank_max_rank, that keep all but
+// tssss::lowrank_error of their squared norm (see haar_lowrank), and writes
+// the basis and the weights of every kernel to lowrank_file,
+// tssss::lowrank_file by default. A kernel's dot product with the radiance
+// coefficients is then one of its weights with the basis vectors' dot
+// products, which are shared by every kernel. The rank is capped where the
+// basis and weights would take more floats than the coef_k coefficients of
+// every kernel, and the bake fails without writing lowrank_file when the
+// cap is reached before the error is.
+//
+// -codebook and -lowrank map coef_file rather than read it, and check it
+// against its checksums first (see SstxFile).
+
+// Kernels baked between two checkpoints, rounded to whole rows.
+const int band_kernels = 4096;
+
+// World positions of the texels, one array per coordinate. Texel (row, col)
+// is at col + row * tex_w, the order the kernels are baked in, so that a
+// kernel is a tex_w by tex_h array stored by columns. bounds are the
+// bounds of the boxes, as tssss::boxBounds.
+struct WorldPos
+{
+	vector<float> x;
+	vector<float> y;
+	vector<float> z;
+	vector<float> bounds;
+};
+
+// Buffers of a thread. kernel holds the images of as many kernels as
+// haar_2d_lowpass_batch takes at once, one after the other, and is all 0
+// between two batches; touched holds the entries of it a batch set.
+struct BakeWork
+{
+	vector<float> kernel;
+	vector<size_t> touched;
+	vector<float> work;
+	vector<float> block;
+	vector<const float *> images;
+	vector<int> index;
+	vector<float> value;
+	vector<int> select;
+};
+
+bool readWorldPos(const char *path, WorldPos &pos)
+{
+	int m = tssss::tex_w;
+	int n = tssss::tex_h;
+	vector<float> texels((size_t)m * n * 4);
+
+	ifstream in(path, ios::binary);
+	in.read((char *)texels.data(), texels.size() * sizeof(float));
+	if (!in.good() || in.peek() != EOF)
+		return false;
+
+	pos.x.resize((size_t)m * n);
+	pos.y.resize((size_t)m * n);
+	pos.z.resize((size_t)m * n);
+	for (int row = 0; row < n; row++)
+	{
+		for (int col = 0; col < m; col++)
+		{
+			const float *t = texels.data() + 4 * ((size_t)col * m + row);
+			pos.x[col + (size_t)row * m] = t[0];
+			pos.y[col + (size_t)row * m] = t[1];
+			pos.z[col + (size_t)row * m] = t[2];
+		}
+	}
+	pos.bounds = tssss::boxBounds(texels.data());
+	return true;
+}
+
+// Sets the image at OFFSET in W.kernel to the diffuse profile of the
+// distance from texel CENTER to every texel, as HaarPass2 does, and adds
+// the entries it sets to W.touched. The profile is 0 farther than
+// CUTOFF_RADIUS from the center. Returns false, setting nothing, for a
+// texel the mesh does not cover.
+bool profileKernel(const WorldPos &pos, int center, float cutoff_radius, BakeWork &w, size_t offset)
+{
+	int m = tssss::tex_w;
+	int n = tssss::tex_h;
+	int cm = tssss::coef_w;
+	int cn = tssss::coef_h;
+	float cx = pos.x[center];
+	float cy = pos.y[center];
+	float cz = pos.z[center];
+
+	if (cx == 0 && cy == 0 && cz == 0)
+		return false;
+
+	// Texels past the largest powers of 2 are in no box and do not
+	// contribute, so they stay 0.
+	float center_pos[3] = {cx, cy, cz};
+	float cutoff2 = cutoff_radius * cutoff_radius;
+	int k_w = 1;
+	while (k_w * 2 <= m)
+		k_w *= 2;
+	int k_h = 1;
+	while (k_h * 2 <= n)
+		k_h *= 2;
+	int box_w = k_w / cm;
+	int box_h = k_h / cn;
+	for (int box = 0; box < cm * cn; box++)
+	{
+		if (cutoff2 < tssss::boxDistance2(pos.bounds, box, center_pos))
+			continue;
+		for (int row = box / cm * box_h; row < (box / cm + 1) * box_h; row++)
+		{
+			for (int col = box % cm * box_w; col < (box % cm + 1) * box_w; col++)
+			{
+				int t = col + row * m;
+				float dx = cx - pos.x[t];
+				float dy = cy - pos.y[t];
+				float dz = cz - pos.z[t];
+				float d2 = dx * dx + dy * dy + dz * dz;
+				if (d2 <= cutoff2)
+				{
+					w.kernel[offset + t] = tssss::fDiffuseProfile(sqrt(d2));
+					w.touched.push_back(offset + t);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Keeps the coef_k coefficients of largest magnitude in BLOCK[coef_w *
+// coef_h] in OUT[coef_k].
+void selectKernel(const float block[], BakeWork &w, SstxCoef out[])
+{
+	int cm = tssss::coef_w;
+	int cn = tssss::coef_h;
+	int k = tssss::coef_k;
+	int kept = haar_select_largest(cm * cn, block, k, w.index.data(), w.value.data(), w.select.data());
+	for (int i = 0; i < k; i++)
+		out[i] = i < kept ? SstxCoef{w.index[i], w.value[i]} : SstxCoef{0, 0.0f};
+}
+
+// Bakes the COUNT kernels centered on texels FIRST on into OUT[COUNT *
+// coef_k]: each profile transformed, keeping the coefficients of largest
+// magnitude in the coef_w x coef_h block. Texels the mesh does not cover
+// have no kernel; all its coefficients are 0, so the shader keeps the
+// first coef_k.
+void bakeKernels(const WorldPos &pos, int first, int count, HaarMode mode, Wavelet wavelet, float cutoff_radius,
+	BakeWork &w, SstxCoef out[])
+{
+	int m = tssss::tex_w;
+	int n = tssss::tex_h;
+	int cm = tssss::coef_w;
+	int cn = tssss::coef_h;
+	int k = tssss::coef_k;
+	size_t image = (size_t)m * n;
+
+	for (int i = 0; i < count; i++)
+	{
+		for (int j = 0; j < k; j++)
+			out[(size_t)i * k + j] = {j < cm * cn ? j : 0, 0.0f};
+	}
+
+	// The Haar blocks of up to w.images.size() kernels are computed
+	// together, each on its own; the block of the CDF wavelets is the
+	// leading block of the full transform, which is in place and spreads
+	// the texels over all of it.
+	if (wavelet == Wavelet::HAAR)
+	{
+		int lanes = (int)w.images.size();
+		vector<int> centers;
+		for (int i = 0; i < count;)
+		{
+			centers.clear();
+			for (; i < count && (int)centers.size() < lanes; i++)
+			{
+				if (profileKernel(pos, first + i, cutoff_radius, w, centers.size() * image))
+					centers.push_back(i);
+			}
+			if (centers.empty())
+				continue;
+			haar_2d_lowpass_batch((int)centers.size(), m, n, w.images.data(), cm, cn, w.block.data(), w.work.data(),
+				mode);
+			for (size_t t : w.touched)
+				w.kernel[t] = 0;
+			w.touched.clear();
+			for (size_t b = 0; b < centers.size(); b++)
+				selectKernel(w.block.data() + b * cm * cn, w, out + (size_t)centers[b] * k);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (!profileKernel(pos, first + i, cutoff_radius, w, 0))
+				continue;
+			wavelet_2d_dual(m, n, w.kernel.data(), w.work.data(), wavelet, mode);
+			for (int j = 0; j < cn; j++)
+				memcpy(w.block.data() + j * cm, w.kernel.data() + (size_t)j * m, cm * sizeof(float));
+			fill(w.kernel.begin(), w.kernel.begin() + image, 0.0f);
+			w.touched.clear();
+			selectKernel(w.block.data(), w, out + (size_t)i * k);
+		}
+	}
+}
+
+// Shard file of rows [FIRST_ROW, END_ROW) of the bake into COEF_PATH.
+string shardPath(const char *coef_path, int first_row, int end_row)
+{
+	return string(coef_path) + "." + to_string(first_row) + "-" + to_string(end_row);
+}
+
+// Bakes rows [FIRST_ROW, FIRST_ROW + ROWS) of kernel centers into the shard
+// file at PATH, resuming it if it is a shard of the same rows and bake. Any
+// other file at PATH is left alone.
+bool bakeShard(const WorldPos &pos, const SstxHeader &sstx_header, int first_row, int rows, ThreadPool &pool,
+	vector<BakeWork> &work, const string &path)
+{
+	int m = sstx_header.tex_w;
+	int k = sstx_header.coef_k;
+	HaarMode mode = (HaarMode)sstx_header.haar_mode;
+	Wavelet wavelet = (Wavelet)sstx_header.wavelet;
+	float cutoff_radius = sstx_header.cutoff_radius;
+	int band_rows = max(band_kernels / m, 1);
+	size_t row_bytes = (size_t)m * k * sizeof(SstxCoef);
+	size_t data_offset = sizeof(SstxShardHeader) + sizeof(SstxHeader);
+
+	SstxShardHeader shard;
+	fstream file(path, ios::in | ios::out | ios::binary);
+	if (file.is_open())
+	{
+		SstxHeader header;
+		if (!shard.read(file) || !header.read(file) || shard.first_row != (uint32_t)first_row ||
+			shard.rows != (uint32_t)rows || memcmp(&header, &sstx_header, sizeof(SstxHeader)) != 0)
+		{
+			cerr << "tssss-bake: " << path << " is not a shard of this bake, remove it to start over\n";
+			return false;
+		}
+		if (shard.rows_done == shard.rows)
+		{
+			cout << path << " is complete\n";
+			return true;
+		}
+		cout << "Resuming " << path << " at row " << first_row + shard.rows_done << "\n";
+	}
+	else
+	{
+		file.open(path, ios::in | ios::out | ios::trunc | ios::binary);
+		shard.first_row = first_row;
+		shard.rows = rows;
+		if (!shard.write(file) || !sstx_header.write(file))
+		{
+			cerr << "tssss-bake: cannot write " << path << "\n";
+			return false;
+		}
+	}
+
+	int kernels = (rows - shard.rows_done) * m;
+	cout << "Baking rows " << first_row + shard.rows_done << " to " << first_row + rows - 1 << ", " << kernels
+		 << " kernels, into " << path << " on " << pool.size() << " threads\n";
+	vector<SstxCoef> band((size_t)band_rows * m * k);
+	auto start = chrono::steady_clock::now();
+	auto reported = start;
+	int done = 0;
+	for (int row = shard.rows_done; row < rows; row += band_rows)
+	{
+		int count = min(band_rows, rows - row) * m;
+		int first = (first_row + row) * m;
+		pool.parallelFor(count, [&](int lo, int hi, int thread) {
+			bakeKernels(pos, first + lo, hi - lo, mode, wavelet, cutoff_radius, work[thread],
+				band.data() + (size_t)lo * k);
+		});
+
+		// The rows go into the file before the checkpoint counts them, so a
+		// stop in between only bakes them again.
+		file.seekp(data_offset + row * row_bytes);
+		file.write((char *)band.data(), (size_t)count * k * sizeof(SstxCoef));
+		file.flush();
+		shard.rows_done = row + count / m;
+		file.seekp(0);
+		if (!file.good() || !shard.write(file) || !file.flush().good())
+		{
+			cerr << "tssss-bake: cannot write " << path << "\n";
+			return false;
+		}
+
+		auto now = chrono::steady_clock::now();
+		done += count;
+		if (chrono::duration<double>(now - reported).count() >= 1.0 || done == kernels)
+		{
+			double elapsed = chrono::duration<double>(now - start).count();
+			printf("  %d / %d kernels (%.1f%%), %.0f s elapsed, %.0f s left\n", done, kernels, 100.0 * done / kernels,
+				elapsed, elapsed * (kernels - done) / done);
+			fflush(stdout);
+			reported = now;
+		}
+	}
+	return true;
+}
+
+// Assembles the shard files at PATHS, complete shards of one bake that hold
+// every row of it once, into the coefficient file at OUT_PATH.
+bool mergeShards(const char *out_path, const vector<const char *> &paths)
+{
+	struct Shard
+	{
+		const char *path;
+		SstxShardHeader header;
+	};
+	vector<Shard> shards;
+	SstxHeader sstx_header;
+
+	for (const char *path : paths)
+	{
+		ifstream in(path, ios::binary);
+		Shard shard;
+		shard.path = path;
+		SstxHeader header;
+		if (!shard.header.read(in) || !header.read(in))
+		{
+			cerr << "tssss-bake: " << path << " is not a shard file\n";
+			return false;
+		}
+		if (shard.header.rows_done != shard.header.rows)
+		{
+			cerr << "tssss-bake: " << path << " is not complete, " << shard.header.rows_done << " of "
+				 << shard.header.rows << " rows are baked\n";
+			return false;
+		}
+		if (!shards.empty() && memcmp(&header, &sstx_header, sizeof(SstxHeader)) != 0)
+		{
+			cerr << "tssss-bake: " << path << " is a shard of another bake than " << shards[0].path << "\n";
+			return false;
+		}
+		sstx_header = header;
+		shards.push_back(shard);
+	}
+
+	sort(shards.begin(), shards.end(),
+		[](const Shard &a, const Shard &b) { return a.header.first_row < b.header.first_row; });
+	uint32_t next_row = 0;
+	for (const Shard &shard : shards)
+	{
+		if (shard.header.first_row != next_row)
+		{
+			cerr << "tssss-bake: " << shard.path << " starts at row " << shard.header.first_row << ", not "
+				 << next_row << "\n";
+			return false;
+		}
+		next_row += shard.header.rows;
+	}
+	if (next_row != sstx_header.tex_h)
+	{
+		cerr << "tssss-bake: rows " << next_row << " to " << sstx_header.tex_h - 1 << " are in no shard\n";
+		return false;
+	}
+
+	ofstream out(out_path, ios::binary);
+	if (!SstxFile::begin(out, sstx_header))
+	{
+		cerr << "tssss-bake: cannot write " << out_path << "\n";
+		return false;
+	}
+	size_t row_bytes = (size_t)sstx_header.tex_w * sstx_header.coef_k * sizeof(SstxCoef);
+	vector<char> buffer(row_bytes);
+	for (const Shard &shard : shards)
+	{
+		ifstream in(shard.path, ios::binary);
+		in.seekg(sizeof(SstxShardHeader) + sizeof(SstxHeader));
+		for (uint32_t row = 0; row < shard.header.rows; row++)
+		{
+			if (!in.read(buffer.data(), row_bytes))
+			{
+				cerr << "tssss-bake: " << shard.path << " is shorter than its header says\n";
+				return false;
+			}
+			out.write(buffer.data(), row_bytes);
+		}
+	}
+	out.close();
+	if (!out.good() || !SstxFile::seal(out_path))
+	{
+		cerr << "tssss-bake: cannot write " << out_path << "\n";
+		return false;
+	}
+	cout << "Merged " << shards.size() << " shards into " << out_path << "\n";
+	return true;
+}
+
+// Clusters the kernels of the coefficient file at COEF_PATH into a codebook
+// of ENTRIES entries and writes it to CODEBOOK_PATH.
+bool bakeCodebook(const char *coef_path, const char *codebook_path, int entries, int iterations, ThreadPool &pool)
+{
+	SstxFile coef_file;
+	if (!coef_file.open(coef_path, true))
+	{
+		cerr << "tssss-bake: " << coef_path << " is not a coefficient file or is damaged\n";
+		return false;
+	}
+	const SstxHeader &sstx_header = coef_file.header();
+	int kernels = sstx_header.tex_w * sstx_header.tex_h;
+	int k = sstx_header.coef_k;
+	int dim = sstx_header.coef_w * sstx_header.coef_h;
+	const SstxCoef *coefs = coef_file.kernels();
+	if (entries < 1 || entries > kernels)
+	{
+		cerr << "tssss-bake: a codebook of " << kernels << " kernels has 1 to " << kernels << " entries\n";
+		return false;
+	}
+
+	cout << "Clustering " << kernels << " kernels into " << entries << " entries on " << pool.size() << " threads\n";
+	auto start = chrono::steady_clock::now();
+	vector<float> codebook((size_t)entries * dim);
+	vector<int> assignment(kernels);
+	double error = haar_codebook(kernels, k, coefs, dim, entries, iterations, 1, pool, codebook.data(),
+		assignment.data());
+
+	// The entries keep as many coefficients as the kernels, so the shaders
+	// read them as they would the kernels. The dropped ones are zeroed to
+	// measure the error of what is kept.
+	vector<SstxCoef> sparse((size_t)entries * k);
+	vector<int> index(k);
+	vector<float> value(k);
+	vector<int> select(dim);
+	vector<double> entry_norm2(entries);
+	for (int e = 0; e < entries; e++)
+	{
+		float *c = codebook.data() + (size_t)e * dim;
+		int kept = haar_select_largest(dim, c, k, index.data(), value.data(), select.data());
+		fill(c, c + dim, 0.0f);
+		for (int i = 0; i < k; i++)
+		{
+			sparse[(size_t)e * k + i] = i < kept ? SstxCoef{index[i], value[i]} : SstxCoef{0, 0.0f};
+			if (i < kept)
+			{
+				c[index[i]] = value[i];
+				entry_norm2[e] += (double)value[i] * value[i];
+			}
+		}
+	}
+	double error_sum = 0;
+	double norm2_sum = 0;
+	for (int t = 0; t < kernels; t++)
+	{
+		const SstxCoef *x = coefs + (size_t)t * k;
+		const float *c = codebook.data() + (size_t)assignment[t] * dim;
+		double norm2 = 0;
+		double dot = 0;
+		for (int i = 0; i < k; i++)
+		{
+			norm2 += (double)x[i].value * x[i].value;
+			dot += (double)x[i].value * c[x[i].index];
+		}
+		error_sum += max(norm2 - 2 * dot + entry_norm2[assignment[t]], 0.0);
+		norm2_sum += norm2;
+	}
+
+	SstxCodebookHeader codebook_header;
+	codebook_header.entries = entries;
+	codebook_header.error = (float)(0 < norm2_sum ? error_sum / norm2_sum : 0);
+	vector<uint32_t> entry_of(assignment.begin(), assignment.end());
+	ofstream out(codebook_path, ios::binary);
+	codebook_header.write(out);
+	sstx_header.write(out);
+	out.write((char *)sparse.data(), sparse.size() * sizeof(SstxCoef));
+	out.write((char *)entry_of.data(), entry_of.size() * sizeof(uint32_t));
+	out.close();
+	if (!out.good())
+	{
+		cerr << "tssss-bake: cannot write " << codebook_path << "\n";
+		return false;
+	}
+	printf("Wrote %d entries to %s in %.0f s, squared error %.3g of the kernels' (%.3g before cutting the entries to "
+		   "%d coefficients)\n",
+		entries, codebook_path, chrono::duration<double>(chrono::steady_clock::now() - start).count(),
+		codebook_header.error, error, k);
+	return true;
+}
+
+// Factors the kernels of the coefficient file at COEF_PATH through a basis
+// of at most MAX_RANK vectors that loses at most ERROR of their squared
+// norm and writes it to LOWRANK_PATH. MAX_RANK is lowered to keep the file
+// no larger than the kernels, and nothing is written if ERROR is not met.
+bool bakeLowRank(const char *coef_path, const char *lowrank_path, double error, int max_rank, ThreadPool &pool)
+{
+	SstxFile coef_file;
+	if (!coef_file.open(coef_path, true))
+	{
+		cerr << "tssss-bake: " << coef_path << " is not a coefficient file or is damaged\n";
+		return false;
+	}
+	const SstxHeader &sstx_header = coef_file.header();
+	int kernels = sstx_header.tex_w * sstx_header.tex_h;
+	int k = sstx_header.coef_k;
+	int dim = sstx_header.coef_w * sstx_header.coef_h;
+	const SstxCoef *coefs = coef_file.kernels();
+	if (max_rank < 1)
+	{
+		cerr << "tssss-bake: the rank is at least 1\n";
+		return false;
+	}
+	// The weights and the basis take no more floats than the sparse kernels,
+	// 2 * k per kernel, or the factorization is not worth sampling.
+	int size_rank = (int)(2 * (int64_t)k * kernels / ((int64_t)kernels + dim));
+	if (size_rank < max_rank)
+	{
+		cout << "Rank " << max_rank << " would outweigh the kernels, factoring to at most rank " << size_rank
+			 << "\n";
+		max_rank = size_rank;
+	}
+
+	cout << "Factoring " << kernels << " kernels of " << dim << " coefficients to within " << error << " on "
+		 << pool.size() << " threads\n";
+	auto start = chrono::steady_clock::now();
+	vector<float> basis((size_t)max_rank * dim);
+	vector<float> weights((size_t)kernels * max_rank);
+	double rank_error;
+	int rank = haar_lowrank(kernels, k, coefs, dim, error, max_rank, tssss::lowrank_power_iterations, 1, pool,
+		basis.data(), weights.data(), &rank_error);
+	if (error < rank_error)
+	{
+		cerr << "tssss-bake: rank " << rank << " loses " << rank_error << " of the kernels' squared norm, more than "
+			 << error << "; " << lowrank_path << " is not written\n";
+		return false;
+	}
+
+	SstxLowRankHeader lowrank_header;
+	lowrank_header.rank = rank;
+	lowrank_header.error = (float)rank_error;
+	ofstream out(lowrank_path, ios::binary);
+	lowrank_header.write(out);
+	sstx_header.write(out);
+	out.write((char *)basis.data(), (size_t)rank * dim * sizeof(float));
+	out.write((char *)weights.data(), (size_t)kernels * rank * sizeof(float));
+	out.close();
+	if (!out.good())
+	{
+		cerr << "tssss-bake: cannot write " << lowrank_path << "\n";
+		return false;
+	}
+	printf("Wrote rank %d to %s in %.0f s, squared error %.3g of the kernels', %d weights per kernel for %d "
+		   "coefficients\n",
+		rank, lowrank_path, chrono::duration<double>(chrono::steady_clock::now() - start).count(), rank_error, rank,
+		k);
+	return true;
+}
+
+void usage()
+{
+	cerr << "usage: tssss-bake [-nonstandard] [-cdf53 | -cdf97] [-threads n] [-cutoff energy]\n"
+			"                  [-shard i n | -rows first count] [world_pos_file [coef_file]]\n"
+			"       tssss-bake -merge coef_file shard_file...\n"
+			"       tssss-bake -codebook [-entries n] [-iterations n] [-threads n] [coef_file [codebook_file]]\n"
+			"       tssss-bake -lowrank [-error e] [-rank n] [-threads n] [coef_file [lowrank_file]]\n";
+}
+
+int main(int argc, char **argv)
+{
+	HaarMode mode = HaarMode::STANDARD;
+	Wavelet wavelet = Wavelet::HAAR;
+	int num_threads = 0;
+	double cutoff_energy = tssss::profile_cutoff_energy;
+	const char *files[2] = {tssss::world_pos_file, tssss::coef_file};
+	int file_count = 0;
+	int n = tssss::tex_h;
+	int first_row = 0;
+	int rows = n;
+	bool sharded = false;
+
+	if (argc > 1 && !strcmp(argv[1], "-merge"))
+	{
+		if (argc < 4)
+		{
+			usage();
+			return 1;
+		}
+		return mergeShards(argv[2], vector<const char *>(argv + 3, argv + argc)) ? 0 : 1;
+	}
+
+	if (argc > 1 && !strcmp(argv[1], "-codebook"))
+	{
+		int entries = tssss::codebook_entries;
+		int iterations = tssss::codebook_iterations;
+		const char *codebook_files[2] = {tssss::coef_file, tssss::codebook_file};
+		for (int i = 2; i < argc; i++)
+		{
+			if (!strcmp(argv[i], "-entries") && i + 1 < argc)
+			{
+				entries = atoi(argv[++i]);
+			}
+			else if (!strcmp(argv[i], "-iterations") && i + 1 < argc)
+			{
+				iterations = atoi(argv[++i]);
+			}
+			else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+			{
+				num_threads = atoi(argv[++i]);
+			}
+			else if (argv[i][0] != '-' && file_count < 2)
+			{
+				codebook_files[file_count++] = argv[i];
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+		ThreadPool pool(num_threads);
+		return bakeCodebook(codebook_files[0], codebook_files[1], entries, iterations, pool) ? 0 : 1;
+	}
+
+	if (argc > 1 && !strcmp(argv[1], "-lowrank"))
+	{
+		double error = tssss::lowrank_error;
+		int max_rank = tssss::lowrank_max_rank;
+		const char *lowrank_files[2] = {tssss::coef_file, tssss::lowrank_file};
+		for (int i = 2; i < argc; i++)
+		{
+			if (!strcmp(argv[i], "-error") && i + 1 < argc)
+			{
+				error = atof(argv[++i]);
+			}
+			else if (!strcmp(argv[i], "-rank") && i + 1 < argc)
+			{
+				max_rank = atoi(argv[++i]);
+			}
+			else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+			{
+				num_threads = atoi(argv[++i]);
+			}
+			else if (argv[i][0] != '-' && file_count < 2)
+			{
+				lowrank_files[file_count++] = argv[i];
+			}
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+		ThreadPool pool(num_threads);
+		return bakeLowRank(lowrank_files[0], lowrank_files[1], error, max_rank, pool) ? 0 : 1;
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-nonstandard"))
+		{
+			mode = HaarMode::NONSTANDARD;
+		}
+		else if (!strcmp(argv[i], "-cdf53"))
+		{
+			wavelet = Wavelet::CDF53;
+		}
+		else if (!strcmp(argv[i], "-cdf97"))
+		{
+			wavelet = Wavelet::CDF97;
+		}
+		else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+		{
+			num_threads = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-cutoff") && i + 1 < argc)
+		{
+			cutoff_energy = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-shard") && i + 2 < argc && !sharded)
+		{
+			int shard = atoi(argv[++i]);
+			int shards = atoi(argv[++i]);
+			if (shards < 1 || shards > n || shard < 0 || shard >= shards)
+			{
+				cerr << "tssss-bake: shard " << shard << " of " << shards << " is not one of 0 to n - 1, n 1 to " << n
+					 << "\n";
+				return 1;
+			}
+			first_row = shard * n / shards;
+			rows = (shard + 1) * n / shards - first_row;
+			sharded = true;
+		}
+		else if (!strcmp(argv[i], "-rows") && i + 2 < argc && !sharded)
+		{
+			first_row = atoi(argv[++i]);
+			rows = atoi(argv[++i]);
+			if (first_row < 0 || rows < 1 || first_row + rows > n)
+			{
+				cerr << "tssss-bake: rows " << first_row << " to " << first_row + rows - 1 << " are not in 0 to "
+					 << n - 1 << "\n";
+				return 1;
+			}
+			sharded = true;
+		}
+		else if (argv[i][0] != '-' && file_count < 2)
+		{
+			files[file_count++] = argv[i];
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	WorldPos pos;
+	if (!readWorldPos(files[0], pos))
+	{
+		cerr << "tssss-bake: cannot read " << files[0] << " as a " << tssss::tex_w << " x " << tssss::tex_h
+			 << " RGBA32F world position map\n";
+		return 1;
+	}
+
+	ThreadPool pool(num_threads);
+	int m = tssss::tex_w;
+	int cm = tssss::coef_w;
+	int cn = tssss::coef_h;
+	int k = tssss::coef_k;
+
+	int lanes = wavelet == Wavelet::HAAR ? haar_2d_lowpass_batch_lanes<float>() : 1;
+	vector<BakeWork> work(pool.size());
+	for (BakeWork &w : work)
+	{
+		w.kernel.resize((size_t)lanes * m * n);
+		w.images.resize(lanes);
+		for (int b = 0; b < lanes; b++)
+			w.images[b] = w.kernel.data() + (size_t)b * m * n;
+		if (wavelet == Wavelet::HAAR)
+			w.work.resize(haar_2d_lowpass_batch_work_size<float>(m, n, cm, cn));
+		else
+			w.work.resize(wavelet_2d_work_size(m, n));
+		w.block.resize((size_t)lanes * cm * cn);
+		w.index.resize(k);
+		w.value.resize(k);
+		w.select.resize(cm * cn);
+	}
+
+	SstxHeader sstx_header;
+	sstx_header.tex_w = m;
+	sstx_header.tex_h = n;
+	sstx_header.coef_w = cm;
+	sstx_header.coef_h = cn;
+	sstx_header.haar_mode = (uint32_t)mode;
+	sstx_header.coef_k = k;
+	sstx_header.wavelet = (uint32_t)wavelet;
+	sstx_header.cutoff_radius = tssss::profileCutoffRadius(cutoff_energy);
+	sstx_header.profile_a = tssss::profile_a;
+	sstx_header.profile_s = tssss::profile_s;
+	if (isfinite(sstx_header.cutoff_radius))
+		cout << "Kernels are cut off at " << sstx_header.cutoff_radius << " from their centers\n";
+
+	string shard_path = shardPath(files[1], first_row, first_row + rows);
+	if (!bakeShard(pos, sstx_header, first_row, rows, pool, work, shard_path))
+		return 1;
+	if (!sharded)
+	{
+		if (!mergeShards(files[1], {shard_path.c_str()}))
+			return 1;
+		remove(shard_path.c_str());
+	}
+
+	return 0;
+}